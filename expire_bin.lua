@@ -32,9 +32,26 @@
 -- local expbin = require("expire_bin");
 -- eb.get(rec, bin);
 
+-- =========================================================================
+-- RECORD TTL
+-- =========================================================================
+--
+-- Writes check every bin TTL against the TTL the record will have, see
+-- known_ttl(). That is the pttl option if the client's write policy sets a
+-- TTL, else the record's own, else for a new record the namespace
+-- default-ttl from the dttl option. A client that passes neither for a new
+-- record costs a second write: the record is created to learn its TTL, then
+-- removed again if a bin TTL is rejected, or with the ext option updated
+-- again to raise the TTL. The C client passes both.
+
 -- =========================================================================
 -- Debug Flags
 -- =========================================================================
+-- F enables the debug lines. A client that asks for a log level rewrites this
+-- line when registering the module (see log_level in src/c/as_expbin.h), so
+-- keep it on one line. With F false no debug argument is evaluated, and
+-- "make lua-strip" in src/c builds a copy with the debug lines removed
+-- altogether.
 local GP;
 local F = true;
 
@@ -43,19 +60,58 @@ local F = true;
 -- =========================================================================
 local EXP_ID = "expbin_ttl";
 local EXP_DATA = "data";
+-- Integer bin holding the earliest expiry of the record's expbins, for a
+-- secondary index range query by the cleaner. Absent when none expires.
+local NEXT_EXP = "expbin_next";
 local CITRUSLEAF_EPOCH = 1262304000
+-- Options map fields (trailing map argument, see split_opts)
+local OPT_MARK = "opts";
+local OPT_FMT = "fmt";
+local OPT_DTTL = "dttl";
+local OPT_PTTL = "pttl";
+local OPT_SHADOW = "shadow";
+local OPT_EXT = "ext";
+local OPT_SHRINK = "shrink";
+local OPT_REPAIR = "repair";
+local FMT_COMPACT = "compact";
+-- Compact envelope: magic (2), version (1), payload type (1),
+-- big-endian expiry (4), then the raw payload
+local ENV_MAGIC0 = 0xEB;
+local ENV_MAGIC1 = 0xB1;
+local ENV_VERSION = 1;
+local ENV_HDR = 8;
+local ENV_INTEGER = 1;
+local ENV_STRING = 3;
+local ENV_BLOB = 4;
 -- Type Checking Vars
 local Map = getmetatable(map());
+local List = getmetatable(list());
+local Bytes = getmetatable(bytes(1));
 
 -- ========================================================================= 
 -- Utility functions
 -- ========================================================================= 
 
--- Get time for TTL
+-- Get time for TTL. Read it once per call and pass it down, rather than
+-- once per bin.
 local function get_time()
 	return os.time() - CITRUSLEAF_EPOCH
 end
 
+-- Check if bin is a compact envelope expbin
+local function is_env(bin)
+	if (bin ~= nil
+		and type(bin) == 'userdata'
+		and getmetatable(bin) == Bytes
+		and bytes.size(bin) >= ENV_HDR
+		and bytes.get_byte(bin, 1) == ENV_MAGIC0
+		and bytes.get_byte(bin, 2) == ENV_MAGIC1
+		and bytes.get_byte(bin, 3) == ENV_VERSION) then
+		return true;
+	end
+	return false;
+end
+
 -- Check if bin is an expbin
 local function is_expbin(bin)
 	if (bin ~= nil 
@@ -64,7 +120,173 @@ local function is_expbin(bin)
 		and bin[EXP_ID] ~= nil) then
 		return true;
 	end
-	return false;
+	return is_env(bin);
+end
+
+-- Get the stored expiry of an expbin
+local function get_expiry(bin)
+	if (is_env(bin)) then
+		return bytes.get_int32_be(bin, 5);
+	end
+	return bin[EXP_ID];
+end
+
+-- Get the stored value of an expbin
+local function get_data(bin)
+	if (is_env(bin)) then
+		local kind = bytes.get_byte(bin, 4);
+		local len = bytes.size(bin) - ENV_HDR;
+		if (kind == ENV_INTEGER) then
+			return bytes.get_int64_be(bin, ENV_HDR + 1);
+		elseif (kind == ENV_STRING) then
+			return bytes.get_string(bin, ENV_HDR + 1, len);
+		else
+			return bytes.get_bytes(bin, ENV_HDR + 1, len);
+		end
+	end
+	return bin[EXP_DATA];
+end
+
+-- Encode val as a compact envelope, nil if val has no compact form
+local function env_encode(val, expiry)
+	local kind, len;
+	if (type(val) == 'string') then
+		kind, len = ENV_STRING, string.len(val);
+	elseif (type(val) == 'number' and math.floor(val) == val) then
+		kind, len = ENV_INTEGER, 8;
+	elseif (type(val) == 'userdata' and getmetatable(val) == Bytes) then
+		kind, len = ENV_BLOB, bytes.size(val);
+	else
+		return nil;
+	end
+	local env = bytes(ENV_HDR + len);
+	bytes.append_byte(env, ENV_MAGIC0);
+	bytes.append_byte(env, ENV_MAGIC1);
+	bytes.append_byte(env, ENV_VERSION);
+	bytes.append_byte(env, kind);
+	bytes.append_int32_be(env, expiry);
+	if (kind == ENV_STRING) then
+		bytes.append_string(env, val);
+	elseif (kind == ENV_INTEGER) then
+		bytes.append_int64_be(env, val);
+	else
+		bytes.append_bytes(env, val, len);
+	end
+	return env;
+end
+
+-- Build an expbin holding val, in the format requested by opts
+local function make_expbin(val, expiry, opts)
+	if (opts ~= nil and opts[OPT_FMT] == FMT_COMPACT) then
+		local env = env_encode(val, expiry);
+		if (env ~= nil) then
+			return env;
+		end
+	end
+	local map_bin = map();
+	map_bin[EXP_ID] = expiry;
+	map_bin[EXP_DATA] = val;
+	return map_bin;
+end
+
+-- Return a copy of an expbin with a new expiry
+local function set_expiry(bin, expiry)
+	if (is_env(bin)) then
+		bytes.set_int32_be(bin, 5, expiry);
+	else
+		bin[EXP_ID] = expiry;
+	end
+	return bin;
+end
+
+-- Lower the record's earliest expiry to expiry. Bins that never expire don't
+-- count. This may leave it earlier than every bin's expiry, which only
+-- costs the cleaner a visit, and clean puts it right.
+local function lower_next(rec, expiry)
+	if (expiry ~= 0) then
+		local cur = rec[NEXT_EXP];
+		if (cur == nil or expiry < cur) then
+			rec[NEXT_EXP] = expiry;
+		end
+	end
+end
+
+-- Recompute the record's earliest expiry from all of its expbins
+local function refresh_next(rec)
+	local next_exp = nil;
+	local names = record.bin_names(rec);
+	for i = 1, #names do
+		local bin = rec[names[i]];
+		if (is_expbin(bin)) then
+			local expiry = get_expiry(bin);
+			if (expiry ~= 0 and (next_exp == nil or expiry < next_exp)) then
+				next_exp = expiry;
+			end
+		end
+	end
+	rec[NEXT_EXP] = next_exp;
+end
+
+-- Mirror an expbin's value into its shadow bin, the bin name behind the
+-- shadow option's prefix, for a secondary index. Only integers and strings
+-- can be indexed, the shadow of any other value (or nil) is removed.
+local function set_shadow(rec, bin, val, opts)
+	if (opts == nil or opts[OPT_SHADOW] == nil) then
+		return;
+	end
+	local name = opts[OPT_SHADOW] .. bin;
+	if (type(val) == 'string' or (type(val) == 'number' and math.floor(val) == val)) then
+		rec[name] = val;
+	else
+		rec[name] = nil;
+	end
+end
+
+-- The record TTL clean can shrink the record to: the seconds until the
+-- latest expiry of its expbins. 0 if none is left live, nil if a bin never
+-- expires or isn't an expbin. Shadow bins and the next expiry bin go with
+-- the expbins, so they don't count.
+local function shrink_ttl(rec, now, opts)
+	local prefix = opts[OPT_SHADOW];
+	local latest = 0;
+	local names = record.bin_names(rec);
+	for i = 1, #names do
+		local name = names[i];
+		local bin = rec[name];
+		if (bin == nil or name == NEXT_EXP
+			or (prefix ~= nil and string.sub(name, 1, #prefix) == prefix)) then
+			-- Erased by this clean, or follows an expbin
+		elseif (not is_expbin(bin)) then
+			return nil;
+		else
+			local expiry = get_expiry(bin);
+			if (expiry == 0) then
+				return nil;
+			end
+			if (expiry > latest) then
+				latest = expiry;
+			end
+		end
+	end
+	if (latest < now) then
+		return 0;
+	end
+	-- A bin is live through its expiry second
+	return latest - now + 1;
+end
+
+-- Split a trailing options map off the variadic arguments. An options map
+-- is marked with opts = 1, so no entry map is mistaken for one.
+local function split_opts(arg)
+	local last = arg[arg.n];
+	if (arg.n > 0
+		and type(last) == 'userdata'
+		and getmetatable(last) == Map
+		and last[OPT_MARK] == 1) then
+		arg.n = arg.n - 1;
+		return last;
+	end
+	return nil;
 end
 
 -- Check if bin_ttl is valid for a given rec_ttl
@@ -81,10 +303,34 @@ local function valid_time(bin_ttl, rec_ttl)
 	return true;
 end
 
--- Check whether bin_ttl has expired yet
-local function not_expired(bin_ttl)
+-- Whether the ext option lets bin TTLs raise the record TTL
+local function can_extend(opts)
+	return (opts ~= nil and opts[OPT_EXT] == 1);
+end
+
+-- The record TTL bin TTLs are checked against: rec_ttl, or none if the ext
+-- option lets them raise it
+local function check_ttl(rec_ttl, opts)
+	if (can_extend(opts)) then
+		return math.huge;
+	end
+	return rec_ttl;
+end
+
+-- With the ext option, raise the record TTL to max_ttl if rec_ttl is
+-- shorter. Called before the write, which then stores the new TTL with
+-- the bins.
+local function extend_ttl(rec, rec_ttl, max_ttl, opts)
+	if (can_extend(opts) and rec_ttl ~= nil and max_ttl ~= nil and max_ttl > rec_ttl) then
+		GP=F and debug("<extend_ttl> Raising record TTL %s to %s", tostring(rec_ttl), tostring(max_ttl));
+		record.set_ttl(rec, max_ttl);
+	end
+end
+
+-- Check whether bin_ttl has expired yet at time now
+local function not_expired(bin_ttl, now)
 	if (bin_ttl ~= nil) then
-		if (bin_ttl == 0 or get_time() <= bin_ttl) then
+		if (bin_ttl == 0 or now <= bin_ttl) then
 			return true;
 		end
 	end
@@ -92,12 +338,12 @@ local function not_expired(bin_ttl)
 end
 
 -- Get the bin value from an expbin if it hasn't expired
-local function get_bin(bin_map)
+local function get_bin(bin_map, now)
 	local meth = "get_bin";
 	GP=F and debug("<%s> Bin: %s", meth, tostring(bin_map));
 	if (is_expbin(bin_map)) then
-		if (not_expired(bin_map[EXP_ID])) then
-			return bin_map[EXP_DATA];
+		if (not_expired(get_expiry(bin_map), now)) then
+			return get_data(bin_map);
 		else
 			GP=F and debug("<%s> Bin has expired, returning nil", meth);
 			return nil;
@@ -108,17 +354,183 @@ local function get_bin(bin_map)
 	end
 end
 
--- Update or create record
-local function push_rec(rec)
-	local meth = "push_rec";
-	GP=F and debug("<%s> Rec: %s", meth, tostring(rec));
-	if aerospike:exists(rec) then
-		GP=F and debug("<%s> Record exists, updating record", meth);
+-- Estimate the stored size of a value in bytes
+local function val_size(val)
+	local t = type(val);
+	if (t == 'string') then
+		return #val;
+	elseif (t == 'userdata') then
+		local mt = getmetatable(val);
+		if (mt == Bytes) then
+			return bytes.size(val);
+		end
+		local size = 0;
+		if (mt == List) then
+			for i = 1, list.size(val) do
+				size = size + val_size(val[i]);
+			end
+		elseif (mt == Map) then
+			for k, v in map.pairs(val) do
+				size = size + val_size(k) + val_size(v);
+			end
+		end
+		return size;
+	end
+	return 8;
+end
+
+-- Estimate the stored size of an expbin in bytes, for read repair
+local function expbin_size(bin)
+	if (is_env(bin)) then
+		return bytes.size(bin);
+	end
+	return #EXP_ID + 8 + #EXP_DATA + val_size(get_data(bin));
+end
+
+-- Write rec, creating it if it doesn't exist
+local function write_rec(rec, exists)
+	if exists then
 		return aerospike:update(rec);
-	else
-		GP=F and debug("<%s> Record doesn't exist, creating record", meth);
-		return aerospike:create(rec);
 	end
+	return aerospike:create(rec);
+end
+
+-- Get the record TTL a write will see: the write policy's if the client
+-- passed it, the record's own, or the namespace default-ttl for a new record
+-- if the client passed it (0 = never). nil if it can't be known until the
+-- record is created.
+local function known_ttl(rec, exists, opts)
+	if (opts ~= nil and opts[OPT_PTTL] ~= nil) then
+		if (opts[OPT_PTTL] == -1) then
+			return math.huge;
+		end
+		return opts[OPT_PTTL];
+	end
+	if exists then
+		return record.ttl(rec);
+	end
+	if (opts ~= nil and opts[OPT_DTTL] ~= nil) then
+		if (opts[OPT_DTTL] == 0) then
+			return math.huge;
+		end
+		return opts[OPT_DTTL];
+	end
+	return nil;
+end
+
+-- Set one put in rec without writing it. Without a bin TTL, a bin that isn't
+-- an expbin is set as a normal bin. Returns false if the bin TTL conflicts
+-- with rec_ttl, otherwise true and the bin TTL used (nil for a normal bin).
+local function stage_put(rec, bin, val, bin_ttl, opts, rec_ttl, now)
+	local meth = "stage_put";
+	if (bin_ttl == nil and not is_expbin(rec[bin])) then
+		GP=F and debug("<%s> Setting normal bin %s", meth, bin);
+		rec[bin] = val;
+		return true, nil;
+	end
+	if (not valid_time(bin_ttl, check_ttl(rec_ttl or math.huge, opts))) then
+		GP=F and debug("<%s> Record and Bin TTL conflict Bin %s, Rec %s", meth, tostring(bin_ttl), tostring(rec_ttl));
+		return false;
+	end
+	local expiry = 0;
+	if (bin_ttl ~= -1) then
+		expiry = bin_ttl + now;
+	end
+	rec[bin] = make_expbin(val, expiry, opts);
+	set_shadow(rec, bin, val, opts);
+	lower_next(rec, expiry);
+	return true, bin_ttl;
+end
+
+-- A new record's TTL is only known once it exists. Undo the create if it
+-- turns out shorter than the longest bin TTL written, or with the ext
+-- option raise it.
+local function check_created(rec, rec_ttl, max_ttl, opts)
+	if (rec_ttl ~= nil or max_ttl == nil) then
+		return true;
+	end
+	rec_ttl = record.ttl(rec);
+	if (can_extend(opts) and max_ttl > rec_ttl) then
+		extend_ttl(rec, rec_ttl, max_ttl, opts);
+		aerospike:update(rec);
+		return true;
+	end
+	if (not valid_time(max_ttl, rec_ttl)) then
+		GP=F and debug("<check_created> Record and Bin TTL conflict Bin %s, Rec %s", tostring(max_ttl), tostring(rec_ttl));
+		aerospike:remove(rec);
+		return false;
+	end
+	return true;
+end
+
+-- Check the TTLs of map mode fields or list mode elements against rec_ttl,
+-- as stage_put() does for bins. Returns false and the first rejected entry,
+-- or true and the longest TTL.
+local function check_entries(arg, rec_ttl, opts)
+	local limit = check_ttl(rec_ttl or math.huge, opts);
+	local max_ttl;
+	for i=1, arg.n do
+		local bin_ttl = arg[i].bin_ttl;
+		if (not valid_time(bin_ttl, limit)) then
+			return false, i;
+		end
+		if (max_ttl == nil or bin_ttl > max_ttl) then
+			max_ttl = bin_ttl;
+		end
+	end
+	return true, max_ttl;
+end
+
+-- Check whether a map mode field entry {expiry, value} is live at time now
+local function field_live(entry, now)
+	return (entry ~= nil
+		and type(entry) == 'userdata'
+		and getmetatable(entry) == List
+		and not_expired(entry[1], now));
+end
+
+-- Get a map mode bin's field map, nil if the bin isn't one
+local function get_fields(rec, bin)
+	local fields = rec[bin];
+	if (fields ~= nil
+		and type(fields) == 'userdata'
+		and getmetatable(fields) == Map) then
+		return fields;
+	end
+	return nil;
+end
+
+-- Get the expiry of an element or field written now with bin_ttl
+local function elem_expiry(bin_ttl, now)
+	if (bin_ttl ~= -1) then
+		return bin_ttl + now;
+	end
+	return 0;
+end
+
+-- Get a list mode bin's element list, nil if the bin isn't one
+local function get_elems(rec, bin)
+	local elems = rec[bin];
+	if (elems ~= nil
+		and type(elems) == 'userdata'
+		and getmetatable(elems) == List) then
+		return elems;
+	end
+	return nil;
+end
+
+-- Copy the live entries of a list mode bin, in order. Expired and malformed
+-- ones are left out.
+local function live_elems(elems, now)
+	local kept = list();
+	if (elems ~= nil) then
+		for i = 1, list.size(elems) do
+			if (field_live(elems[i], now)) then
+				list.append(kept, elems[i]);
+			end
+		end
+	end
+	return kept;
 end
 
 -- Count the number of parameters
@@ -135,27 +547,55 @@ end
 -- Params:
 -- (*) rec: record to retrieve bin from
 -- (*) bin: variable number of bin names to retrieve from
+-- (*) opts: (optional) trailing map of options, see put(), and
+-- 	(*) repair: read repair. If the expired bins among those read take at
+-- 	            least this many bytes, they are erased by this call.
 --
 -- Return:
 -- 1 = error
--- map containing each respective bin value = success
+-- map containing each respective bin value = success. With repair, the map
+-- is returned as {bins = map}, plus repaired = {bins, bytes} when expired
+-- bins were erased, so that no bin name is reserved for the report.
 -- =========================================================================
 function get(rec, ...)
 	local meth = "get";
 	GP=F and debug("[ENTER]<%s>", meth);
 	local arg = table.pack(...)
+	local opts = split_opts(arg);
 	if aerospike:exists(rec) then
 		local return_map = map();
+		local now = get_time();
+		local repair = opts ~= nil and opts[OPT_REPAIR] or nil;
+		local result = return_map;
+		if repair ~= nil then
+			result = map{bins = return_map};
+		end
+		local expired = {};
+		local expired_size = 0;
 		-- Iterate through every bin request 
 		for i=1, arg.n do
 			local bin_map = rec[arg[i]];
-			local ret_bin = get_bin(bin_map);
+			local ret_bin = get_bin(bin_map, now);
 			if ret_bin ~= nil then
 				return_map[arg[i]] = ret_bin;
+			elseif (repair ~= nil and is_expbin(bin_map)
+				and not not_expired(get_expiry(bin_map), now)) then
+				expired[#expired + 1] = arg[i];
+				expired_size = expired_size + expbin_size(bin_map);
 			end
 		end
-		GP=F and debug("[EXIT]<%s> Returning bin map: %s", meth, tostring(return_map));
-		return return_map;
+		if (repair ~= nil and #expired > 0 and expired_size >= repair) then
+			for j=1, #expired do
+				rec[expired[j]] = nil;
+				set_shadow(rec, expired[j], nil, opts);
+			end
+			refresh_next(rec);
+			aerospike:update(rec);
+			result["repaired"] = list{#expired, expired_size};
+			GP=F and debug("<%s> Repaired %d bins, %d bytes", meth, #expired, expired_size);
+		end
+		GP=F and debug("[EXIT]<%s> Returning bin map: %s", meth, tostring(result));
+		return result;
 	else
 		GP=F and debug("[EXIT]<%s> Record does not exist", meth);
 	end
@@ -166,77 +606,63 @@ end
 -- put(): Store bin to record
 -- =========================================================================
 -- 
--- USAGE: as.execute(policy, key, "expire_bin", "put", bin, val, bin_ttl, create);
+-- USAGE: as.execute(policy, key, "expire_bin", "put", bin, val, bin_ttl, opts);
 --
 -- Params:
 -- (*) rec: record to retrieve bin from
 -- (*) bin: bin name 
 -- (*) val: Value to store in bin
 -- (*) bin_ttl: Bin TTL given in seconds or -1 to disable expiration
+-- (*) opts: (optional) map of options
+-- 	(*) opts: 1. Marks the map as options; a trailing map without it is
+-- 	          taken as one more argument by the functions that take several.
+-- 	(*) fmt: "compact" to store integers, strings and bytes in a compact
+-- 	         envelope instead of a map
+-- 	(*) dttl: the namespace default-ttl, 0 for never. Lets a new record's
+-- 	          TTL be checked before it is written.
+-- 	(*) pttl: the record TTL the write policy applies, -1 for never, if
+-- 	          the client sets one. Bin TTLs are checked against it rather
+-- 	          than the record's TTL or dttl.
+-- 	(*) shadow: bin name prefix. An expbin's integer or string value is
+-- 	            also written to the plain bin <shadow><bin>, which a
+-- 	            secondary index can cover, and removed with it by clean.
+-- 	(*) ext: 1 to raise the record TTL to the bin TTL when it is longer,
+-- 	         instead of rejecting the write.
 --
 -- Return:
 -- 1 = error
 -- 0 = success
 -- =========================================================================
-function put(rec, bin, val, bin_ttl)
+function put(rec, bin, val, bin_ttl, opts)
 	local meth = "put";
 	GP=F and debug("[ENTER]<%s> Bin: %s Value: %s TTL: %s", meth, bin, tostring(val), tostring(bin_ttl));
-	local exp_create;
-	if (bin_ttl ~= nil) then
-		exp_create = true;
-	else
-		exp_create = false;
-	end
+	local exists = aerospike:exists(rec);
+	local rec_ttl = known_ttl(rec, exists, opts);
 
-	-- If bin creation is off, don't create any new exp bins
-	if (rec[bin] == nil and not exp_create) then
-		GP=F and debug("[EXIT]<%s> Bin doesn't exist and expire bin creation disabled", meth);
-		rec[bin] = val;
-		return push_rec(rec);
-	else
-		local map_bin = rec[tostring(bin)];
-		if (not is_expbin(map_bin)) then
-			if (exp_create) then
-				map_bin = map();
-			else
-				-- bin creation off, creating normal bin
-				rec[bin] = val;
-				GP=F and debug("[EXIT]<%s>", meth);
-				return push_rec(rec);
-			end
-		end
-		-- Create rec on server to get default server ttl
-		local temp_rec = false;
-		if not aerospike:exists(rec) then
-			aerospike:create(rec);
-			temp_rec = true;
-		end
-		if (not valid_time(bin_ttl, record.ttl(rec))) then
-			if (temp_rec) then
-				aerospike:remove(rec);
-			end
-			GP=F and debug("[EXIT]<%s> Record and Bin TTL conflict Bin %s, Rec %s", meth, tostring(bin_ttl), tostring(record.ttl(rec)));
-			return 1;
-		end	
-		if (bin_ttl ~= -1) then
-			map_bin[EXP_ID] = bin_ttl + get_time();
-		else
-			map_bin[EXP_ID] = 0;
-		end
-		map_bin[EXP_DATA] = val;
-		rec[bin] = map_bin;
-		push_rec(rec);
+	local ok, used_ttl = stage_put(rec, bin, val, bin_ttl, opts, rec_ttl, get_time());
+	if (not ok) then
 		GP=F and debug("[EXIT]<%s>", meth);
-		return 0;
+		return 1;
+	end
+	extend_ttl(rec, rec_ttl, used_ttl, opts);
+	local rc = write_rec(rec, exists);
+	if (used_ttl == nil) then
+		GP=F and debug("[EXIT]<%s> Wrote normal bin", meth);
+		return rc;
 	end
+	if (not check_created(rec, rec_ttl, used_ttl, opts)) then
+		GP=F and debug("[EXIT]<%s>", meth);
+		return 1;
+	end
+	GP=F and debug("[EXIT]<%s>", meth);
+	return 0;
 end
 
-local put = put;
 -- =========================================================================
 -- puts(): Store bin to record
 -- =========================================================================
 --
--- USAGE: as.execute(policy, key, "expire_bin", "put", record_maps);
+-- USAGE: as.execute(policy, key, "expire_bin", "puts", record_maps, opts);
 --
 -- Params:
 -- (*) rec: record to create/update bin to
@@ -244,6 +670,10 @@ local put = put;
 -- 	(*) bin: bin name 
 -- 	(*) val: Value to store in bin
 -- 	(*) bin_ttl: (optional) if provided, expire_bin will be created if none exists
+-- (*) opts: (optional) trailing map of options, see put()
+--
+-- All or nothing: every bin is checked and set before the record is written
+-- once. If any bin TTL is rejected nothing is written.
 --
 -- Return:
 -- 1 = error
@@ -254,14 +684,36 @@ function puts(rec, ...)
 	local meth = "puts";
 	GP=F and debug("[ENTER]<%s>", meth);
 	local arg = table.pack(...)
+	local opts = split_opts(arg);
+	if (arg.n == 0) then
+		GP=F and debug("[EXIT]<%s> Nothing to write", meth);
+		return 0;
+	end
+	local exists = aerospike:exists(rec);
+	local rec_ttl = known_ttl(rec, exists, opts);
+	local now = get_time();
+	local max_ttl;
+
+	-- Unwritten changes to rec are dropped when the UDF returns, so bailing
+	-- out part way leaves the stored record untouched
 	for i=1, arg.n do
-		local return_val = put(rec, arg[i].bin, arg[i].val, arg[i].bin_ttl);
-		if (return_val == 1) then
-			GP=F and debug("[EXIT]<%s>", meth);
+		local ok, used_ttl = stage_put(rec, arg[i].bin, arg[i].val, arg[i].bin_ttl, opts, rec_ttl, now);
+		if (not ok) then
+			GP=F and debug("[EXIT]<%s> Rejected bin %s", meth, tostring(arg[i].bin));
 			return 1;
 		end
-    end
-    GP=F and debug("[EXIT]<%s>", meth);
+		if (used_ttl ~= nil and (max_ttl == nil or used_ttl > max_ttl)) then
+			max_ttl = used_ttl;
+		end
+	end
+
+	extend_ttl(rec, rec_ttl, max_ttl, opts);
+	write_rec(rec, exists);
+	if (not check_created(rec, rec_ttl, max_ttl, opts)) then
+		GP=F and debug("[EXIT]<%s>", meth);
+		return 1;
+	end
+	GP=F and debug("[EXIT]<%s>", meth);
 	return 0;
 end
 
@@ -269,13 +721,16 @@ end
 -- touch(): Modify the bin's TTL
 -- =========================================================================
 --
--- USAGE: as.execute(policy, key, "expire_bin", "touch", bin, bin_maps);
+-- USAGE: as.execute(policy, key, "expire_bin", "touch", bin, bin_maps, opts);
 --
 -- Params:
 -- (*) rec: record to retrieve bin from
 -- (*) bin_map: variable number of maps containing the following
 -- 	(*) bin: bin names 
 -- 	(*) bin_ttl: Bin TTL given in seconds or -1 to disable expiration
+-- (*) opts: (optional) trailing map of options, see put(). With shadow,
+--           the touched bins' shadows are rewritten from their values.
+--           With ext, a bin TTL longer than the record's raises it.
 --
 -- Return:
 -- 0 = success
@@ -285,31 +740,46 @@ function touch(rec, ...)
 	local meth = "touch";
 	GP=F and debug("[ENTER]<%s>", meth);
 	local arg = table.pack(...)
-	if aerospike:exists(rec) then
-		for i=1, arg.n do
-			local bin_name = arg[i].bin
-			if (not valid_time(arg[i].bin_ttl, record.ttl(rec))) then
-				GP=F and debug("<%s>[EXIT] Record TTL is less than Bin TTL for Bin %s", meth, bin_name);
-				return 1;
-			else
-				local rec_map = rec[bin_name];
-				if (is_expbin(rec_map)) then
-					if (arg[i].bin_ttl ~= -1) then
-						rec_map[EXP_ID] = arg[i].bin_ttl + get_time();
-					else
-						rec_map[EXP_ID] = 0;
-					end
-					rec[bin_name] = rec_map;
-					aerospike:update(rec);
-				else
-					GP=F and debug("<%s> Bin %s is not a valid expbin", meth, bin_name);
-				end
-			end	
-		end
-	else
+	local opts = split_opts(arg);
+	if (not aerospike:exists(rec)) then
 		GP=F and debug("[EXIT]<%s> Record doesn't exist", meth);
 		return 1;
 	end
+	local rec_ttl = known_ttl(rec, true, opts);
+	for i=1, arg.n do
+		if (not valid_time(arg[i].bin_ttl, check_ttl(rec_ttl, opts))) then
+			GP=F and debug("<%s>[EXIT] Record TTL is less than Bin TTL for Bin %s", meth, arg[i].bin);
+			return 1;
+		end
+	end
+
+	-- Only the expiry changes, the record is written once for all bins
+	local now = get_time();
+	local touched = false;
+	local max_ttl;
+	for i=1, arg.n do
+		local bin_name = arg[i].bin
+		local rec_map = rec[bin_name];
+		if (is_expbin(rec_map)) then
+			local expiry = 0;
+			if (arg[i].bin_ttl ~= -1) then
+				expiry = arg[i].bin_ttl + now;
+			end
+			rec[bin_name] = set_expiry(rec_map, expiry);
+			set_shadow(rec, bin_name, get_data(rec_map), opts);
+			lower_next(rec, expiry);
+			if (max_ttl == nil or arg[i].bin_ttl > max_ttl) then
+				max_ttl = arg[i].bin_ttl;
+			end
+			touched = true;
+		else
+			GP=F and debug("<%s> Bin %s is not a valid expbin", meth, bin_name);
+		end
+	end
+	if touched then
+		extend_ttl(rec, rec_ttl, max_ttl, opts);
+		aerospike:update(rec);
+	end
 	GP=F and debug("[EXIT]<%s>", meth);
 	return 0;
 end
@@ -321,6 +791,11 @@ end
 -- Params:
 -- (*) rec: record to retrieve bin from
 -- (*) bin: variable number of bins to clean 
+-- (*) opts: (optional) trailing map of options, see put(). With shadow,
+--           an erased bin's shadow is erased too.
+-- 	(*) shrink: 1 to lower the record TTL to the latest expiry of its
+-- 	            remaining expbins, and to remove the record if none is
+-- 	            left live. Records with other bins keep their TTL.
 --
 -- Return:
 -- 0 = success
@@ -330,18 +805,34 @@ function clean(rec, ...)
 	local meth = "clean";
 	GP=F and debug("[ENTER]<%s>", meth);
 	local arg = table.pack(...)
+	local opts = split_opts(arg);
 	if aerospike:exists(rec) then
+		local now = get_time();
 		for i=1, arg.n do
 			local bin = arg[i];
 			local temp_bin = rec[bin];
 			GP=F and debug("<%s> Cleaning %s", meth, tostring(bin));
-			if (is_expbin(temp_bin) and not not_expired(temp_bin[EXP_ID])) then
+			if (is_expbin(temp_bin) and not not_expired(get_expiry(temp_bin), now)) then
 				rec[bin] = nil;
+				set_shadow(rec, bin, nil, opts);
 				GP=F and debug("<%s> Bin %s expired, erasing bin", meth, bin);
 			else
 				GP=F and debug("<%s> Bin %s hasn't expired, skipping record", meth, bin);
 			end
 		end
+		refresh_next(rec);
+		if (opts ~= nil and opts[OPT_SHRINK] == 1) then
+			local rec_ttl = shrink_ttl(rec, now, opts);
+			if (rec_ttl == 0) then
+				aerospike:remove(rec);
+				GP=F and debug("[EXIT]<%s> No live bins left, removed record", meth);
+				return 0;
+			end
+			if (rec_ttl ~= nil and rec_ttl < record.ttl(rec)) then
+				GP=F and debug("<%s> Shrinking record TTL to %d", meth, rec_ttl);
+				record.set_ttl(rec, rec_ttl);
+			end
+		end
 		aerospike:update(rec);
 		GP=F and debug("[EXIT]<%s>", meth);
 		return 0;
@@ -369,13 +860,14 @@ function ttl(rec, bin)
 	if aerospike:exists(rec) then
 		local binMap = rec[bin];
 		if (is_expbin(binMap)) then
-			local bin_ttl = binMap[EXP_ID];
-			if not_expired(bin_ttl) then
+			local bin_ttl = get_expiry(binMap);
+			local now = get_time();
+			if not_expired(bin_ttl, now) then
 				GP=F and debug("[EXIT]<%s>", meth);
 				if (bin_ttl == 0) then
 					return -1;
 				else
-					return bin_ttl - get_time(); 
+					return bin_ttl - now; 
 				end
 			else
 				GP=F and debug("[EXIT]<%s> Bin has expired", meth);
@@ -391,16 +883,458 @@ function ttl(rec, bin)
 	end
 end
 
+-- =========================================================================
+-- Map mode
+-- =========================================================================
+--
+-- A map mode bin holds many logical fields in one map, each field stored
+-- as a list {expiry, value} with its own expiry. Expiry values follow the
+-- expire bin convention: 0 never expires, otherwise CITRUSLEAF_EPOCH based
+-- seconds. Only the requested fields are read or changed.
+
+-- =========================================================================
+-- mget(): Get fields from a map mode bin
+-- =========================================================================
+--
+-- USAGE: as.execute(policy, key, "expire_bin", "mget", bin, field, ...);
+--
+-- Params:
+-- (*) rec: record to retrieve fields from
+-- (*) bin: map mode bin name
+-- (*) field: variable number of field names, none for every live field
+--
+-- Return:
+-- 1 = error
+-- map containing each respective live field value = success
+-- =========================================================================
+function mget(rec, bin, ...)
+	local meth = "mget";
+	GP=F and debug("[ENTER]<%s> Bin: %s", meth, tostring(bin));
+	local arg = table.pack(...)
+	if not aerospike:exists(rec) then
+		GP=F and debug("[EXIT]<%s> Record does not exist", meth);
+		return 1;
+	end
+	local return_map = map();
+	local fields = get_fields(rec, bin);
+	local now = get_time();
+	if (fields ~= nil) then
+		if (arg.n == 0) then
+			for field, entry in map.pairs(fields) do
+				if (field_live(entry, now)) then
+					return_map[field] = entry[2];
+				end
+			end
+		else
+			for i=1, arg.n do
+				local entry = fields[arg[i]];
+				if (field_live(entry, now)) then
+					return_map[arg[i]] = entry[2];
+				end
+			end
+		end
+	end
+	GP=F and debug("[EXIT]<%s> Returning field map: %s", meth, tostring(return_map));
+	return return_map;
+end
+
+-- =========================================================================
+-- mput(): Store fields to a map mode bin
+-- =========================================================================
+--
+-- USAGE: as.execute(policy, key, "expire_bin", "mput", bin, field_maps, opts);
+--
+-- Params:
+-- (*) rec: record to create/update
+-- (*) bin: map mode bin name
+-- (*) field_map: variable number of maps containing the following fields
+-- 	(*) field: field name
+-- 	(*) val: Value to store in field
+-- 	(*) bin_ttl: Field TTL given in seconds or -1 to disable expiration
+-- (*) opts: (optional) trailing map of options, see put(). dttl and ext
+--           apply to field TTLs as to bin TTLs.
+--
+-- Expired fields of the bin are removed by the same write.
+--
+-- Return:
+-- 1 = error, nothing written
+-- 0 = success
+-- =========================================================================
+function mput(rec, bin, ...)
+	local meth = "mput";
+	GP=F and debug("[ENTER]<%s> Bin: %s", meth, tostring(bin));
+	local arg = table.pack(...)
+	local opts = split_opts(arg);
+	for i=1, arg.n do
+		if (arg[i].field == nil) then
+			GP=F and debug("[EXIT]<%s> Entry %d has no field", meth, i);
+			return 1;
+		end
+	end
+	local exists = aerospike:exists(rec);
+	local rec_ttl = known_ttl(rec, exists, opts);
+	local ok, max_ttl = check_entries(arg, rec_ttl, opts);
+	if (not ok) then
+		GP=F and debug("[EXIT]<%s> Record and Field TTL conflict Field %s", meth, tostring(arg[max_ttl].field));
+		return 1;
+	end
+	local fields = get_fields(rec, bin);
+	local now = get_time();
+	if (fields == nil) then
+		fields = map();
+	else
+		-- Trim expired fields while the bin is being rewritten anyway
+		local expired = {};
+		for field, entry in map.pairs(fields) do
+			if (not field_live(entry, now)) then
+				expired[#expired + 1] = field;
+			end
+		end
+		for j=1, #expired do
+			map.remove(fields, expired[j]);
+		end
+	end
+	for i=1, arg.n do
+		fields[arg[i].field] = list{elem_expiry(arg[i].bin_ttl, now), arg[i].val};
+	end
+	rec[bin] = fields;
+	extend_ttl(rec, rec_ttl, max_ttl, opts);
+	write_rec(rec, exists);
+	if (not check_created(rec, rec_ttl, max_ttl, opts)) then
+		GP=F and debug("[EXIT]<%s>", meth);
+		return 1;
+	end
+	GP=F and debug("[EXIT]<%s>", meth);
+	return 0;
+end
+
+-- =========================================================================
+-- mtouch(): Modify the TTL of fields in a map mode bin
+-- =========================================================================
+--
+-- USAGE: as.execute(policy, key, "expire_bin", "mtouch", bin, field_maps, opts);
+--
+-- Params:
+-- (*) rec: record to update
+-- (*) bin: map mode bin name
+-- (*) field_map: variable number of maps containing the following
+-- 	(*) field: field name
+-- 	(*) bin_ttl: Field TTL given in seconds or -1 to disable expiration
+-- (*) opts: (optional) trailing map of options, see put(). With ext, a
+--           field TTL longer than the record's raises it.
+--
+-- Return:
+-- 1 = error, nothing written
+-- 0 = success
+-- =========================================================================
+function mtouch(rec, bin, ...)
+	local meth = "mtouch";
+	GP=F and debug("[ENTER]<%s> Bin: %s", meth, tostring(bin));
+	local arg = table.pack(...)
+	local opts = split_opts(arg);
+	if not aerospike:exists(rec) then
+		GP=F and debug("[EXIT]<%s> Record doesn't exist", meth);
+		return 1;
+	end
+	local rec_ttl = known_ttl(rec, true, opts);
+	local ok, max_ttl = check_entries(arg, rec_ttl, opts);
+	if (not ok) then
+		GP=F and debug("[EXIT]<%s> Record TTL is less than Field TTL for Field %s", meth, tostring(arg[max_ttl].field));
+		return 1;
+	end
+	local fields = get_fields(rec, bin);
+	if (fields == nil) then
+		GP=F and debug("[EXIT]<%s> Bin %s is not a map mode bin", meth, tostring(bin));
+		return 0;
+	end
+	local now = get_time();
+	local changed = false;
+	for i=1, arg.n do
+		local entry = fields[arg[i].field];
+		if (entry ~= nil and getmetatable(entry) == List) then
+			local expiry = 0;
+			if (arg[i].bin_ttl ~= -1) then
+				expiry = arg[i].bin_ttl + now;
+			end
+			entry[1] = expiry;
+			fields[arg[i].field] = entry;
+			changed = true;
+		else
+			GP=F and debug("<%s> Field %s doesn't exist", meth, tostring(arg[i].field));
+		end
+	end
+	if (changed) then
+		rec[bin] = fields;
+		extend_ttl(rec, rec_ttl, max_ttl, opts);
+		aerospike:update(rec);
+	end
+	GP=F and debug("[EXIT]<%s>", meth);
+	return 0;
+end
+
+-- =========================================================================
+-- mttl(): Get the TTL of a field in a map mode bin
+-- =========================================================================
+--
+-- Params:
+-- (*) rec: record to retrieve field from
+-- (*) bin: map mode bin name
+-- (*) field: field to check
+--
+-- Return:
+-- time to live in seconds, -1 for no expiration = success
+-- nil = record, bin or field doesn't exist, or field expired
+-- =========================================================================
+function mttl(rec, bin, field)
+	local meth = "mttl";
+	GP=F and debug("[ENTER]<%s> Bin: %s Field: %s", meth, tostring(bin), tostring(field));
+	if not aerospike:exists(rec) then
+		GP=F and debug("[EXIT]<%s> Record doesn't exist", meth);
+		return nil;
+	end
+	local fields = get_fields(rec, bin);
+	if (fields == nil) then
+		GP=F and debug("[EXIT]<%s> Bin isn't a map mode bin", meth);
+		return nil;
+	end
+	local entry = fields[field];
+	local now = get_time();
+	if (not field_live(entry, now)) then
+		GP=F and debug("[EXIT]<%s> Field doesn't exist or has expired", meth);
+		return nil;
+	end
+	GP=F and debug("[EXIT]<%s>", meth);
+	if (entry[1] == 0) then
+		return -1;
+	end
+	return entry[1] - now;
+end
+
+-- =========================================================================
+-- mclean(): Remove expired fields from map mode bins
+-- =========================================================================
+--
+-- Params:
+-- (*) rec: record to clean
+-- (*) bin: variable number of map or list mode bins to clean
+--
+-- Return:
+-- 0 = success
+-- 1 = error
+-- =========================================================================
+function mclean(rec, ...)
+	local meth = "mclean";
+	GP=F and debug("[ENTER]<%s>", meth);
+	local arg = table.pack(...)
+	if not aerospike:exists(rec) then
+		GP=F and debug("[EXIT]<%s> Record doesn't exist", meth);
+		return 1;
+	end
+	local changed = false;
+	local now = get_time();
+	for i=1, arg.n do
+		local fields = get_fields(rec, arg[i]);
+		if (fields ~= nil) then
+			local expired = {};
+			for field, entry in map.pairs(fields) do
+				if (not field_live(entry, now)) then
+					expired[#expired + 1] = field;
+				end
+			end
+			if (#expired > 0) then
+				for j=1, #expired do
+					map.remove(fields, expired[j]);
+				end
+				if (map.size(fields) == 0) then
+					rec[arg[i]] = nil;
+				else
+					rec[arg[i]] = fields;
+				end
+				changed = true;
+				GP=F and debug("<%s> Bin %s erased %d fields", meth, tostring(arg[i]), #expired);
+			end
+		else
+			local elems = get_elems(rec, arg[i]);
+			if (elems ~= nil) then
+				local kept = live_elems(elems, now);
+				if (list.size(kept) < list.size(elems)) then
+					if (list.size(kept) == 0) then
+						rec[arg[i]] = nil;
+					else
+						rec[arg[i]] = kept;
+					end
+					changed = true;
+					GP=F and debug("<%s> Bin %s erased %d elements", meth, tostring(arg[i]), list.size(elems) - list.size(kept));
+				end
+			end
+		end
+	end
+	if (changed) then
+		aerospike:update(rec);
+	end
+	GP=F and debug("[EXIT]<%s>", meth);
+	return 0;
+end
+
+-- =========================================================================
+-- List mode
+-- =========================================================================
+--
+-- A list mode bin holds a list of elements, each stored as a list
+-- {expiry, value} with its own expiry, like a map mode field. Reads return
+-- only the live values, in order. Every write drops the expired elements,
+-- so the bin doesn't grow with dead ones between cleans. mclean trims list
+-- mode bins too.
+
+-- Insert elements before the index-th live element, or append them for a
+-- nil index or one past the end. Shared by lappend() and linsert().
+local function lwrite(rec, bin, index, arg)
+	local meth = "lwrite";
+	local opts = split_opts(arg);
+	for i=1, arg.n do
+		if (arg[i].val == nil) then
+			GP=F and debug("[EXIT]<%s> Entry %d has no val", meth, i);
+			return 1;
+		end
+	end
+	local exists = aerospike:exists(rec);
+	local rec_ttl = known_ttl(rec, exists, opts);
+	local ok, max_ttl = check_entries(arg, rec_ttl, opts);
+	if (not ok) then
+		GP=F and debug("[EXIT]<%s> Record and Element TTL conflict Entry %d", meth, max_ttl);
+		return 1;
+	end
+	local now = get_time();
+	local elems = live_elems(get_elems(rec, bin), now);
+	if (index ~= nil and index > list.size(elems)) then
+		index = nil;
+	end
+	for i=1, arg.n do
+		local entry = list{elem_expiry(arg[i].bin_ttl, now), arg[i].val};
+		if (index == nil) then
+			list.append(elems, entry);
+		else
+			list.insert(elems, index + i - 1, entry);
+		end
+	end
+	rec[bin] = elems;
+	extend_ttl(rec, rec_ttl, max_ttl, opts);
+	write_rec(rec, exists);
+	if (not check_created(rec, rec_ttl, max_ttl, opts)) then
+		GP=F and debug("[EXIT]<%s>", meth);
+		return 1;
+	end
+	GP=F and debug("[EXIT]<%s>", meth);
+	return 0;
+end
+
+-- =========================================================================
+-- lget(): Get the live elements of a list mode bin
+-- =========================================================================
+--
+-- USAGE: as.execute(policy, key, "expire_bin", "lget", bin);
+--
+-- Params:
+-- (*) rec: record to retrieve elements from
+-- (*) bin: list mode bin name
+--
+-- Return:
+-- 1 = error
+-- list of the live element values, oldest first = success
+-- =========================================================================
+function lget(rec, bin)
+	local meth = "lget";
+	GP=F and debug("[ENTER]<%s> Bin: %s", meth, tostring(bin));
+	if not aerospike:exists(rec) then
+		GP=F and debug("[EXIT]<%s> Record does not exist", meth);
+		return 1;
+	end
+	local return_list = list();
+	local elems = get_elems(rec, bin);
+	local now = get_time();
+	if (elems ~= nil) then
+		for i = 1, list.size(elems) do
+			local entry = elems[i];
+			if (field_live(entry, now)) then
+				list.append(return_list, entry[2]);
+			end
+		end
+	end
+	GP=F and debug("[EXIT]<%s> Returning element list: %s", meth, tostring(return_list));
+	return return_list;
+end
+
+-- =========================================================================
+-- lappend(): Append elements to a list mode bin
+-- =========================================================================
+--
+-- USAGE: as.execute(policy, key, "expire_bin", "lappend", bin, elem_maps, opts);
+--
+-- Params:
+-- (*) rec: record to create/update
+-- (*) bin: list mode bin name
+-- (*) elem_map: variable number of maps containing the following fields
+-- 	(*) val: Value of the element
+-- 	(*) bin_ttl: Element TTL given in seconds or -1 to disable expiration
+-- (*) opts: (optional) trailing map of options, see mput()
+--
+-- Expired elements of the bin are removed by the same write.
+--
+-- Return:
+-- 1 = error, nothing written
+-- 0 = success
+-- =========================================================================
+function lappend(rec, bin, ...)
+	GP=F and debug("[ENTER]<lappend> Bin: %s", tostring(bin));
+	return lwrite(rec, bin, nil, table.pack(...));
+end
+
+-- =========================================================================
+-- linsert(): Insert elements into a list mode bin
+-- =========================================================================
+--
+-- USAGE: as.execute(policy, key, "expire_bin", "linsert", bin, index, elem_maps, opts);
+--
+-- Params:
+-- (*) rec: record to create/update
+-- (*) bin: list mode bin name
+-- (*) index: position among the live elements, from 1, to insert before.
+--            Past the end appends.
+-- (*) elem_map: variable number of maps, see lappend()
+-- (*) opts: (optional) trailing map of options, see mput()
+--
+-- Return:
+-- 1 = error, nothing written
+-- 0 = success
+-- =========================================================================
+function linsert(rec, bin, index, ...)
+	local meth = "linsert";
+	GP=F and debug("[ENTER]<%s> Bin: %s Index: %s", meth, tostring(bin), tostring(index));
+	if (type(index) ~= 'number' or index < 1) then
+		GP=F and debug("[EXIT]<%s> Index is invalid", meth);
+		return 1;
+	end
+	return lwrite(rec, bin, index, table.pack(...));
+end
+
 -- =========================================================================
 -- Module export
 -- =========================================================================
 return {
-	get   = get,
-	put   = put,
-	puts  = puts,
-	touch = touch,
-	clean = clean,
-	ttl   = ttl
+	get    = get,
+	put    = put,
+	puts   = puts,
+	touch  = touch,
+	clean  = clean,
+	ttl    = ttl,
+	mget   = mget,
+	mput   = mput,
+	mtouch = mtouch,
+	mttl   = mttl,
+	mclean = mclean,
+	lget   = lget,
+	lappend = lappend,
+	linsert = linsert
 	-- uncomment to test
 	-- ,is_expbin = is_expbin,
 	-- valid_time = valid_time,
@@ -0,0 +1,874 @@
+/*******************************************************************************
+ * Copyright 2008-2015 by Aerospike.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ ******************************************************************************/
+
+
+//==========================================================
+// Includes
+//
+
+#include "as_expbin.h"
+#include "expbin_internal.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <aerospike/aerospike_info.h>
+#include <aerospike/aerospike_key.h>
+#include <aerospike/aerospike_scan.h>
+#include <aerospike/aerospike_udf.h>
+#include <aerospike/as_arraylist.h>
+#include <aerospike/as_hashmap.h>
+#include <aerospike/as_integer.h>
+#include <aerospike/as_nil.h>
+#include <aerospike/as_scan.h>
+#include <aerospike/as_string.h>
+#include <aerospike/as_stringmap.h>
+
+
+//==========================================================
+// Constants
+//
+
+// as_expbin_write_flags passed to the module as options.
+#define EXPBIN_OPTS_FLAGS AS_EXPBIN_WRITE_EXTEND_TTL
+
+// Largest module file as_expbin_register() uploads.
+#define EXPBIN_MODULE_MAX_SIZE (1024 * 1024)
+
+
+//==========================================================
+// Typedefs
+//
+
+// Per-thread scratch used to hand bin names to the module without a heap
+// allocation per name. Each call rebuilds the prefix it uses.
+typedef struct expbin_scratch_s {
+	as_string names[AS_EXPBIN_MAX_BINS];
+
+	// The last options maps built, per as_expbin_write_flags, shared while
+	// the handle settings they were built from are unchanged. They are never
+	// modified once built, so calls still holding a reference may keep using
+	// them after a rebuild. The last ones a thread builds are not freed.
+	as_map* opts[EXPBIN_OPTS_FLAGS + 1];
+	uint32_t opts_write_ttl[EXPBIN_OPTS_FLAGS + 1];
+	as_expbin_format opts_format;
+	int64_t opts_default_ttl;
+	char opts_shadow_prefix[AS_BIN_NAME_MAX_SIZE];
+	bool opts_clean_shrink;
+	uint32_t opts_repair_min_bytes;
+} expbin_scratch;
+
+
+//==========================================================
+// Forward Declarations
+//
+
+static uint32_t expbin_set_log_flag(uint8_t* content, uint32_t size, uint32_t capacity, as_expbin_log_level level);
+static void expbin_load_default_ttl(as_expbin* eb);
+static as_status expbin_take_repair(as_expbin* eb, as_error* err, as_map* result, as_map** bins);
+
+
+//==========================================================
+// Globals
+//
+
+static __thread expbin_scratch g_scratch;
+
+
+
+//==========================================================
+// Public API
+//
+
+as_expbin*
+as_expbin_init(as_expbin* eb, aerospike* as, const char* ns, const char* set)
+{
+	if (strlen(ns) >= sizeof(eb->ns) ||
+			(set && strlen(set) >= sizeof(eb->set))) {
+		return NULL;
+	}
+
+	memset(eb, 0, sizeof(as_expbin));
+	eb->as = as;
+	strcpy(eb->ns, ns);
+
+	if (set) {
+		strcpy(eb->set, set);
+	}
+
+	strcpy(eb->module, AS_EXPBIN_MODULE);
+	eb->default_ttl = AS_EXPBIN_TTL_NONE;
+
+	return eb;
+}
+
+void
+as_expbin_destroy(as_expbin* eb)
+{
+	eb->as = NULL;
+}
+
+as_status
+as_expbin_register(as_expbin* eb, as_error* err, const char* path)
+{
+	FILE* file = fopen(path, "r");
+
+	if (! file) {
+		return as_error_update(err, AEROSPIKE_ERR_PARAM,
+				"cannot open script file %s : %s", path, strerror(errno));
+	}
+
+	// Read the file's content into a local buffer.
+
+	uint8_t* content = (uint8_t*)malloc(EXPBIN_MODULE_MAX_SIZE);
+
+	if (! content) {
+		fclose(file);
+		return as_error_update(err, AEROSPIKE_ERR_CLIENT,
+				"script content allocation failed");
+	}
+
+	uint32_t size = 0;
+	size_t read;
+
+	while (size < EXPBIN_MODULE_MAX_SIZE &&
+			(read = fread(content + size, 1, EXPBIN_MODULE_MAX_SIZE - size,
+					file)) != 0) {
+		size += (uint32_t)read;
+	}
+
+	bool too_big = size == EXPBIN_MODULE_MAX_SIZE && fgetc(file) != EOF;
+
+	fclose(file);
+
+	if (too_big) {
+		free(content);
+		return as_error_update(err, AEROSPIKE_ERR_PARAM,
+				"script file %s is larger than %u bytes", path,
+				EXPBIN_MODULE_MAX_SIZE);
+	}
+
+	if (eb->log_level != AS_EXPBIN_LOG_MODULE) {
+		size = expbin_set_log_flag(content, size, EXPBIN_MODULE_MAX_SIZE,
+				eb->log_level);
+	}
+
+	// Wrap the local buffer as an as_bytes object.
+	as_bytes udf_content;
+	as_bytes_init_wrap(&udf_content, content, size, true);
+
+	as_string base_string;
+	const char* base = as_basename(&base_string, path);
+
+	as_status rc;
+
+	if (eb->transport) {
+		// Hand the module to the transport instead of the cluster.
+		rc = eb->transport->udf_put(eb->transport->udata, err, base,
+				&udf_content);
+	}
+	else {
+		rc = aerospike_udf_put(eb->as, err, NULL, base, AS_UDF_TYPE_LUA,
+				&udf_content);
+
+		if (rc == AEROSPIKE_OK) {
+			// Wait for the system metadata to spread to all nodes.
+			rc = aerospike_udf_put_wait(eb->as, err, NULL, base, 100);
+		}
+	}
+
+	as_string_destroy(&base_string);
+
+	// This frees the local buffer.
+	as_bytes_destroy(&udf_content);
+
+	if (rc == AEROSPIKE_OK) {
+		expbin_load_default_ttl(eb);
+	}
+
+	return rc;
+}
+
+as_status
+as_expbin_get(as_expbin* eb, as_error* err, const as_policy_apply* policy,
+		const as_key* key, const char* bins[], as_map** result)
+{
+	uint32_t n_bins;
+
+	if (expbin_count_bins(err, bins, &n_bins) != AEROSPIKE_OK) {
+		return err->code;
+	}
+
+	if (eb->cache) {
+		return expbin_get_cached(eb, err, policy, key, bins, n_bins, result);
+	}
+
+	if (eb->read_mode == AS_EXPBIN_READ_NATIVE) {
+		return expbin_get_native(eb, err, policy, key, bins, n_bins, result);
+	}
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, n_bins + 1);
+	expbin_append_names(&arglist, bins, n_bins);
+
+	if (eb->repair_min_bytes != 0) {
+		// Only read repair needs the options.
+		as_arraylist_append_map(&arglist,
+				expbin_opts_new(eb, AS_EXPBIN_WRITE_DEFAULT, 0));
+	}
+
+	as_val* val = NULL;
+	as_status rc = expbin_apply(eb, err, policy, key, "get", (as_list*)&arglist,
+			&val);
+
+	as_arraylist_destroy(&arglist);
+
+	if (rc != AEROSPIKE_OK) {
+		return rc;
+	}
+
+	rc = expbin_check_map(err, val);
+
+	if (rc != AEROSPIKE_OK) {
+		as_val_destroy(val);
+		return rc;
+	}
+
+	if (eb->repair_min_bytes != 0) {
+		return expbin_take_repair(eb, err, (as_map*)val, result);
+	}
+
+	*result = (as_map*)val;
+	return AEROSPIKE_OK;
+}
+
+void
+as_expbin_repair_stats_get(const as_expbin* eb, as_expbin_repair_stats* stats)
+{
+	stats->repairs = __atomic_load_n(&eb->repaired.repairs, __ATOMIC_RELAXED);
+	stats->bins = __atomic_load_n(&eb->repaired.bins, __ATOMIC_RELAXED);
+	stats->bytes = __atomic_load_n(&eb->repaired.bytes, __ATOMIC_RELAXED);
+}
+
+as_status
+as_expbin_put(as_expbin* eb, as_error* err, const as_policy_apply* policy,
+		const as_key* key, const char* bin, as_val* val, int64_t bin_ttl)
+{
+	return as_expbin_put_flags(eb, err, policy, key, bin, val, bin_ttl,
+			AS_EXPBIN_WRITE_DEFAULT);
+}
+
+as_status
+as_expbin_put_flags(as_expbin* eb, as_error* err,
+		const as_policy_apply* policy, const as_key* key, const char* bin,
+		as_val* val, int64_t bin_ttl, uint32_t flags)
+{
+	as_string bin_str;
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 4);
+	expbin_append_put_args(eb, policy, &arglist,
+			(as_val*)as_string_init(&bin_str, (char*)bin, false), val, bin_ttl,
+			flags);
+
+	as_val* result = NULL;
+	as_status rc = expbin_apply(eb, err, policy, key, "put",
+			(as_list*)&arglist, &result);
+
+	as_arraylist_destroy(&arglist);
+
+	if (eb->cache) {
+		// Even a failed write may have been applied.
+		expbin_cache_forget(eb->cache, key, bin);
+	}
+
+	if (rc != AEROSPIKE_OK) {
+		return rc;
+	}
+
+	rc = expbin_check_code(err, "put", result);
+	as_val_destroy(result);
+	return rc;
+}
+
+as_status
+as_expbin_puts(as_expbin* eb, as_error* err, const as_policy_apply* policy,
+		const as_key* key, as_list* entries)
+{
+	return as_expbin_puts_flags(eb, err, policy, key, entries,
+			AS_EXPBIN_WRITE_DEFAULT);
+}
+
+as_status
+as_expbin_puts_flags(as_expbin* eb, as_error* err,
+		const as_policy_apply* policy, const as_key* key, as_list* entries,
+		uint32_t flags)
+{
+	uint32_t n_entries = as_list_size(entries);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, n_entries + 1);
+	expbin_append_puts_args(eb, policy, &arglist, entries, flags);
+
+	as_val* result = NULL;
+	as_status rc = expbin_apply(eb, err, policy, key, "puts",
+			(as_list*)&arglist, &result);
+
+	as_arraylist_destroy(&arglist);
+
+	if (eb->cache) {
+		expbin_cache_forget_entries(eb->cache, key, entries);
+	}
+
+	if (rc != AEROSPIKE_OK) {
+		return rc;
+	}
+
+	rc = expbin_check_code(err, "puts", result);
+	as_val_destroy(result);
+	return rc;
+}
+
+as_status
+as_expbin_touch(as_expbin* eb, as_error* err, const as_policy_apply* policy,
+		const as_key* key, as_list* entries)
+{
+	return as_expbin_touch_flags(eb, err, policy, key, entries,
+			AS_EXPBIN_WRITE_DEFAULT);
+}
+
+as_status
+as_expbin_touch_flags(as_expbin* eb, as_error* err,
+		const as_policy_apply* policy, const as_key* key, as_list* entries,
+		uint32_t flags)
+{
+	uint32_t n_entries = as_list_size(entries);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, n_entries + 1);
+	expbin_append_puts_args(eb, policy, &arglist, entries, flags);
+
+	as_val* result = NULL;
+	as_status rc = expbin_apply(eb, err, policy, key, "touch",
+			(as_list*)&arglist, &result);
+
+	as_arraylist_destroy(&arglist);
+
+	if (eb->cache) {
+		expbin_cache_forget_entries(eb->cache, key, entries);
+	}
+
+	if (rc != AEROSPIKE_OK) {
+		return rc;
+	}
+
+	rc = expbin_check_code(err, "touch", result);
+	as_val_destroy(result);
+	return rc;
+}
+
+as_status
+as_expbin_ttl(as_expbin* eb, as_error* err, const as_policy_apply* policy,
+		const as_key* key, const char* bin, int64_t* ttl)
+{
+	if (eb->read_mode == AS_EXPBIN_READ_NATIVE) {
+		return expbin_ttl_native(eb, err, policy, key, bin, ttl);
+	}
+
+	as_string bin_str;
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 1);
+	as_arraylist_append(&arglist,
+			(as_val*)as_string_init(&bin_str, (char*)bin, false));
+
+	as_val* result = NULL;
+	as_status rc = expbin_apply(eb, err, policy, key, "ttl",
+			(as_list*)&arglist, &result);
+
+	as_arraylist_destroy(&arglist);
+
+	if (rc != AEROSPIKE_OK) {
+		return rc;
+	}
+
+	rc = expbin_check_ttl(err, bin, result, ttl);
+	as_val_destroy(result);
+	return rc;
+}
+
+as_status
+as_expbin_clean(as_expbin* eb, as_error* err, const as_policy_scan* policy,
+		const char* bins[])
+{
+	as_status rc = expbin_scan_apply(eb, err, policy, "clean", bins,
+			expbin_opts_new(eb, AS_EXPBIN_WRITE_DEFAULT, 0));
+
+	if (eb->cache) {
+		// The scan doesn't say which records it changed.
+		as_expbin_cache_clear(eb->cache);
+	}
+
+	return rc;
+}
+
+as_map*
+as_expbin_entry_new(const char* bin, as_val* val, int64_t bin_ttl)
+{
+	as_hashmap* map = as_hashmap_new(3);
+	as_stringmap_set_str((as_map*)map, "bin", bin);
+
+	if (val) {
+		as_stringmap_set((as_map*)map, "val", val);
+	}
+
+	if (bin_ttl != AS_EXPBIN_TTL_NONE) {
+		as_stringmap_set_int64((as_map*)map, "bin_ttl", bin_ttl);
+	}
+
+	return (as_map*)map;
+}
+
+
+//==========================================================
+// Internal API
+//
+
+as_status
+expbin_count_bins(as_error* err, const char* bins[], uint32_t* n_bins)
+{
+	uint32_t n = 0;
+
+	while (bins[n]) {
+		if (++n > AS_EXPBIN_MAX_BINS) {
+			return as_error_update(err, AEROSPIKE_ERR_PARAM,
+					"more than %u bins requested", AS_EXPBIN_MAX_BINS);
+		}
+	}
+
+	*n_bins = n;
+	return AEROSPIKE_OK;
+}
+
+void
+expbin_append_put_args(as_expbin* eb, const as_policy_apply* policy,
+		as_arraylist* list, as_val* bin, as_val* val, int64_t bin_ttl,
+		uint32_t flags)
+{
+	as_map* opts = expbin_opts_new(eb, flags, expbin_write_ttl(eb, policy));
+
+	as_arraylist_append(list, bin);
+	as_arraylist_append(list, as_val_reserve(val));
+
+	if (bin_ttl != AS_EXPBIN_TTL_NONE) {
+		as_arraylist_append_int64(list, bin_ttl);
+	}
+	else if (opts) {
+		// Options are positional for put - hold bin_ttl's place.
+		as_arraylist_append(list, (as_val*)&as_nil);
+	}
+
+	if (opts) {
+		as_arraylist_append_map(list, opts);
+	}
+}
+
+void
+expbin_append_puts_args(as_expbin* eb, const as_policy_apply* policy,
+		as_arraylist* list, const as_list* entries, uint32_t flags)
+{
+	uint32_t n_entries = as_list_size(entries);
+
+	for (uint32_t i = 0; i < n_entries; i++) {
+		as_arraylist_append(list, as_val_reserve(as_list_get(entries, i)));
+	}
+
+	as_map* opts = expbin_opts_new(eb, flags, expbin_write_ttl(eb, policy));
+
+	if (opts) {
+		as_arraylist_append_map(list, opts);
+	}
+}
+
+uint32_t
+expbin_write_ttl(const as_expbin* eb, const as_policy_apply* policy)
+{
+	if (! policy) {
+		if (! eb->as) {
+			return AS_RECORD_DEFAULT_TTL;
+		}
+
+		policy = &eb->as->config.policies.apply;
+	}
+
+	uint32_t ttl = policy->ttl;
+
+	if (ttl == AS_RECORD_CLIENT_DEFAULT_TTL && eb->as) {
+		ttl = eb->as->config.policies.apply.ttl;
+	}
+
+	if (ttl == AS_RECORD_NO_CHANGE_TTL || ttl == AS_RECORD_CLIENT_DEFAULT_TTL) {
+		return AS_RECORD_DEFAULT_TTL;
+	}
+
+	return ttl;
+}
+
+as_map*
+expbin_opts_new(as_expbin* eb, uint32_t flags, uint32_t write_ttl)
+{
+	// A handle that was never registered learns the default-ttl here, once.
+	if (__atomic_load_n(&eb->default_ttl, __ATOMIC_RELAXED) ==
+			AS_EXPBIN_TTL_NONE &&
+			! __atomic_exchange_n(&eb->default_ttl_asked, true,
+					__ATOMIC_RELAXED)) {
+		expbin_load_default_ttl(eb);
+	}
+
+	int64_t default_ttl = __atomic_load_n(&eb->default_ttl, __ATOMIC_RELAXED);
+	bool compact = eb->format == AS_EXPBIN_FORMAT_COMPACT;
+	bool dttl = default_ttl != AS_EXPBIN_TTL_NONE;
+	bool shadow = eb->shadow_prefix[0] != '\0';
+	bool ext = (flags & AS_EXPBIN_WRITE_EXTEND_TTL) != 0;
+
+	if (! compact && ! dttl && ! shadow && ! eb->clean_shrink &&
+			eb->repair_min_bytes == 0 && ! ext && write_ttl == 0) {
+		return NULL;
+	}
+
+	expbin_scratch* scratch = &g_scratch;
+	uint32_t i = flags & EXPBIN_OPTS_FLAGS;
+
+	if (scratch->opts_format != eb->format ||
+			scratch->opts_default_ttl != default_ttl ||
+			strcmp(scratch->opts_shadow_prefix, eb->shadow_prefix) != 0 ||
+			scratch->opts_clean_shrink != eb->clean_shrink ||
+			scratch->opts_repair_min_bytes != eb->repair_min_bytes) {
+		// The settings changed, drop the maps built from the old ones.
+		for (uint32_t j = 0; j <= EXPBIN_OPTS_FLAGS; j++) {
+			if (scratch->opts[j]) {
+				as_map_destroy(scratch->opts[j]);
+				scratch->opts[j] = NULL;
+			}
+		}
+
+		scratch->opts_format = eb->format;
+		scratch->opts_default_ttl = default_ttl;
+		strcpy(scratch->opts_shadow_prefix, eb->shadow_prefix);
+		scratch->opts_clean_shrink = eb->clean_shrink;
+		scratch->opts_repair_min_bytes = eb->repair_min_bytes;
+	}
+
+	if (scratch->opts[i]) {
+		if (scratch->opts_write_ttl[i] == write_ttl) {
+			return (as_map*)as_val_reserve(scratch->opts[i]);
+		}
+
+		as_map_destroy(scratch->opts[i]);
+		scratch->opts[i] = NULL;
+	}
+
+	as_hashmap* opts = as_hashmap_new(8);
+
+	// The module takes a trailing map as options only with this marker.
+	as_stringmap_set_int64((as_map*)opts, "opts", 1);
+
+	if (compact) {
+		as_stringmap_set_str((as_map*)opts, "fmt", "compact");
+	}
+
+	if (dttl) {
+		as_stringmap_set_int64((as_map*)opts, "dttl", default_ttl);
+	}
+
+	if (shadow) {
+		as_stringmap_set_str((as_map*)opts, "shadow", eb->shadow_prefix);
+	}
+
+	if (eb->clean_shrink) {
+		as_stringmap_set_int64((as_map*)opts, "shrink", 1);
+	}
+
+	if (eb->repair_min_bytes != 0) {
+		as_stringmap_set_int64((as_map*)opts, "repair", eb->repair_min_bytes);
+	}
+
+	if (ext) {
+		as_stringmap_set_int64((as_map*)opts, "ext", 1);
+	}
+
+	if (write_ttl != 0) {
+		as_stringmap_set_int64((as_map*)opts, "pttl",
+				write_ttl == AS_RECORD_NO_EXPIRE_TTL ? -1 : (int64_t)write_ttl);
+	}
+
+	scratch->opts[i] = (as_map*)opts;
+	scratch->opts_write_ttl[i] = write_ttl;
+
+	return (as_map*)as_val_reserve(opts);
+}
+
+as_status
+expbin_check_code(as_error* err, const char* fn, as_val* result)
+{
+	as_integer* i = as_integer_fromval(result);
+
+	if (! i) {
+		return as_error_update(err, AEROSPIKE_ERR_UDF,
+				"%s returned an unexpected value type %d", fn,
+				as_val_type(result));
+	}
+
+	if (as_integer_get(i) != 0) {
+		return as_error_update(err, AEROSPIKE_ERR_UDF,
+				"%s rejected: bin ttl exceeds record ttl or record missing",
+				fn);
+	}
+
+	return AEROSPIKE_OK;
+}
+
+as_status
+expbin_check_map(as_error* err, as_val* result)
+{
+	if (! as_map_fromval(result)) {
+		// The module answers 1 instead of a map when the record is missing.
+		return as_error_update(err, AEROSPIKE_ERR_RECORD_NOT_FOUND,
+				"get: record not found");
+	}
+
+	return AEROSPIKE_OK;
+}
+
+as_status
+expbin_check_ttl(as_error* err, const char* bin, as_val* result, int64_t* ttl)
+{
+	as_integer* i = as_integer_fromval(result);
+
+	if (! i) {
+		// The module answers nil for a missing, expired or normal bin.
+		return as_error_update(err, AEROSPIKE_ERR_BIN_NOT_FOUND,
+				"ttl: bin %s has no ttl", bin);
+	}
+
+	*ttl = as_integer_get(i);
+	return AEROSPIKE_OK;
+}
+
+void
+expbin_append_names(as_arraylist* list, const char* bins[], uint32_t n_bins)
+{
+	for (uint32_t i = 0; i < n_bins; i++) {
+		as_string* s = as_string_init(&g_scratch.names[i], (char*)bins[i],
+				false);
+
+		as_arraylist_append(list, (as_val*)s);
+	}
+}
+
+as_status
+expbin_apply(as_expbin* eb, as_error* err, const as_policy_apply* policy,
+		const as_key* key, const char* fn, as_list* arglist, as_val** result)
+{
+	if (eb->transport) {
+		return eb->transport->apply(eb->transport->udata, err, policy, key,
+				eb->module, fn, arglist, result);
+	}
+
+	return aerospike_key_apply(eb->as, err, policy, key, eb->module, fn,
+			arglist, result);
+}
+
+as_status
+expbin_select(as_expbin* eb, as_error* err, const as_policy_read* policy,
+		const as_key* key, const char* bins[], as_record** rec)
+{
+	if (eb->transport) {
+		return eb->transport->select(eb->transport->udata, err, policy, key,
+				bins, rec);
+	}
+
+	return aerospike_key_select(eb->as, err, policy, key, bins, rec);
+}
+
+as_status
+expbin_scan_apply(as_expbin* eb, as_error* err, const as_policy_scan* policy,
+		const char* fn, const char* bins[], as_map* opts)
+{
+	uint32_t n_bins;
+
+	if (expbin_count_bins(err, bins, &n_bins) != AEROSPIKE_OK) {
+		if (opts) {
+			as_map_destroy(opts);
+		}
+
+		return err->code;
+	}
+
+	// The scan takes ownership of the argument list, so it can't live in the
+	// thread's scratch.
+	as_arraylist* arglist = as_arraylist_new(n_bins + 1, 0);
+
+	for (uint32_t i = 0; i < n_bins; i++) {
+		as_arraylist_append_str(arglist, bins[i]);
+	}
+
+	if (opts) {
+		as_arraylist_append_map(arglist, opts);
+	}
+
+	if (eb->transport) {
+		as_status rc = eb->transport->scan_apply(eb->transport->udata, err,
+				policy, eb->ns, eb->set, eb->module, fn, (as_list*)arglist);
+
+		as_arraylist_destroy(arglist);
+		return rc;
+	}
+
+	as_scan scan;
+	as_scan_init(&scan, eb->ns, eb->set);
+
+	if (! as_scan_apply_each(&scan, eb->module, fn, (as_list*)arglist)) {
+		as_arraylist_destroy(arglist);
+		as_scan_destroy(&scan);
+		return as_error_update(err, AEROSPIKE_ERR_CLIENT,
+				"%s UDF apply failed", fn);
+	}
+
+	uint64_t scan_id = 0;
+	as_status rc = aerospike_scan_background(eb->as, err, policy, &scan,
+			&scan_id);
+
+	if (rc == AEROSPIKE_OK) {
+		rc = aerospike_scan_wait(eb->as, err, NULL, scan_id, 0);
+	}
+
+	as_scan_destroy(&scan);
+	return rc;
+}
+
+
+//==========================================================
+// Local Helpers
+//
+
+// Rewrite the module's "local F = ...;" line for the log level, in place.
+// Returns the new size, unchanged if the line is missing or doesn't fit.
+static uint32_t
+expbin_set_log_flag(uint8_t* content, uint32_t size, uint32_t capacity,
+		as_expbin_log_level level)
+{
+	static const char prefix[] = "\nlocal F = ";
+	const char* flag = level == AS_EXPBIN_LOG_OFF ? "false" : "true";
+	uint8_t* p = memmem(content, size, prefix, sizeof(prefix) - 1);
+
+	if (! p) {
+		return size;
+	}
+
+	uint8_t* start = p + sizeof(prefix) - 1;
+	uint8_t* end = memchr(start, ';', size - (uint32_t)(start - content));
+
+	if (! end) {
+		return size;
+	}
+
+	uint32_t old_len = (uint32_t)(end - start);
+	uint32_t new_len = (uint32_t)strlen(flag);
+
+	if (size - old_len + new_len > capacity) {
+		return size;
+	}
+
+	memmove(start + new_len, end, size - (uint32_t)(end - content));
+	memcpy(start, flag, new_len);
+
+	return size - old_len + new_len;
+}
+
+// Learn the namespace default-ttl. Failing is not an error - without it the
+// module learns a new record's TTL by creating the record.
+static void
+expbin_load_default_ttl(as_expbin* eb)
+{
+	char request[AS_NAMESPACE_MAX_SIZE + 16];
+	snprintf(request, sizeof(request), "namespace/%s", eb->ns);
+
+	as_error err;
+	char* response = NULL;
+	as_status rc;
+
+	if (eb->transport) {
+		rc = eb->transport->info ?
+				eb->transport->info(eb->transport->udata, &err, request,
+						&response) :
+				AEROSPIKE_ERR_CLIENT;
+	}
+	else {
+		rc = aerospike_info_any(eb->as, &err, NULL, request, &response);
+	}
+
+	if (rc != AEROSPIKE_OK) {
+		return;
+	}
+
+	const char* p = strstr(response, "default-ttl=");
+
+	if (p) {
+		__atomic_store_n(&eb->default_ttl,
+				strtoll(p + strlen("default-ttl="), NULL, 10), __ATOMIC_RELAXED);
+	}
+
+	free(response);
+}
+
+// Unwrap a get result sent with read repair, {bins = map} plus
+// repaired = {bins, bytes} if the module erased any, adding the report to the
+// handle's counters. Consumes result.
+static as_status
+expbin_take_repair(as_expbin* eb, as_error* err, as_map* result,
+		as_map** bins)
+{
+	as_map* map = as_map_fromval(as_stringmap_get(result, "bins"));
+
+	if (! map) {
+		as_map_destroy(result);
+		return as_error_update(err, AEROSPIKE_ERR_UDF,
+				"get: module returned no bins map");
+	}
+
+	as_list* report = as_list_fromval(as_stringmap_get(result, "repaired"));
+
+	if (report && as_list_size(report) >= 2) {
+		__atomic_fetch_add(&eb->repaired.repairs, 1, __ATOMIC_RELAXED);
+		__atomic_fetch_add(&eb->repaired.bins,
+				(uint64_t)as_list_get_int64(report, 0), __ATOMIC_RELAXED);
+		__atomic_fetch_add(&eb->repaired.bytes,
+				(uint64_t)as_list_get_int64(report, 1), __ATOMIC_RELAXED);
+	}
+
+	as_val_reserve(map);
+	as_map_destroy(result);
+
+	*bins = map;
+	return AEROSPIKE_OK;
+}
@@ -0,0 +1,1093 @@
+/*******************************************************************************
+ * Copyright 2008-2015 by Aerospike.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ ******************************************************************************/
+
+#pragma once
+
+//==========================================================
+// Includes
+//
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <aerospike/aerospike.h>
+#include <aerospike/aerospike_index.h>
+#include <aerospike/as_batch.h>
+#include <aerospike/as_bytes.h>
+#include <aerospike/as_error.h>
+#include <aerospike/as_key.h>
+#include <aerospike/as_list.h>
+#include <aerospike/as_map.h>
+#include <aerospike/as_policy.h>
+#include <aerospike/as_query.h>
+#include <aerospike/as_record.h>
+#include <aerospike/as_status.h>
+#include <aerospike/as_udf.h>
+#include <aerospike/as_val.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//==========================================================
+// Constants
+//
+
+#define AS_EXPBIN_MODULE "expire_bin"
+
+// Largest number of bin names a single call may pass to the module.
+#define AS_EXPBIN_MAX_BINS 512
+
+// bin_ttl value for a bin that never expires.
+#define AS_EXPBIN_TTL_NEVER (-1)
+
+// bin_ttl value that writes a normal bin unless an expire bin already exists.
+#define AS_EXPBIN_TTL_NONE INT64_MIN
+
+// Keys of the map wrapping an expire bin's value, as in expire_bin.lua.
+#define AS_EXPBIN_EXP_ID "expbin_ttl"
+#define AS_EXPBIN_DATA "data"
+
+// Integer bin the module keeps at the earliest expiry of a record's expire
+// bins, absent when none expires. Reserved, see as_expbin_index_create().
+#define AS_EXPBIN_NEXT_BIN "expbin_next"
+
+// Stored expiry times are seconds since this epoch (2010-01-01 UTC).
+#define AS_EXPBIN_CITRUSLEAF_EPOCH 1262304000
+
+// Compact envelope header: magic (2 bytes), version (1), payload type (1),
+// big-endian expiry (4). The payload follows the header.
+#define AS_EXPBIN_ENV_MAGIC0 0xEB
+#define AS_EXPBIN_ENV_MAGIC1 0xB1
+#define AS_EXPBIN_ENV_VERSION 1
+#define AS_EXPBIN_ENV_HEADER_SIZE 8
+
+// Partitions per namespace, the unit as_expbin_clean_partitions() splits by.
+#define AS_EXPBIN_PARTITIONS 4096
+
+// Most entries as_expbin_touch_native() writes without the module. Its
+// filter expression spells out this many header checks.
+#define AS_EXPBIN_NATIVE_TOUCH_MAX 8
+
+//==========================================================
+// Typedefs
+//
+
+/*
+ * How get and ttl are served.
+ */
+typedef enum as_expbin_read_mode_e {
+	// Run the module's get and ttl functions on the server.
+	AS_EXPBIN_READ_UDF,
+
+	// Read the raw bins and evaluate expiry in the client, with the same
+	// results as the module. No UDF runs on the server.
+	AS_EXPBIN_READ_NATIVE
+} as_expbin_read_mode;
+
+/*
+ * Storage format for expire bins written through a handle. Reads understand
+ * both formats regardless.
+ */
+typedef enum as_expbin_format_e {
+	// A map of {expbin_ttl, data}. Holds any value type.
+	AS_EXPBIN_FORMAT_MAP,
+
+	// A bytes bin of header and raw payload, for integer, string and bytes
+	// values. Other types fall back to the map format.
+	AS_EXPBIN_FORMAT_COMPACT
+} as_expbin_format;
+
+/*
+ * Logging of the module's debug lines, set in the module source by
+ * as_expbin_register().
+ */
+typedef enum as_expbin_log_level_e {
+	// The module is registered with its own debug flag, unchanged.
+	AS_EXPBIN_LOG_MODULE,
+
+	// Debug lines are skipped without evaluating their arguments.
+	AS_EXPBIN_LOG_OFF,
+
+	// Debug lines are passed to the server's UDF debug log.
+	AS_EXPBIN_LOG_DEBUG
+} as_expbin_log_level;
+
+/*
+ * Flags of a single write, see as_expbin_put_flags().
+ */
+typedef enum as_expbin_write_flags_e {
+	AS_EXPBIN_WRITE_DEFAULT = 0,
+
+	// Raise the record TTL to the longest bin TTL written, in the same
+	// write, rather than rejecting bin TTLs that outlive the record.
+	AS_EXPBIN_WRITE_EXTEND_TTL = 1 << 0
+} as_expbin_write_flags;
+
+/*
+ * State of a stored bin value, see as_expbin_eval().
+ */
+typedef enum as_expbin_state_e {
+	// Not an expire bin - the stored value is returned as is.
+	AS_EXPBIN_PLAIN,
+
+	// An expire bin that has not expired.
+	AS_EXPBIN_LIVE,
+
+	// An expire bin that has expired.
+	AS_EXPBIN_EXPIRED
+} as_expbin_state;
+
+/*
+ * What an as_expbin_slot is decoded as, see as_expbin_get_slots().
+ */
+typedef enum as_expbin_slot_type_e {
+	// Integer values, including compact envelopes of integers.
+	AS_EXPBIN_SLOT_INT64,
+
+	// Double values, and integer values converted.
+	AS_EXPBIN_SLOT_DOUBLE,
+
+	// String and bytes values, as a view of the bytes in the record. Strings
+	// are not NUL terminated in the view.
+	AS_EXPBIN_SLOT_VIEW,
+
+	// Only whether the bin is live, for a value of any type.
+	AS_EXPBIN_SLOT_PRESENCE
+} as_expbin_slot_type;
+
+/*
+ * Outcome of decoding an as_expbin_slot.
+ */
+typedef enum as_expbin_slot_status_e {
+	// No such bin, or an expire bin with no value.
+	AS_EXPBIN_SLOT_MISSING,
+
+	// An expire bin that has expired.
+	AS_EXPBIN_SLOT_EXPIRED,
+
+	// A live value that can't be decoded as the slot's type.
+	AS_EXPBIN_SLOT_WRONG_TYPE,
+
+	// A live value, decoded.
+	AS_EXPBIN_SLOT_OK
+} as_expbin_slot_status;
+
+/*
+ * A caller-owned destination for one bin's value, see as_expbin_get_slots().
+ */
+typedef struct as_expbin_slot_s {
+	// Set by the caller.
+	const char* bin;
+	as_expbin_slot_type type;
+
+	// Set by as_expbin_get_slots(). The value is only set when status is
+	// AS_EXPBIN_SLOT_OK.
+	as_expbin_slot_status status;
+
+	// Type of the stored value, with compact envelopes as the type they
+	// hold. AS_UNDEF unless status is AS_EXPBIN_SLOT_OK or
+	// AS_EXPBIN_SLOT_WRONG_TYPE.
+	as_val_t val_type;
+
+	union {
+		int64_t i64;
+		double f64;
+
+		// Borrowed from the record, valid until it is destroyed.
+		struct {
+			const uint8_t* data;
+			uint32_t size;
+		} view;
+	} value;
+} as_expbin_slot;
+
+/*
+ * Replaces the cluster as the target of a handle's synchronous operations,
+ * e.g. with the in-process stand-in in as_expbin_standin.h. Each function
+ * gets the transport's udata and the arguments of the client call it
+ * replaces. Arguments are borrowed, results are owned by the caller.
+ */
+typedef struct as_expbin_transport_s {
+	// Replaces aerospike_key_apply().
+	as_status (*apply)(void* udata, as_error* err, const as_policy_apply* policy, const as_key* key, const char* module, const char* fn, as_list* arglist, as_val** result);
+
+	// Replaces a background scan UDF apply over ns and set, and its wait.
+	as_status (*scan_apply)(void* udata, as_error* err, const as_policy_scan* policy, const char* ns, const char* set, const char* module, const char* fn, as_list* arglist);
+
+	// Replaces aerospike_key_select().
+	as_status (*select)(void* udata, as_error* err, const as_policy_read* policy, const as_key* key, const char* bins[], as_record** rec);
+
+	// Replaces aerospike_udf_put() and its wait.
+	as_status (*udf_put)(void* udata, as_error* err, const char* filename, const as_bytes* content);
+
+	// Replaces aerospike_info_any(). The response is freed with free(). May
+	// be NULL.
+	as_status (*info)(void* udata, as_error* err, const char* request, char** response);
+
+	void* udata;
+} as_expbin_transport;
+
+/*
+ * Result of one partition range of as_expbin_clean_partitions().
+ */
+typedef struct as_expbin_clean_range_s {
+	// Partitions [part_begin, part_begin + part_count).
+	uint32_t part_begin;
+	uint32_t part_count;
+
+	// Records read, and records with expired bins cleaned.
+	uint64_t scanned;
+	uint64_t cleaned;
+
+	// Wall time of the range, including throttling.
+	uint64_t nanos;
+
+	// Status of the range's scan.
+	as_status status;
+} as_expbin_clean_range;
+
+/*
+ * Running totals of as_expbin_clean_partitions().
+ */
+typedef struct as_expbin_clean_progress_s {
+	uint32_t ranges_done;
+	uint32_t ranges_total;
+
+	// Ranges whose scan failed. Their partitions may be partly cleaned.
+	uint32_t ranges_failed;
+
+	uint64_t scanned;
+	uint64_t cleaned;
+
+	// Records whose clean apply failed.
+	uint64_t failed;
+
+	// The range that just finished, only valid during the progress call.
+	const as_expbin_clean_range* range;
+} as_expbin_clean_progress;
+
+/*
+ * Called after each partition range, one call at a time.
+ */
+typedef void (*as_expbin_clean_progress_fn)(const as_expbin_clean_progress* progress, void* udata);
+
+/*
+ * Called with each live value found by as_expbin_query_shadow(). The key and
+ * value are borrowed for the call, which may come from several threads at
+ * once. Return false to stop the query.
+ */
+typedef bool (*as_expbin_query_fn)(const as_key* key, const as_val* val, void* udata);
+
+/*
+ * Settings of an as_expbin_cache, see as_expbin_cache_config_init() for the
+ * defaults.
+ */
+typedef struct as_expbin_cache_config_s {
+	// Independently locked parts, each with its own LRU list.
+	uint32_t shards;
+
+	// Budget for cached values and their entries, split evenly between the
+	// shards. The least recently used entries are dropped past it.
+	uint64_t max_bytes;
+
+	// Longest a value is served from the cache, in seconds. Values of
+	// expire bins are never served past their own expiry.
+	uint32_t max_ttl;
+} as_expbin_cache_config;
+
+/*
+ * Counters of an as_expbin_cache, see as_expbin_cache_stats().
+ */
+typedef struct as_expbin_cache_stats_s {
+	// Bins served from the cache, and bins read from the cluster.
+	uint64_t hits;
+	uint64_t misses;
+
+	// Entries dropped for the byte budget, and by writes through a handle.
+	uint64_t evictions;
+	uint64_t invalidations;
+
+	uint64_t entries;
+	uint64_t bytes;
+} as_expbin_cache_stats;
+
+/*
+ * Read repair counters of a handle, see as_expbin_repair_stats_get().
+ */
+typedef struct as_expbin_repair_stats_s {
+	// Gets that erased expired bins.
+	uint64_t repairs;
+
+	// Bins erased, and the module's estimate of the bytes they took.
+	uint64_t bins;
+	uint64_t bytes;
+} as_expbin_repair_stats;
+
+/*
+ * A client-side cache of as_expbin_get() results, see as_expbin_cache_new().
+ */
+typedef struct as_expbin_cache_s as_expbin_cache;
+
+/*
+ * A reusable builder of entry lists, see as_expbin_args_new().
+ */
+typedef struct as_expbin_args_s as_expbin_args;
+
+/*
+ * Settings of as_expbin_clean_partitions(), see
+ * as_expbin_clean_config_init() for the defaults.
+ */
+typedef struct as_expbin_clean_config_s {
+	// Partition ranges cleaned in parallel.
+	uint32_t threads;
+
+	// Partitions per range. 1 reports timings per partition.
+	uint32_t range_size;
+
+	// Threads issuing the clean applies, fed by the scans through a bounded
+	// queue. 0 applies from the scan callbacks instead, stalling the scans.
+	uint32_t apply_threads;
+
+	// Cap on records read per second across all threads, and on clean
+	// applies per second, 0 for none. The reads are capped by splitting it
+	// evenly into the scans' records_per_second, unless the scan policy sets
+	// one.
+	uint32_t max_rps;
+
+	// Optional.
+	as_expbin_clean_progress_fn progress;
+	void* udata;
+} as_expbin_clean_config;
+
+/*
+ * Per-handle context for the expirable bin module. A handle holds no
+ * per-call state and may be shared by any number of threads once
+ * initialized, as may the aerospike instance it refers to.
+ */
+typedef struct as_expbin_s {
+	// Cluster connection, owned by the caller.
+	aerospike* as;
+
+	// Namespace and set used by scan based operations (clean).
+	char ns[AS_NAMESPACE_MAX_SIZE];
+	char set[AS_SET_MAX_SIZE];
+
+	// Registered name of the Lua module.
+	char module[AS_UDF_MODULE_MAX_SIZE];
+
+	// How get and ttl are served, AS_EXPBIN_READ_UDF by default.
+	as_expbin_read_mode read_mode;
+
+	// Format of expire bins written by put and puts, AS_EXPBIN_FORMAT_MAP
+	// by default.
+	as_expbin_format format;
+
+	// Module logging applied by as_expbin_register(). AS_EXPBIN_LOG_MODULE
+	// by default, which keeps the module file's own flag. The module is
+	// shared by every client of the cluster, so the last registration wins.
+	as_expbin_log_level log_level;
+
+	// Namespace default-ttl in seconds, 0 for never, learned by
+	// as_expbin_register(), or by the first call of a handle that skipped it.
+	// Lets writes check a new record's TTL before writing it. While it is
+	// unknown, AS_EXPBIN_TTL_NONE, a write to a new record creates it to
+	// learn its TTL, and removes it again if a bin TTL is rejected, or with
+	// AS_EXPBIN_WRITE_EXTEND_TTL updates it again to raise the TTL.
+	int64_t default_ttl;
+
+	// Set once a call has asked for default_ttl, so a failed request is not
+	// repeated. as_expbin_register() always asks.
+	bool default_ttl_asked;
+
+	// Shadow bins are off while empty. Otherwise put, puts and touch also
+	// write an expire bin's integer or string value to the plain bin named
+	// shadow_prefix followed by the bin name, which a secondary index can
+	// cover, and clean removes it with the expire bin. The combined name
+	// must fit AS_BIN_NAME_MAX_LEN. See as_expbin_query_shadow().
+	char shadow_prefix[AS_BIN_NAME_MAX_SIZE];
+
+	// If set, clean also lowers a record's TTL to the latest expiry of its
+	// remaining expire bins, and removes the record when none is left live,
+	// so the server's own expiration reclaims it. Records holding any other
+	// bin, or an expire bin that never expires, keep their TTL. Off by
+	// default.
+	bool clean_shrink;
+
+	// Read repair is off while 0. Otherwise a get through the module erases
+	// the expired expire bins among those it reads, in the same call, when
+	// they take at least this many bytes by the module's estimate. Gets
+	// served natively or from the cache never write. See
+	// as_expbin_repair_stats_get().
+	uint32_t repair_min_bytes;
+
+	// Read repair counters, updated atomically.
+	as_expbin_repair_stats repaired;
+
+	// If set, as_expbin_get() serves bins from this cache and reads only the
+	// rest, which refills it. Writes through the handle drop the bins they
+	// change, writes by anyone else show once the entries time out. Owned by
+	// the caller, may be shared by handles of the same cluster.
+	as_expbin_cache* cache;
+
+	// If set, synchronous operations go here instead of to the cluster, and
+	// as may be NULL. Owned by the caller. The async API always uses the
+	// cluster.
+	const as_expbin_transport* transport;
+} as_expbin;
+
+//==========================================================
+// Public API
+//
+
+/*
+ * Initialize a handle.
+ *
+ * \param eb  - The handle to initialize.
+ * \param as  - A connected aerospike instance. Must outlive the handle. May
+ *              be NULL if a transport is set before use.
+ * \param ns  - Namespace for scan based operations.
+ * \param set - Set for scan based operations, or NULL for the whole namespace.
+ * \return    - eb if successful, NULL if a name is too long.
+ */
+as_expbin* as_expbin_init(as_expbin* eb, aerospike* as, const char* ns, const char* set);
+
+/*
+ * Release resources held by a handle. Does not close the aerospike instance.
+ */
+void as_expbin_destroy(as_expbin* eb);
+
+/*
+ * Register the Lua module file with the cluster and wait for it to reach
+ * every node. Unless log_level is AS_EXPBIN_LOG_MODULE, the module's debug
+ * flag is set from it first, a file without one (see "make lua-strip") is
+ * registered as is. Also learns the
+ * namespace default-ttl, see default_ttl.
+ *
+ * \param eb   - The handle to use.
+ * \param err  - The as_error to be populated if an error occurs.
+ * \param path - Path to expire_bin.lua.
+ * \return     - AEROSPIKE_OK if successful, an error code otherwise.
+ */
+as_status as_expbin_register(as_expbin* eb, as_error* err, const char* path);
+
+/*
+ * Attempt to retrieve values from list of bins. The bins
+ * can be expire bins or normal bins.
+ *
+ * \param eb      - The handle to use for this operation.
+ * \param err     - The as_error to be populated if an error occurs.
+ * \param policy  - The policy to use for this operation. If NULL, then the default policy will be used.
+ * \param key     - The key of the record.
+ * \param bins    - NULL terminated array of bin names to retrieve values from.
+ * \param result  - Set to a map of bin name to value. Expired or empty bins are absent.
+ *                  The caller must destroy it with as_map_destroy().
+ * \return        - AEROSPIKE_OK if successful, AEROSPIKE_ERR_RECORD_NOT_FOUND if the
+ *                  record does not exist, another error code otherwise.
+ */
+as_status as_expbin_get(as_expbin* eb, as_error* err, const as_policy_apply* policy, const as_key* key, const char* bins[], as_map** result);
+
+/*
+ * Retrieve values from bins of many records with batch reads, one request
+ * per node instead of one UDF call per key. Expiry is checked in the client,
+ * with the same results as as_expbin_get() in AS_EXPBIN_READ_NATIVE mode.
+ *
+ * \param eb      - The handle to use for this operation. With a transport, the
+ *                  records are read one by one.
+ * \param err     - The as_error to be populated if an error occurs.
+ * \param policy  - The policy to use for this operation. If NULL, then the default policy will be used.
+ * \param batch   - The keys of the records.
+ * \param bins    - NULL terminated array of bin names to retrieve values from.
+ * \param results - One slot per key, in batch order. Set to a map of bin name to value,
+ *                  expired or empty bins absent, or NULL if the record does not exist.
+ *                  The caller must destroy each map with as_map_destroy().
+ * \return        - AEROSPIKE_OK if successful, another error code otherwise, in which
+ *                  case every slot is NULL.
+ */
+as_status as_expbin_get_many(as_expbin* eb, as_error* err, const as_policy_batch* policy, const as_batch* batch, const char* bins[], as_map* results[]);
+
+/*
+ * Read bins of a record straight into typed slots, with the same liveness
+ * as as_expbin_get() in AS_EXPBIN_READ_NATIVE mode. The bins are read with
+ * one select and decoded in place, so no value is allocated beyond those
+ * of the record itself, and no result map is built. The handle's cache and
+ * read mode don't apply.
+ *
+ * \param eb      - The handle to use for this operation.
+ * \param err     - The as_error to be populated if an error occurs.
+ * \param policy  - The policy to use for this operation. If NULL, then the default policy will be used.
+ * \param key     - The key of the record.
+ * \param slots   - The bins to read and their types. Each slot's status and value are set,
+ *                  every status is AS_EXPBIN_SLOT_MISSING if the record does not exist.
+ * \param n_slots - Number of slots, at most AS_EXPBIN_MAX_BINS.
+ * \param rec     - Must not be NULL. *rec is NULL, or a caller-owned record to populate,
+ *                  as aerospike_key_select() takes it. Set to the record the views borrow
+ *                  from, or left NULL if the record does not exist. The caller must destroy
+ *                  it with as_record_destroy() once done with the slots.
+ * \return        - AEROSPIKE_OK if successful, AEROSPIKE_ERR_RECORD_NOT_FOUND if the
+ *                  record does not exist, another error code otherwise.
+ */
+as_status as_expbin_get_slots(as_expbin* eb, as_error* err, const as_policy_apply* policy, const as_key* key, as_expbin_slot slots[], uint32_t n_slots, as_record** rec);
+
+/*
+ * Get the read repair counters of a handle.
+ */
+void as_expbin_repair_stats_get(const as_expbin* eb, as_expbin_repair_stats* stats);
+
+/*
+ * Create or update an expire bin. If bin_ttl is not AS_EXPBIN_TTL_NONE, a new
+ * bin will be an expire bin, otherwise a normal bin is created and an existing
+ * expire bin is updated. Note: existing expire bins will not be converted into
+ * normal bins by AS_EXPBIN_TTL_NONE.
+ *
+ * \param eb      - The handle to use for this operation.
+ * \param err     - The as_error to be populated if an error occurs.
+ * \param policy  - The policy to use for this operation. If NULL, then the default policy will be used.
+ * \param key     - The key of the record.
+ * \param bin     - Bin name.
+ * \param val     - Bin value. Ownership stays with the caller.
+ * \param bin_ttl - Expiration time in seconds, AS_EXPBIN_TTL_NEVER or AS_EXPBIN_TTL_NONE.
+ * \return        - AEROSPIKE_OK if written, AEROSPIKE_ERR_UDF if the module rejected
+ *                  the bin TTL, another error code otherwise.
+ */
+as_status as_expbin_put(as_expbin* eb, as_error* err, const as_policy_apply* policy, const as_key* key, const char* bin, as_val* val, int64_t bin_ttl);
+
+/*
+ * as_expbin_put() with as_expbin_write_flags. With AS_EXPBIN_WRITE_EXTEND_TTL
+ * a bin TTL longer than the record's raises the record TTL instead of being
+ * rejected.
+ *
+ * \param flags - as_expbin_write_flags, or'd together.
+ */
+as_status as_expbin_put_flags(as_expbin* eb, as_error* err, const as_policy_apply* policy, const as_key* key, const char* bin, as_val* val, int64_t bin_ttl, uint32_t flags);
+
+/*
+ * Batch create or update expire bins for a given key. Use the as_map:
+ * {'bin' : bin_name, 'val' : bin_value, 'bin_ttl' : ttl} to store each put operation.
+ * Omit the bin_ttl to turn bin creation off. The handle's format applies to
+ * every entry. All or nothing: the record is written once, and not at all if
+ * any entry's bin TTL is rejected.
+ *
+ * \param eb      - The handle to use for this operation.
+ * \param err     - The as_error to be populated if an error occurs.
+ * \param policy  - The policy to use for this operation. If NULL, then the default policy will be used.
+ * \param key     - The key of the record.
+ * \param entries - The list of as_maps, see as_expbin_entry_new().
+ * \return        - AEROSPIKE_OK if written, AEROSPIKE_ERR_UDF if the module rejected
+ *                  a bin TTL, another error code otherwise.
+ */
+as_status as_expbin_puts(as_expbin* eb, as_error* err, const as_policy_apply* policy, const as_key* key, as_list* entries);
+
+/*
+ * as_expbin_puts() with as_expbin_write_flags, see as_expbin_put_flags().
+ * With AS_EXPBIN_WRITE_EXTEND_TTL the record TTL is raised to the longest
+ * bin TTL of the entries.
+ */
+as_status as_expbin_puts_flags(as_expbin* eb, as_error* err, const as_policy_apply* policy, const as_key* key, as_list* entries, uint32_t flags);
+
+/*
+ * Batch update the bin TTLs. Use this method to change or reset the bin TTL of
+ * multiple bins in a record.
+ *
+ * \param eb      - The handle to use for this operation.
+ * \param err     - The as_error to be populated if an error occurs.
+ * \param policy  - The policy to use for this operation. If NULL, then the default policy will be used.
+ * \param key     - The key of the record.
+ * \param entries - The list of as_maps in the form {'bin' : bin_name, 'bin_ttl' : ttl}.
+ * \return        - AEROSPIKE_OK if all ops succeed, an error code otherwise.
+ */
+as_status as_expbin_touch(as_expbin* eb, as_error* err, const as_policy_apply* policy, const as_key* key, as_list* entries);
+
+/*
+ * as_expbin_touch() with as_expbin_write_flags, see as_expbin_put_flags().
+ * With AS_EXPBIN_WRITE_EXTEND_TTL the record TTL is raised to the longest
+ * bin TTL of the entries that touched a bin.
+ */
+as_status as_expbin_touch_flags(as_expbin* eb, as_error* err, const as_policy_apply* policy, const as_key* key, as_list* entries, uint32_t flags);
+
+/*
+ * as_expbin_touch_flags() with a single operate instead of the UDF where it
+ * can. Only the stored expiries are rewritten, by map puts for the map
+ * format or bit writes for compact envelopes, so the cost does not grow
+ * with the values. AS_EXPBIN_NEXT_BIN is lowered as the module does and the
+ * record TTL is left unchanged.
+ *
+ * The operate assumes every bin is in the handle's format. The call goes to
+ * the module instead, with the same result as as_expbin_touch_flags(), if
+ * the handle has a transport or shadow_prefix, flags has
+ * AS_EXPBIN_WRITE_EXTEND_TTL, there are more than AS_EXPBIN_NATIVE_TOUCH_MAX
+ * entries, or the operate is refused because a bin is not an expire bin in
+ * that format or a bin TTL exceeds the record TTL.
+ *
+ * Unlike as_expbin_touch(), the expiry of an operate is computed from the
+ * client's clock.
+ *
+ * \param eb      - The handle to use for this operation.
+ * \param err     - The as_error to be populated if an error occurs.
+ * \param policy  - The policy to use for this operation. If NULL, then the default
+ *                  policy will be used. The operate's filter expression is replaced.
+ * \param key     - The key of the record.
+ * \param entries - The list of as_maps in the form {'bin' : bin_name, 'bin_ttl' : ttl}.
+ * \param flags   - Bitwise or of as_expbin_write_flags.
+ * \return        - AEROSPIKE_OK if successful, AEROSPIKE_ERR_RECORD_NOT_FOUND if the
+ *                  record is missing, another error code otherwise.
+ */
+as_status as_expbin_touch_native(as_expbin* eb, as_error* err, const as_policy_operate* policy, const as_key* key, as_list* entries, uint32_t flags);
+
+/*
+ * Get bin TTL in seconds.
+ *
+ * \param eb      - The handle to use for this operation.
+ * \param err     - The as_error to be populated if an error occurs.
+ * \param policy  - The policy to use for this operation. If NULL, then the default policy will be used.
+ * \param key     - The key of the record.
+ * \param bin     - The bin name to check.
+ * \param ttl     - Set to the bin time to expire in seconds, or AS_EXPBIN_TTL_NEVER.
+ * \return        - AEROSPIKE_OK if successful, AEROSPIKE_ERR_BIN_NOT_FOUND if the bin
+ *                  is missing, expired or not an expire bin, another error code otherwise.
+ */
+as_status as_expbin_ttl(as_expbin* eb, as_error* err, const as_policy_apply* policy, const as_key* key, const char* bin, int64_t* ttl);
+
+/*
+ * Perform a background scan of the handle's namespace and set, remove all
+ * expired bins and wait for the scan to complete.
+ *
+ * \param eb      - The handle to use for this operation.
+ * \param err     - The as_error to be populated if an error occurs.
+ * \param policy  - The policy to use for this operation. If NULL, then the default policy will be used.
+ * \param bins    - NULL terminated array of bins to clean.
+ * \return        - AEROSPIKE_OK if successful, an error code otherwise.
+ */
+as_status as_expbin_clean(as_expbin* eb, as_error* err, const as_policy_scan* policy, const char* bins[]);
+
+/*
+ * Create the secondary index on AS_EXPBIN_NEXT_BIN for the handle's
+ * namespace and set, named <set>_expbin_next, and wait for it to be built.
+ * An existing index is not an error. Records written before the module kept
+ * the bin are not indexed until they are next written.
+ *
+ * \param eb     - The handle to use for this operation.
+ * \param err    - The as_error to be populated if an error occurs.
+ * \param policy - The policy to use for this operation. If NULL, then the default policy will be used.
+ * \return       - AEROSPIKE_OK if the index exists, an error code otherwise.
+ */
+as_status as_expbin_index_create(as_expbin* eb, as_error* err, const as_policy_info* policy);
+
+/*
+ * Remove expired bins from only the records that have a due bin: a
+ * background query over the index of as_expbin_index_create() runs clean on
+ * records whose AS_EXPBIN_NEXT_BIN is not after now, and this waits for it.
+ * The cost follows the number of due records rather than the set size.
+ *
+ * With a transport, this is as_expbin_clean().
+ *
+ * \param eb     - The handle to use for this operation.
+ * \param err    - The as_error to be populated if an error occurs.
+ * \param policy - The policy to use for this operation. If NULL, then the default policy will be used.
+ * \param bins   - NULL terminated array of bins to clean.
+ * \return       - AEROSPIKE_OK if successful, an error code otherwise.
+ */
+as_status as_expbin_clean_due(as_expbin* eb, as_error* err, const as_policy_write* policy, const char* bins[]);
+
+/*
+ * Get the name of an expire bin's shadow bin, see shadow_prefix.
+ *
+ * \param eb   - The handle to use.
+ * \param err  - The as_error to be populated if an error occurs.
+ * \param bin  - The expire bin.
+ * \param name - Set to the shadow bin name.
+ * \return     - AEROSPIKE_OK if successful, AEROSPIKE_ERR_PARAM if the handle has no
+ *                shadow_prefix or the name is too long.
+ */
+as_status as_expbin_shadow_name(const as_expbin* eb, as_error* err, const char* bin, as_bin_name name);
+
+/*
+ * Create a secondary index on an expire bin's shadow bin for the handle's
+ * namespace and set, named <set>_<shadow bin>, and wait for it to be built.
+ * An existing index is not an error.
+ *
+ * \param eb     - The handle to use for this operation.
+ * \param err    - The as_error to be populated if an error occurs.
+ * \param policy - The policy to use for this operation. If NULL, then the default policy will be used.
+ * \param bin    - The expire bin.
+ * \param type   - AS_INDEX_NUMERIC for integer values, AS_INDEX_STRING for strings.
+ * \return       - AEROSPIKE_OK if the index exists, an error code otherwise.
+ */
+as_status as_expbin_shadow_index_create(as_expbin* eb, as_error* err, const as_policy_info* policy, const char* bin, as_index_type type);
+
+/*
+ * Run a secondary index query on an expire bin's shadow bin and pass the
+ * live values of the matching records to callback. A shadow bin keeps its
+ * value until clean runs, so records whose bin has expired since are left
+ * out here, by reading the expire bin with the query.
+ *
+ * \param eb       - The handle to use for this operation. Must not have a transport.
+ * \param err      - The as_error to be populated if an error occurs.
+ * \param policy   - The policy to use for this operation. If NULL, then the default policy will be used.
+ * \param query    - A query of the handle's namespace and set with a where clause on the
+ *                   shadow bin, see as_expbin_shadow_name(), and no bins selected. The
+ *                   expire bin is selected by this call.
+ * \param bin      - The expire bin.
+ * \param callback - Called with each live value.
+ * \param udata    - Passed to callback.
+ * \return         - AEROSPIKE_OK if successful, an error code otherwise.
+ */
+as_status as_expbin_query_shadow(as_expbin* eb, as_error* err, const as_policy_query* policy, as_query* query, const char* bin, as_expbin_query_fn callback, void* udata);
+
+/*
+ * Set the defaults: 4 threads, ranges of 1 partition, no rate cap, no
+ * progress calls.
+ */
+void as_expbin_clean_config_init(as_expbin_clean_config* config);
+
+/*
+ * Remove expired bins from the handle's namespace and set, one partition
+ * range at a time, config->threads ranges at once. Each range is a scan
+ * reading the given bins. Records with expired bins get a clean apply for
+ * those bins only, records with none are not written. The applies are
+ * queued to config->apply_threads workers, and a range completes once its
+ * applies have. The scans and the clean applies are each capped at
+ * config->max_rps per second. A failed range does not stop the others.
+ *
+ * With a transport, this is as_expbin_clean() reported as one range.
+ *
+ * \param eb           - The handle to use for this operation.
+ * \param err          - The as_error to be populated with the first error.
+ * \param scan_policy  - The policy for the scans. If NULL, then the default policy will be used.
+ * \param apply_policy - The policy for the clean applies. If NULL, then the default policy will be used.
+ * \param config       - The settings. If NULL, then the defaults will be used.
+ * \param bins         - NULL terminated array of bins to clean, at least one.
+ * \param totals       - If not NULL, set to the final totals.
+ * \return             - AEROSPIKE_OK if every range was scanned, the first range's error
+ *                       otherwise. Failed clean applies are only counted.
+ */
+as_status as_expbin_clean_partitions(as_expbin* eb, as_error* err, const as_policy_scan* scan_policy, const as_policy_apply* apply_policy, const as_expbin_clean_config* config, const char* bins[], as_expbin_clean_progress* totals);
+
+/*
+ * Set the defaults: 16 shards, 64 MiB, 5 seconds.
+ */
+void as_expbin_cache_config_init(as_expbin_cache_config* config);
+
+/*
+ * Create a cache for as_expbin_get() results, and set it as a handle's cache.
+ * Each entry is one bin of one record, kept until the bin's expiry or
+ * config->max_ttl, whichever comes first. Bins that are missing or expired
+ * are cached as absent, and a missing record is cached as missing, so a get
+ * fails with AEROSPIKE_ERR_RECORD_NOT_FOUND as it does uncached. A get whose
+ * bins are all cached as absent is read again, to tell the two apart.
+ *
+ * Cached bins are read without the UDF whatever the handle's read_mode, as
+ * in AS_EXPBIN_READ_NATIVE, since the cache needs their stored expiry. The
+ * values in a result are shared with the cache and must not be modified.
+ *
+ * \param config - The settings. If NULL, then the defaults will be used.
+ * \return       - The cache, or NULL if the settings are invalid or out of memory.
+ */
+as_expbin_cache* as_expbin_cache_new(const as_expbin_cache_config* config);
+
+/*
+ * Destroy a cache. Unset it from every handle first.
+ */
+void as_expbin_cache_destroy(as_expbin_cache* cache);
+
+/*
+ * Drop every entry of a cache.
+ */
+void as_expbin_cache_clear(as_expbin_cache* cache);
+
+/*
+ * Get a cache's counters, summed over its shards.
+ */
+void as_expbin_cache_stats_get(as_expbin_cache* cache, as_expbin_cache_stats* stats);
+
+/*
+ * Get fields from a map mode bin. A map mode bin holds many fields, each with
+ * its own expiry, in a single map.
+ *
+ * \param eb      - The handle to use for this operation.
+ * \param err     - The as_error to be populated if an error occurs.
+ * \param policy  - The policy to use for this operation. If NULL, then the default policy will be used.
+ * \param key     - The key of the record.
+ * \param bin     - The map mode bin.
+ * \param fields  - NULL terminated array of field names. Empty for every live field.
+ * \param result  - Set to a map of field name to value. Expired or missing fields are absent.
+ *                  The caller must destroy it with as_map_destroy().
+ * \return        - AEROSPIKE_OK if successful, AEROSPIKE_ERR_RECORD_NOT_FOUND if the
+ *                  record does not exist, another error code otherwise.
+ */
+as_status as_expbin_mget(as_expbin* eb, as_error* err, const as_policy_apply* policy, const as_key* key, const char* bin, const char* fields[], as_map** result);
+
+/*
+ * Create or update fields of a map mode bin. Either every field is written
+ * or, if any field TTL is rejected, none is.
+ *
+ * \param eb      - The handle to use for this operation.
+ * \param err     - The as_error to be populated if an error occurs.
+ * \param policy  - The policy to use for this operation. If NULL, then the default policy will be used.
+ * \param key     - The key of the record.
+ * \param bin     - The map mode bin.
+ * \param entries - The list of as_maps, see as_expbin_field_new().
+ * \return        - AEROSPIKE_OK if written, an error code otherwise.
+ */
+as_status as_expbin_mput(as_expbin* eb, as_error* err, const as_policy_apply* policy, const as_key* key, const char* bin, as_list* entries);
+
+/*
+ * Update the TTL of fields of a map mode bin. Missing fields are skipped.
+ *
+ * \param eb      - The handle to use for this operation.
+ * \param err     - The as_error to be populated if an error occurs.
+ * \param policy  - The policy to use for this operation. If NULL, then the default policy will be used.
+ * \param key     - The key of the record.
+ * \param bin     - The map mode bin.
+ * \param entries - The list of as_maps in the form {'field' : field_name, 'bin_ttl' : ttl}.
+ * \return        - AEROSPIKE_OK if successful, an error code otherwise.
+ */
+as_status as_expbin_mtouch(as_expbin* eb, as_error* err, const as_policy_apply* policy, const as_key* key, const char* bin, as_list* entries);
+
+/*
+ * Get the TTL of a field of a map mode bin in seconds.
+ *
+ * \param ttl     - Set to the field time to expire in seconds, or AS_EXPBIN_TTL_NEVER.
+ * \return        - AEROSPIKE_OK if successful, AEROSPIKE_ERR_BIN_NOT_FOUND if the field
+ *                  is missing or expired, another error code otherwise.
+ */
+as_status as_expbin_mttl(as_expbin* eb, as_error* err, const as_policy_apply* policy, const as_key* key, const char* bin, const char* field, int64_t* ttl);
+
+/*
+ * Perform a background scan of the handle's namespace and set, remove all
+ * expired fields from the given map mode bins, and expired elements from
+ * the given list mode bins, and wait for the scan to complete. A bin left
+ * with no fields or elements is removed.
+ */
+as_status as_expbin_mclean(as_expbin* eb, as_error* err, const as_policy_scan* policy, const char* bins[]);
+
+/*
+ * Generate maps for use with as_expbin_mput() and as_expbin_mtouch().
+ *
+ * \param field   - name of the field.
+ * \param val     - value of the field, or NULL for mtouch. The map takes ownership.
+ * \param bin_ttl - field TTL in seconds, or AS_EXPBIN_TTL_NEVER.
+ * \return        - heap allocated map, destroy with as_map_destroy() or by
+ *                  destroying the list it was appended to.
+ */
+as_map* as_expbin_field_new(const char* field, as_val* val, int64_t bin_ttl);
+
+/*
+ * Get the live elements of a list mode bin. A list mode bin holds a list of
+ * elements, each with its own expiry.
+ *
+ * \param eb      - The handle to use for this operation.
+ * \param err     - The as_error to be populated if an error occurs.
+ * \param policy  - The policy to use for this operation. If NULL, then the default policy will be used.
+ * \param key     - The key of the record.
+ * \param bin     - The list mode bin.
+ * \param result  - Set to the list of live element values, oldest first. The caller must
+ *                  destroy it with as_list_destroy().
+ * \return        - AEROSPIKE_OK if successful, AEROSPIKE_ERR_RECORD_NOT_FOUND if the
+ *                  record does not exist, another error code otherwise.
+ */
+as_status as_expbin_lget(as_expbin* eb, as_error* err, const as_policy_apply* policy, const as_key* key, const char* bin, as_list** result);
+
+/*
+ * Append elements to a list mode bin, creating it if needed. Expired
+ * elements are removed by the same write. Either every element is written
+ * or, if any element TTL is rejected, none is.
+ *
+ * \param eb      - The handle to use for this operation.
+ * \param err     - The as_error to be populated if an error occurs.
+ * \param policy  - The policy to use for this operation. If NULL, then the default policy will be used.
+ * \param key     - The key of the record.
+ * \param bin     - The list mode bin.
+ * \param entries - The list of as_maps, see as_expbin_elem_new().
+ * \return        - AEROSPIKE_OK if written, an error code otherwise.
+ */
+as_status as_expbin_lappend(as_expbin* eb, as_error* err, const as_policy_apply* policy, const as_key* key, const char* bin, as_list* entries);
+
+/*
+ * Insert elements into a list mode bin, like as_expbin_lappend().
+ *
+ * \param index   - Position among the live elements, from 0, to insert before. Past the
+ *                  end appends.
+ */
+as_status as_expbin_linsert(as_expbin* eb, as_error* err, const as_policy_apply* policy, const as_key* key, const char* bin, uint32_t index, as_list* entries);
+
+/*
+ * Generate maps for use with as_expbin_lappend() and as_expbin_linsert().
+ *
+ * \param val     - value of the element. The map takes ownership.
+ * \param bin_ttl - element TTL in seconds, or AS_EXPBIN_TTL_NEVER.
+ * \return        - heap allocated map, destroy with as_map_destroy() or by
+ *                  destroying the list it was appended to.
+ */
+as_map* as_expbin_elem_new(as_val* val, int64_t bin_ttl);
+
+/*
+ * Evaluate a stored bin value the way the module's get does.
+ *
+ * \param stored - The bin value as stored in the record.
+ * \param now    - Current time in seconds since AS_EXPBIN_CITRUSLEAF_EPOCH.
+ * \param data   - Set to the value get would return, borrowed from stored.
+ *                 NULL if expired or if an expire bin holds no data. For a
+ *                 compact envelope this is the envelope itself, see
+ *                 as_expbin_env_decode().
+ * \param expiry - If not NULL, set to the stored expiry time (0 for never)
+ *                 of an expire bin.
+ * \return       - The state of the bin.
+ */
+as_expbin_state as_expbin_eval(const as_val* stored, int64_t now, as_val** data, int64_t* expiry);
+
+/*
+ * Write a compact envelope into buf and wrap it, without allocating. If the
+ * caller already serialized the payload at buf + AS_EXPBIN_ENV_HEADER_SIZE,
+ * nothing is copied.
+ *
+ * \param env      - The as_bytes to wrap buf with. Does not take ownership.
+ * \param buf      - At least AS_EXPBIN_ENV_HEADER_SIZE + size bytes.
+ * \param capacity - Size of buf.
+ * \param expiry   - Expiry time since AS_EXPBIN_CITRUSLEAF_EPOCH, 0 for never.
+ * \param type     - AS_BYTES_INTEGER (8 byte big-endian payload),
+ *                   AS_BYTES_STRING or AS_BYTES_BLOB.
+ * \param payload  - The payload bytes.
+ * \param size     - The payload size.
+ * \return         - env if successful, NULL if buf is too small.
+ */
+as_bytes* as_expbin_env_encode(as_bytes* env, uint8_t* buf, uint32_t capacity, uint32_t expiry, as_bytes_type type, const uint8_t* payload, uint32_t size);
+
+/*
+ * Check whether a stored value is a compact envelope.
+ */
+bool as_expbin_is_env(const as_val* stored);
+
+/*
+ * Decode a compact envelope without copying.
+ *
+ * \param env     - The stored envelope.
+ * \param expiry  - Set to the expiry time, 0 for never.
+ * \param type    - Set to the payload type.
+ * \param payload - Wrapped around the payload inside env. Valid while env is.
+ * \return        - true if env is a compact envelope.
+ */
+bool as_expbin_env_decode(const as_bytes* env, uint32_t* expiry, as_bytes_type* type, as_bytes* payload);
+
+/*
+ * Copy a compact envelope's payload into a new value of its type.
+ *
+ * \return - as_integer, as_string or as_bytes, or NULL if env is not an
+ *            envelope. Destroy with as_val_destroy().
+ */
+as_val* as_expbin_env_to_val(const as_bytes* env);
+
+/*
+ * Current time in seconds since AS_EXPBIN_CITRUSLEAF_EPOCH, as used by the
+ * module for stored expiry times. Read from the coarse clock, or while the
+ * clock thread runs, from its copy.
+ */
+int64_t as_expbin_now(void);
+
+/*
+ * Start the clock thread, which refreshes a shared copy of as_expbin_now()
+ * every 100 ms, so reading it is a plain load. The copy may lag by up to a
+ * tick, so a bin can read as live for that long past its expiry. Each start
+ * is paired with an as_expbin_clock_stop(), the thread runs while any start
+ * is unpaired.
+ *
+ * \param err - The as_error to be populated if an error occurs.
+ * \return    - AEROSPIKE_OK if the thread runs, an error code otherwise.
+ */
+as_status as_expbin_clock_start(as_error* err);
+
+/*
+ * Undo an as_expbin_clock_start(). The last one stops the thread.
+ */
+void as_expbin_clock_stop(void);
+
+/*
+ * Generate maps for use with batch put and touch operations.
+ *
+ * \param bin     - name of bin to perform op on.
+ * \param val     - value of bin, or NULL for touch. The map takes ownership.
+ * \param bin_ttl - bin_ttl for bin (-1 for no expiration, AS_EXPBIN_TTL_NONE to create normal bin).
+ * \return        - heap allocated map, destroy with as_map_destroy() or by
+ *                  destroying the list it was appended to.
+ */
+as_map* as_expbin_entry_new(const char* bin, as_val* val, int64_t bin_ttl);
+
+/*
+ * Create a builder of the entry lists taken by puts, touch, mput, mtouch,
+ * lappend and linsert, as an allocation free alternative to
+ * as_expbin_entry_new(), as_expbin_field_new() and as_expbin_elem_new().
+ * Entries are built in slots the builder keeps across
+ * as_expbin_args_reset(), so once it has held the largest list a thread
+ * needs, building a list allocates nothing. A builder is used by one thread
+ * at a time.
+ *
+ * \param capacity - Entries to make room for up front.
+ * \return         - The builder, or NULL if out of memory.
+ */
+as_expbin_args* as_expbin_args_new(uint32_t capacity);
+
+/*
+ * Destroy a builder and its slots.
+ */
+void as_expbin_args_destroy(as_expbin_args* args);
+
+/*
+ * Empty a builder for the next list, releasing the values of its entries.
+ * Entries still held by an async command in flight are left to it, and the
+ * builder takes fresh ones in their place, allocating again.
+ */
+void as_expbin_args_reset(as_expbin_args* args);
+
+/*
+ * Add an entry for as_expbin_puts() or as_expbin_touch(), as
+ * as_expbin_entry_new() would build it.
+ *
+ * \param args    - The builder.
+ * \param bin     - name of bin to perform op on. Borrowed until the next reset, or
+ *                  until completion if the list goes to an async call.
+ * \param val     - value of bin, or NULL for touch. Reserved until the next reset,
+ *                  ownership stays with the caller.
+ * \param bin_ttl - bin_ttl for bin (-1 for no expiration, AS_EXPBIN_TTL_NONE to create normal bin).
+ * \return        - false if out of memory.
+ */
+bool as_expbin_args_add(as_expbin_args* args, const char* bin, as_val* val, int64_t bin_ttl);
+
+/*
+ * Add an entry for as_expbin_mput() or as_expbin_mtouch(), as
+ * as_expbin_field_new() would build it. Same terms as as_expbin_args_add().
+ */
+bool as_expbin_args_add_field(as_expbin_args* args, const char* field, as_val* val, int64_t bin_ttl);
+
+/*
+ * Add an entry for as_expbin_lappend() or as_expbin_linsert(), as
+ * as_expbin_elem_new() would build it. Same terms as as_expbin_args_add().
+ */
+bool as_expbin_args_add_elem(as_expbin_args* args, as_val* val, int64_t bin_ttl);
+
+/*
+ * The list of the entries added since the last reset, owned by the builder.
+ */
+as_list* as_expbin_args_list(as_expbin_args* args);
+
+#ifdef __cplusplus
+} // end extern "C"
+#endif
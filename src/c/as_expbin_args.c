@@ -0,0 +1,262 @@
+/*******************************************************************************
+ * Copyright 2008-2015 by Aerospike.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ ******************************************************************************/
+
+
+
+//==========================================================
+// Includes
+//
+
+#include "as_expbin.h"
+
+#include <stdlib.h>
+
+#include <aerospike/as_arraylist.h>
+#include <aerospike/as_hashmap.h>
+#include <aerospike/as_integer.h>
+#include <aerospike/as_string.h>
+
+
+//==========================================================
+// Typedefs
+//
+
+// One entry map and the keys and values it points at. Slots are allocated
+// once, and their maps' tables survive as_hashmap_clear(). The map comes
+// first, so a detached slot is freed with its map, see reset.
+typedef struct expbin_args_slot_s {
+	as_hashmap map;
+	as_string name_key;
+	as_string name;
+	as_string val_key;
+	as_string ttl_key;
+	as_integer ttl;
+} expbin_args_slot;
+
+struct as_expbin_args_s {
+	// Holds a reference to each used slot's map, the slot keeps the other.
+	// Any more are held by async commands still in flight.
+	as_arraylist list;
+
+	// NULL where a slot was detached, allocated again when next used.
+
+	expbin_args_slot** slots;
+	uint32_t n_slots;
+	uint32_t capacity;
+};
+
+
+//==========================================================
+// Forward Declarations
+//
+
+static bool expbin_args_add(as_expbin_args* args, const char* name_key, const char* name, as_val* val, bool has_ttl, int64_t bin_ttl);
+static expbin_args_slot* expbin_args_next_slot(as_expbin_args* args);
+static expbin_args_slot* expbin_args_slot_new(void);
+
+
+//==========================================================
+// Public API
+//
+
+as_expbin_args*
+as_expbin_args_new(uint32_t capacity)
+{
+	if (capacity == 0) {
+		capacity = 1;
+	}
+
+	as_expbin_args* args = malloc(sizeof(as_expbin_args));
+
+	if (! args) {
+		return NULL;
+	}
+
+	args->slots = malloc(capacity * sizeof(expbin_args_slot*));
+
+	if (! args->slots) {
+		free(args);
+		return NULL;
+	}
+
+	args->n_slots = 0;
+	args->capacity = capacity;
+	as_arraylist_init(&args->list, capacity, capacity);
+
+	return args;
+}
+
+void
+as_expbin_args_destroy(as_expbin_args* args)
+{
+	as_expbin_args_reset(args);
+
+	for (uint32_t i = 0; i < args->n_slots; i++) {
+		if (args->slots[i]) {
+			as_hashmap_destroy(&args->slots[i]->map);
+			free(args->slots[i]);
+		}
+	}
+
+	as_arraylist_destroy(&args->list);
+	free(args->slots);
+	free(args);
+}
+
+void
+as_expbin_args_reset(as_expbin_args* args)
+{
+	uint32_t size = as_arraylist_size(&args->list);
+
+	as_arraylist_trim(&args->list, 0);
+
+	for (uint32_t i = 0; i < size; i++) {
+		expbin_args_slot* slot = args->slots[i];
+		as_val* map = (as_val*)&slot->map;
+
+		// Only the slot's own reference is left unless an async command still
+		// holds the map. Clearing it then would change the command's entries
+		// under it, so hand the slot over instead - the last release frees it.
+		if (__atomic_load_n(&map->count, __ATOMIC_ACQUIRE) > 1) {
+			map->free = true;
+			as_val_destroy(map);
+			args->slots[i] = NULL;
+			continue;
+		}
+
+		// Destroys the embedded keys and values and releases the caller's.
+		as_hashmap_clear(&slot->map);
+	}
+}
+
+bool
+as_expbin_args_add(as_expbin_args* args, const char* bin, as_val* val,
+		int64_t bin_ttl)
+{
+	return expbin_args_add(args, "bin", bin, val,
+			bin_ttl != AS_EXPBIN_TTL_NONE, bin_ttl);
+}
+
+bool
+as_expbin_args_add_field(as_expbin_args* args, const char* field,
+		as_val* val, int64_t bin_ttl)
+{
+	return expbin_args_add(args, "field", field, val, true, bin_ttl);
+}
+
+bool
+as_expbin_args_add_elem(as_expbin_args* args, as_val* val, int64_t bin_ttl)
+{
+	return expbin_args_add(args, NULL, NULL, val, true, bin_ttl);
+}
+
+as_list*
+as_expbin_args_list(as_expbin_args* args)
+{
+	return (as_list*)&args->list;
+}
+
+
+//==========================================================
+// Local Helpers
+//
+
+static bool
+expbin_args_add(as_expbin_args* args, const char* name_key, const char* name,
+		as_val* val, bool has_ttl, int64_t bin_ttl)
+{
+	expbin_args_slot* slot = expbin_args_next_slot(args);
+
+	if (! slot) {
+		return false;
+	}
+
+	if (name_key) {
+		as_hashmap_set(&slot->map,
+				(as_val*)as_string_init(&slot->name_key, (char*)name_key, false),
+				(as_val*)as_string_init(&slot->name, (char*)name, false));
+	}
+
+	if (val) {
+		as_hashmap_set(&slot->map,
+				(as_val*)as_string_init(&slot->val_key, "val", false),
+				as_val_reserve(val));
+	}
+
+	if (has_ttl) {
+		as_hashmap_set(&slot->map,
+				(as_val*)as_string_init(&slot->ttl_key, "bin_ttl", false),
+				(as_val*)as_integer_init(&slot->ttl, bin_ttl));
+	}
+
+	as_arraylist_append(&args->list, as_val_reserve(&slot->map));
+	return true;
+}
+
+static expbin_args_slot*
+expbin_args_next_slot(as_expbin_args* args)
+{
+	uint32_t i = as_arraylist_size(&args->list);
+
+	if (i < args->n_slots) {
+		if (! args->slots[i]) {
+			args->slots[i] = expbin_args_slot_new();
+		}
+
+		return args->slots[i];
+	}
+
+	if (args->n_slots == args->capacity) {
+		expbin_args_slot** slots = realloc(args->slots,
+				args->capacity * 2 * sizeof(expbin_args_slot*));
+
+		if (! slots) {
+			return NULL;
+		}
+
+		args->slots = slots;
+		args->capacity *= 2;
+	}
+
+	expbin_args_slot* slot = expbin_args_slot_new();
+
+	if (! slot) {
+		return NULL;
+	}
+
+	args->slots[args->n_slots++] = slot;
+
+	return slot;
+}
+
+static expbin_args_slot*
+expbin_args_slot_new(void)
+{
+	expbin_args_slot* slot = malloc(sizeof(expbin_args_slot));
+
+	if (! slot) {
+		return NULL;
+	}
+
+	as_hashmap_init(&slot->map, 3);
+	return slot;
+}
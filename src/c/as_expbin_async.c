@@ -0,0 +1,487 @@
+/*******************************************************************************
+ * Copyright 2008-2015 by Aerospike.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ ******************************************************************************/
+
+
+
+//==========================================================
+// Includes
+//
+
+#include "as_expbin_async.h"
+#include "expbin_internal.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <aerospike/aerospike_key.h>
+#include <aerospike/as_arraylist.h>
+#include <aerospike/as_string.h>
+
+
+//==========================================================
+// Typedefs
+//
+
+struct expbin_cmd_s;
+
+typedef void (*expbin_complete_fn)(struct expbin_cmd_s* cmd, as_error* err, as_val* val);
+
+typedef struct expbin_cmd_s {
+	struct expbin_cmd_s* next;
+	as_expbin_async* async;
+	as_event_loop* event_loop;
+
+	const char* fn;
+	as_key key;
+	as_policy_apply policy;
+	bool has_policy;
+	as_list* arglist;
+
+	expbin_complete_fn complete;
+
+	union {
+		as_expbin_get_listener get;
+		as_expbin_write_listener write;
+		as_expbin_ttl_listener ttl;
+	} listener;
+
+	void* udata;
+} expbin_cmd;
+
+// An event loop's window. Commands complete on the loop's thread, but are
+// issued from whichever thread frees or finds a slot - a submitter's, or
+// the loop's when a completion hands the slot on - so the counts and queue
+// are only touched under the lock. aerospike_key_apply_async() itself may be
+// called from any thread.
+typedef struct expbin_loop_s {
+	pthread_mutex_t lock;
+	uint32_t inflight;
+	expbin_cmd* head;
+	expbin_cmd* tail;
+} expbin_loop;
+
+
+//==========================================================
+// Forward Declarations
+//
+
+static expbin_cmd* expbin_cmd_create(as_expbin_async* async, as_error* err, const as_policy_apply* policy, const as_key* key, const char* fn, as_list* arglist);
+static void expbin_cmd_destroy(expbin_cmd* cmd);
+static as_status expbin_submit(as_expbin_async* async, as_error* err, expbin_cmd* cmd, as_event_loop* event_loop);
+static as_status expbin_issue(expbin_cmd* cmd, as_error* err);
+static void expbin_next(as_expbin_async* async, as_event_loop* event_loop);
+static void expbin_on_value(as_error* err, as_val* val, void* udata, as_event_loop* event_loop);
+static void expbin_on_written(void* udata, as_event_loop* event_loop);
+static void expbin_complete_get(expbin_cmd* cmd, as_error* err, as_val* val);
+static void expbin_complete_write(expbin_cmd* cmd, as_error* err, as_val* val);
+static void expbin_complete_ttl(expbin_cmd* cmd, as_error* err, as_val* val);
+
+
+//==========================================================
+// Public API
+//
+
+as_expbin_async*
+as_expbin_async_init(as_expbin_async* async, as_expbin* eb, uint32_t window,
+		bool pipeline)
+{
+	if (window == 0 || as_event_loop_size == 0) {
+		return NULL;
+	}
+
+	expbin_loop* loops = calloc(as_event_loop_size, sizeof(expbin_loop));
+
+	if (! loops) {
+		return NULL;
+	}
+
+	for (uint32_t i = 0; i < as_event_loop_size; i++) {
+		pthread_mutex_init(&loops[i].lock, NULL);
+	}
+
+	async->eb = eb;
+	async->window = window;
+	async->pipeline = pipeline;
+	async->n_loops = as_event_loop_size;
+	async->loops = loops;
+
+	return async;
+}
+
+void
+as_expbin_async_destroy(as_expbin_async* async)
+{
+	for (uint32_t i = 0; i < async->n_loops; i++) {
+		pthread_mutex_destroy(&async->loops[i].lock);
+	}
+
+	free(async->loops);
+	async->loops = NULL;
+	async->n_loops = 0;
+}
+
+as_status
+as_expbin_get_async(as_expbin_async* async, as_error* err,
+		const as_policy_apply* policy, const as_key* key, const char* bins[],
+		as_expbin_get_listener listener, void* udata,
+		as_event_loop* event_loop)
+{
+	uint32_t n_bins;
+
+	if (expbin_count_bins(err, bins, &n_bins) != AEROSPIKE_OK) {
+		return err->code;
+	}
+
+	as_arraylist* arglist = as_arraylist_new(n_bins, 0);
+
+	for (uint32_t i = 0; i < n_bins; i++) {
+		as_arraylist_append_str(arglist, bins[i]);
+	}
+
+	expbin_cmd* cmd = expbin_cmd_create(async, err, policy, key, "get",
+			(as_list*)arglist);
+
+	if (! cmd) {
+		return err->code;
+	}
+
+	cmd->complete = expbin_complete_get;
+	cmd->listener.get = listener;
+	cmd->udata = udata;
+
+	return expbin_submit(async, err, cmd, event_loop);
+}
+
+as_status
+as_expbin_put_async(as_expbin_async* async, as_error* err,
+		const as_policy_apply* policy, const as_key* key, const char* bin,
+		as_val* val, int64_t bin_ttl, as_expbin_write_listener listener,
+		void* udata, as_event_loop* event_loop)
+{
+	as_arraylist* arglist = as_arraylist_new(4, 0);
+	expbin_append_put_args(async->eb, policy, arglist,
+			(as_val*)as_string_new_strdup(bin), val, bin_ttl,
+			AS_EXPBIN_WRITE_DEFAULT);
+
+	expbin_cmd* cmd = expbin_cmd_create(async, err, policy, key, "put",
+			(as_list*)arglist);
+
+	if (! cmd) {
+		return err->code;
+	}
+
+	cmd->complete = expbin_complete_write;
+	cmd->listener.write = listener;
+	cmd->udata = udata;
+
+	return expbin_submit(async, err, cmd, event_loop);
+}
+
+as_status
+as_expbin_puts_async(as_expbin_async* async, as_error* err,
+		const as_policy_apply* policy, const as_key* key, as_list* entries,
+		as_expbin_write_listener listener, void* udata,
+		as_event_loop* event_loop)
+{
+	as_arraylist* arglist = as_arraylist_new(as_list_size(entries) + 1, 0);
+	expbin_append_puts_args(async->eb, policy, arglist, entries,
+			AS_EXPBIN_WRITE_DEFAULT);
+
+	expbin_cmd* cmd = expbin_cmd_create(async, err, policy, key, "puts",
+			(as_list*)arglist);
+
+	if (! cmd) {
+		return err->code;
+	}
+
+	cmd->complete = expbin_complete_write;
+	cmd->listener.write = listener;
+	cmd->udata = udata;
+
+	return expbin_submit(async, err, cmd, event_loop);
+}
+
+as_status
+as_expbin_touch_async(as_expbin_async* async, as_error* err,
+		const as_policy_apply* policy, const as_key* key, as_list* entries,
+		as_expbin_write_listener listener, void* udata,
+		as_event_loop* event_loop)
+{
+	as_arraylist* arglist = as_arraylist_new(as_list_size(entries) + 1, 0);
+	expbin_append_puts_args(async->eb, policy, arglist, entries,
+			AS_EXPBIN_WRITE_DEFAULT);
+
+	expbin_cmd* cmd = expbin_cmd_create(async, err, policy, key, "touch",
+			(as_list*)arglist);
+
+	if (! cmd) {
+		return err->code;
+	}
+
+	cmd->complete = expbin_complete_write;
+	cmd->listener.write = listener;
+	cmd->udata = udata;
+
+	return expbin_submit(async, err, cmd, event_loop);
+}
+
+as_status
+as_expbin_ttl_async(as_expbin_async* async, as_error* err,
+		const as_policy_apply* policy, const as_key* key, const char* bin,
+		as_expbin_ttl_listener listener, void* udata,
+		as_event_loop* event_loop)
+{
+	as_arraylist* arglist = as_arraylist_new(1, 0);
+	as_arraylist_append_str(arglist, bin);
+
+	expbin_cmd* cmd = expbin_cmd_create(async, err, policy, key, "ttl",
+			(as_list*)arglist);
+
+	if (! cmd) {
+		return err->code;
+	}
+
+	cmd->complete = expbin_complete_ttl;
+	cmd->listener.ttl = listener;
+	cmd->udata = udata;
+
+	return expbin_submit(async, err, cmd, event_loop);
+}
+
+
+//==========================================================
+// Local Helpers
+//
+
+// Takes ownership of arglist, releasing it on failure.
+static expbin_cmd*
+expbin_cmd_create(as_expbin_async* async, as_error* err,
+		const as_policy_apply* policy, const as_key* key, const char* fn,
+		as_list* arglist)
+{
+	// Queued commands outlive the caller's key, so keep our own by digest.
+	if (as_key_set_digest(err, (as_key*)key) != AEROSPIKE_OK) {
+		as_list_destroy(arglist);
+		return NULL;
+	}
+
+	expbin_cmd* cmd = calloc(1, sizeof(expbin_cmd));
+
+	if (! cmd) {
+		as_list_destroy(arglist);
+		as_error_update(err, AEROSPIKE_ERR_CLIENT, "command allocation failed");
+		return NULL;
+	}
+
+	cmd->async = async;
+	cmd->fn = fn;
+	as_key_init_digest(&cmd->key, key->ns, key->set, key->digest.value);
+
+	if (policy) {
+		cmd->policy = *policy;
+		cmd->has_policy = true;
+	}
+
+	cmd->arglist = arglist;
+
+	return cmd;
+}
+
+static void
+expbin_cmd_destroy(expbin_cmd* cmd)
+{
+	as_list_destroy(cmd->arglist);
+	as_key_destroy(&cmd->key);
+	free(cmd);
+}
+
+static as_status
+expbin_submit(as_expbin_async* async, as_error* err, expbin_cmd* cmd,
+		as_event_loop* event_loop)
+{
+	if (! event_loop) {
+		event_loop = as_event_loop_get();
+	}
+
+	cmd->event_loop = event_loop;
+
+	expbin_loop* loop = &async->loops[event_loop->index];
+
+	pthread_mutex_lock(&loop->lock);
+
+	if (loop->inflight >= async->window) {
+		if (loop->tail) {
+			loop->tail->next = cmd;
+		}
+		else {
+			loop->head = cmd;
+		}
+
+		loop->tail = cmd;
+		pthread_mutex_unlock(&loop->lock);
+		return AEROSPIKE_OK;
+	}
+
+	loop->inflight++;
+	pthread_mutex_unlock(&loop->lock);
+
+	as_status rc = expbin_issue(cmd, err);
+
+	if (rc != AEROSPIKE_OK) {
+		expbin_cmd_destroy(cmd);
+
+		// The slot we took may have been the only thing draining the queue.
+		expbin_next(async, event_loop);
+	}
+
+	return rc;
+}
+
+static as_status
+expbin_issue(expbin_cmd* cmd, as_error* err)
+{
+	as_expbin_async* async = cmd->async;
+
+	return aerospike_key_apply_async(async->eb->as, err,
+			cmd->has_policy ? &cmd->policy : NULL, &cmd->key,
+			async->eb->module, cmd->fn, cmd->arglist, expbin_on_value, cmd,
+			cmd->event_loop, async->pipeline ? expbin_on_written : NULL);
+}
+
+// Called when one of the loop's commands is done, on the loop's thread, or
+// on a submitter's if its issue failed. Hands the freed slot to the next
+// queued command, if any.
+static void
+expbin_next(as_expbin_async* async, as_event_loop* event_loop)
+{
+	expbin_loop* loop = &async->loops[event_loop->index];
+
+	while (true) {
+		pthread_mutex_lock(&loop->lock);
+
+		expbin_cmd* cmd = loop->head;
+
+		if (! cmd) {
+			loop->inflight--;
+			pthread_mutex_unlock(&loop->lock);
+			return;
+		}
+
+		loop->head = cmd->next;
+
+		if (! loop->head) {
+			loop->tail = NULL;
+		}
+
+		pthread_mutex_unlock(&loop->lock);
+
+		as_error err;
+
+		if (expbin_issue(cmd, &err) == AEROSPIKE_OK) {
+			return;
+		}
+
+		// This command was accepted by its submitter, so report the failure
+		// through its listener and try the next one.
+		cmd->complete(cmd, &err, NULL);
+		expbin_cmd_destroy(cmd);
+	}
+}
+
+// val belongs to the client, which destroys it when this returns - see
+// as_async_value_listener. Listeners only borrow it.
+static void
+expbin_on_value(as_error* err, as_val* val, void* udata,
+		as_event_loop* event_loop)
+{
+	expbin_cmd* cmd = (expbin_cmd*)udata;
+	as_expbin_async* async = cmd->async;
+
+	cmd->complete(cmd, err, val);
+	expbin_cmd_destroy(cmd);
+	expbin_next(async, event_loop);
+}
+
+// Nothing to do - the window, not the pipe, decides when the next command is
+// issued. Passing a pipe listener is what selects a pipelined connection.
+static void
+expbin_on_written(void* udata, as_event_loop* event_loop)
+{
+}
+
+static void
+expbin_complete_get(expbin_cmd* cmd, as_error* err, as_val* val)
+{
+	as_error check;
+
+	if (! err && expbin_check_map(&check, val) != AEROSPIKE_OK) {
+		err = &check;
+	}
+
+	cmd->listener.get(err, err ? NULL : (as_map*)val, cmd->udata,
+			cmd->event_loop);
+}
+
+static void
+expbin_complete_write(expbin_cmd* cmd, as_error* err, as_val* val)
+{
+	as_error check;
+
+	if (! err && expbin_check_code(&check, cmd->fn, val) != AEROSPIKE_OK) {
+		err = &check;
+	}
+
+	as_expbin_cache* cache = cmd->async->eb->cache;
+
+	if (cache) {
+		// put's first argument is the bin, puts' and touch's are entries.
+		if (strcmp(cmd->fn, "put") == 0) {
+			as_string* bin = as_string_fromval(as_list_get(cmd->arglist, 0));
+
+			expbin_cache_forget(cache, &cmd->key, as_string_get(bin));
+		}
+		else {
+			expbin_cache_forget_entries(cache, &cmd->key, cmd->arglist);
+		}
+	}
+
+	cmd->listener.write(err, cmd->udata, cmd->event_loop);
+}
+
+static void
+expbin_complete_ttl(expbin_cmd* cmd, as_error* err, as_val* val)
+{
+	as_error check;
+	int64_t ttl = 0;
+
+	if (! err) {
+		as_string* bin = as_string_fromval(as_list_get(cmd->arglist, 0));
+
+		if (expbin_check_ttl(&check, as_string_get(bin), val, &ttl) !=
+				AEROSPIKE_OK) {
+			err = &check;
+		}
+	}
+
+	cmd->listener.ttl(err, ttl, cmd->udata, cmd->event_loop);
+}
@@ -0,0 +1,143 @@
+/*******************************************************************************
+ * Copyright 2008-2015 by Aerospike.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ ******************************************************************************/
+
+
+#pragma once
+
+//==========================================================
+// Includes
+//
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <aerospike/as_event.h>
+
+#include "as_expbin.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//==========================================================
+// Typedefs
+//
+
+/*
+ * Called when an as_expbin_get_async() completes. On success err is NULL and
+ * result holds the live bins. result is borrowed: the client destroys it
+ * when the listener returns, so reserve it with as_val_reserve() to keep it
+ * and never destroy it otherwise.
+ */
+typedef void (*as_expbin_get_listener)(as_error* err, as_map* result, void* udata, as_event_loop* event_loop);
+
+/*
+ * Called when an as_expbin_put_async(), as_expbin_puts_async() or
+ * as_expbin_touch_async() completes. On success err is NULL.
+ */
+typedef void (*as_expbin_write_listener)(as_error* err, void* udata, as_event_loop* event_loop);
+
+/*
+ * Called when an as_expbin_ttl_async() completes. On success err is NULL and
+ * ttl holds the bin time to expire in seconds, or AS_EXPBIN_TTL_NEVER.
+ */
+typedef void (*as_expbin_ttl_listener)(as_error* err, int64_t ttl, void* udata, as_event_loop* event_loop);
+
+struct expbin_loop_s;
+
+/*
+ * Async dispatcher for one handle. Commands are issued on the client's event
+ * loops. Each event loop keeps at most 'window' commands in flight; further
+ * commands queue in submission order and are issued as earlier ones complete.
+ * With 'pipeline' set, commands go out on the client's pipelined connections
+ * (see as_config.pipe_max_conns_per_node) instead of one connection each.
+ */
+typedef struct as_expbin_async_s {
+	as_expbin* eb;
+	uint32_t window;
+	bool pipeline;
+
+	// One entry per event loop, indexed by as_event_loop.index.
+	uint32_t n_loops;
+	struct expbin_loop_s* loops;
+} as_expbin_async;
+
+//==========================================================
+// Public API
+//
+
+/*
+ * Initialize an async dispatcher. The client's event loops must already be
+ * created, see as_event_create_loops().
+ *
+ * \param async    - The dispatcher to initialize.
+ * \param eb       - The handle commands run against. Must outlive the dispatcher.
+ * \param window   - Commands in flight per event loop, at least 1.
+ * \param pipeline - Use pipelined connections.
+ * \return         - async if successful, NULL otherwise.
+ */
+as_expbin_async* as_expbin_async_init(as_expbin_async* async, as_expbin* eb, uint32_t window, bool pipeline);
+
+/*
+ * Release a dispatcher. Every submitted command must have completed.
+ */
+void as_expbin_async_destroy(as_expbin_async* async);
+
+/*
+ * Async as_expbin_get(). Arguments are copied, so they need not outlive the
+ * call. The key is sent by digest. If event_loop is NULL, one is chosen round
+ * robin.
+ *
+ * \return - AEROSPIKE_OK if the command was issued or queued, in which case the
+ *           listener will be called exactly once. Otherwise an error code, and
+ *           the listener is not called.
+ */
+as_status as_expbin_get_async(as_expbin_async* async, as_error* err, const as_policy_apply* policy, const as_key* key, const char* bins[], as_expbin_get_listener listener, void* udata, as_event_loop* event_loop);
+
+/*
+ * Async as_expbin_put(). See as_expbin_get_async() for argument lifetime and
+ * return value.
+ */
+as_status as_expbin_put_async(as_expbin_async* async, as_error* err, const as_policy_apply* policy, const as_key* key, const char* bin, as_val* val, int64_t bin_ttl, as_expbin_write_listener listener, void* udata, as_event_loop* event_loop);
+
+/*
+ * Async as_expbin_puts(). The entries are reserved until completion. A list
+ * from an as_expbin_args builder may be reset and reused once this returns,
+ * the command keeps its entries, but the bin names added to it must stay
+ * valid until completion.
+ */
+as_status as_expbin_puts_async(as_expbin_async* async, as_error* err, const as_policy_apply* policy, const as_key* key, as_list* entries, as_expbin_write_listener listener, void* udata, as_event_loop* event_loop);
+
+/*
+ * Async as_expbin_touch(). The entries are reserved until completion, see
+ * as_expbin_puts_async() for builder lists.
+ */
+as_status as_expbin_touch_async(as_expbin_async* async, as_error* err, const as_policy_apply* policy, const as_key* key, as_list* entries, as_expbin_write_listener listener, void* udata, as_event_loop* event_loop);
+
+/*
+ * Async as_expbin_ttl().
+ */
+as_status as_expbin_ttl_async(as_expbin_async* async, as_error* err, const as_policy_apply* policy, const as_key* key, const char* bin, as_expbin_ttl_listener listener, void* udata, as_event_loop* event_loop);
+
+#ifdef __cplusplus
+} // end extern "C"
+#endif
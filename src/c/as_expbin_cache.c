@@ -0,0 +1,718 @@
+/*******************************************************************************
+ * Copyright 2008-2015 by Aerospike.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ ******************************************************************************/
+
+
+
+//==========================================================
+// Includes
+//
+
+#include "as_expbin.h"
+#include "expbin_internal.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <aerospike/as_hashmap.h>
+#include <aerospike/as_msgpack.h>
+#include <aerospike/as_serializer.h>
+#include <aerospike/as_string.h>
+#include <aerospike/as_stringmap.h>
+
+
+//==========================================================
+// Constants
+//
+
+#define EXPBIN_CACHE_BUCKETS_MIN 64
+
+// Bin name of the entry caching a record as missing. No bin has it.
+#define EXPBIN_CACHE_RECORD ""
+
+
+//==========================================================
+// Typedefs
+//
+
+typedef struct expbin_cache_entry_s {
+	// Next entry of the same bucket.
+	struct expbin_cache_entry_s* chain;
+
+	// LRU list, most recently used first.
+	struct expbin_cache_entry_s* prev;
+	struct expbin_cache_entry_s* next;
+
+	uint64_t hash;
+	uint8_t digest[AS_DIGEST_VALUE_SIZE];
+	char ns[AS_NAMESPACE_MAX_SIZE];
+	as_bin_name bin;
+
+	// NULL for a bin cached as absent.
+	as_val* val;
+
+	// First second, in as_expbin_now() time, the entry is no longer served.
+	int64_t deadline;
+
+	uint64_t size;
+} expbin_cache_entry;
+
+typedef struct expbin_cache_shard_s {
+	pthread_mutex_t lock;
+
+	// Power of 2 buckets, doubled when the entries outnumber them.
+	expbin_cache_entry** buckets;
+	uint32_t n_buckets;
+
+	expbin_cache_entry* head;
+	expbin_cache_entry* tail;
+
+	// Bumped by every invalidation, so a fill read before one is dropped.
+	uint64_t gen;
+
+	as_expbin_cache_stats stats;
+} expbin_cache_shard;
+
+struct as_expbin_cache_s {
+	as_expbin_cache_config config;
+	uint64_t shard_bytes;
+	expbin_cache_shard* shards;
+};
+
+
+//==========================================================
+// Forward Declarations
+//
+
+static expbin_cache_shard* expbin_cache_locate(as_expbin_cache* cache, as_key* key, const char* bin, uint64_t* hash);
+static expbin_cache_entry** expbin_cache_find(expbin_cache_shard* shard, uint64_t hash, const as_key* key, const char* bin);
+static expbin_cache_entry** expbin_cache_slot(expbin_cache_shard* shard, const expbin_cache_entry* entry);
+static void expbin_cache_unlink(expbin_cache_shard* shard, expbin_cache_entry** ref);
+static void expbin_cache_push(expbin_cache_shard* shard, expbin_cache_entry* entry);
+static void expbin_cache_grow(expbin_cache_shard* shard);
+static void expbin_cache_forget_bin(as_expbin_cache* cache, const as_key* key, const char* bin);
+static uint64_t expbin_cache_val_size(const as_val* val);
+
+
+//==========================================================
+// Public API
+//
+
+void
+as_expbin_cache_config_init(as_expbin_cache_config* config)
+{
+	config->shards = 16;
+	config->max_bytes = 64 * 1024 * 1024;
+	config->max_ttl = 5;
+}
+
+as_expbin_cache*
+as_expbin_cache_new(const as_expbin_cache_config* config)
+{
+	as_expbin_cache_config cfg;
+
+	if (config) {
+		cfg = *config;
+	}
+	else {
+		as_expbin_cache_config_init(&cfg);
+	}
+
+	if (cfg.shards == 0 || cfg.max_ttl == 0 || cfg.max_bytes < cfg.shards) {
+		return NULL;
+	}
+
+	as_expbin_cache* cache = malloc(sizeof(as_expbin_cache));
+
+	if (! cache) {
+		return NULL;
+	}
+
+	cache->config = cfg;
+	cache->shard_bytes = cfg.max_bytes / cfg.shards;
+	cache->shards = calloc(cfg.shards, sizeof(expbin_cache_shard));
+
+	if (! cache->shards) {
+		free(cache);
+		return NULL;
+	}
+
+	for (uint32_t i = 0; i < cfg.shards; i++) {
+		expbin_cache_shard* shard = &cache->shards[i];
+
+		shard->buckets = calloc(EXPBIN_CACHE_BUCKETS_MIN,
+				sizeof(expbin_cache_entry*));
+
+		if (! shard->buckets) {
+			cache->config.shards = i;
+			as_expbin_cache_destroy(cache);
+			return NULL;
+		}
+
+		shard->n_buckets = EXPBIN_CACHE_BUCKETS_MIN;
+		pthread_mutex_init(&shard->lock, NULL);
+	}
+
+	return cache;
+}
+
+void
+as_expbin_cache_destroy(as_expbin_cache* cache)
+{
+	as_expbin_cache_clear(cache);
+
+	for (uint32_t i = 0; i < cache->config.shards; i++) {
+		pthread_mutex_destroy(&cache->shards[i].lock);
+		free(cache->shards[i].buckets);
+	}
+
+	free(cache->shards);
+	free(cache);
+}
+
+void
+as_expbin_cache_clear(as_expbin_cache* cache)
+{
+	for (uint32_t i = 0; i < cache->config.shards; i++) {
+		expbin_cache_shard* shard = &cache->shards[i];
+
+		pthread_mutex_lock(&shard->lock);
+
+		expbin_cache_entry* entry = shard->head;
+
+		while (entry) {
+			expbin_cache_entry* next = entry->next;
+
+			if (entry->val) {
+				as_val_destroy(entry->val);
+			}
+
+			free(entry);
+			entry = next;
+		}
+
+		memset(shard->buckets, 0, shard->n_buckets * sizeof(expbin_cache_entry*));
+		shard->head = NULL;
+		shard->tail = NULL;
+		shard->gen++;
+		shard->stats.invalidations += shard->stats.entries;
+		shard->stats.entries = 0;
+		shard->stats.bytes = 0;
+
+		pthread_mutex_unlock(&shard->lock);
+	}
+}
+
+void
+as_expbin_cache_stats_get(as_expbin_cache* cache, as_expbin_cache_stats* stats)
+{
+	memset(stats, 0, sizeof(as_expbin_cache_stats));
+
+	for (uint32_t i = 0; i < cache->config.shards; i++) {
+		expbin_cache_shard* shard = &cache->shards[i];
+
+		pthread_mutex_lock(&shard->lock);
+		stats->hits += shard->stats.hits;
+		stats->misses += shard->stats.misses;
+		stats->evictions += shard->stats.evictions;
+		stats->invalidations += shard->stats.invalidations;
+		stats->entries += shard->stats.entries;
+		stats->bytes += shard->stats.bytes;
+		pthread_mutex_unlock(&shard->lock);
+	}
+}
+
+
+//==========================================================
+// Internal API
+//
+
+as_status
+expbin_get_cached(as_expbin* eb, as_error* err, const as_policy_apply* policy,
+		const as_key* key, const char* bins[], uint32_t n_bins,
+		as_map** result)
+{
+	as_expbin_cache* cache = eb->cache;
+	int64_t now = as_expbin_now();
+	as_val* none;
+	uint64_t rec_gen;
+
+	if (expbin_cache_get(cache, key, EXPBIN_CACHE_RECORD, now, &none,
+			&rec_gen)) {
+		// Only a missing record is cached at the record level.
+		return as_error_update(err, AEROSPIKE_ERR_RECORD_NOT_FOUND,
+				"get: record not found");
+	}
+
+	as_map* map = (as_map*)as_hashmap_new(n_bins ? n_bins : 1);
+	const char* missing[n_bins + 1];
+	uint64_t gens[n_bins + 1];
+	uint32_t n_missing = 0;
+
+	for (uint32_t i = 0; i < n_bins; i++) {
+		as_val* val;
+
+		if (! expbin_cache_get(cache, key, bins[i], now, &val, &gens[i])) {
+			missing[n_missing] = bins[i];
+			gens[n_missing++] = gens[i];
+		}
+		else if (val) {
+			as_stringmap_set(map, bins[i], val);
+		}
+	}
+
+	if (n_missing == 0 && as_map_size(map) != 0) {
+		*result = map;
+		return AEROSPIKE_OK;
+	}
+
+	if (n_missing == 0) {
+		// Every bin is cached as absent, which can't tell an empty result
+		// from a missing record - read them all to answer as uncached.
+		for (uint32_t i = 0; i < n_bins; i++) {
+			missing[i] = bins[i];
+		}
+
+		n_missing = n_bins;
+	}
+
+	missing[n_missing] = NULL;
+
+	as_policy_read read;
+	expbin_read_policy(&read, policy);
+
+	as_record* rec = NULL;
+
+	if (expbin_select(eb, err, &read, key, missing, &rec) != AEROSPIKE_OK) {
+		if (err->code == AEROSPIKE_ERR_RECORD_NOT_FOUND) {
+			expbin_cache_put(cache, key, EXPBIN_CACHE_RECORD, NULL, 0, now,
+					rec_gen);
+		}
+
+		as_map_destroy(map);
+		return err->code;
+	}
+
+	for (uint32_t i = 0; i < n_missing; i++) {
+		as_val* stored = (as_val*)as_record_get(rec, missing[i]);
+		as_val* live = NULL;
+		as_val* data;
+		int64_t expiry = 0;
+
+		if (stored) {
+			if (as_expbin_eval(stored, now, &data, &expiry) != AS_EXPBIN_LIVE) {
+				// Plain bins don't expire, expired ones stay expired until
+				// written.
+				expiry = 0;
+			}
+
+			live = expbin_live_val(stored, now);
+		}
+
+		expbin_cache_put(cache, key, missing[i], live, expiry, now, gens[i]);
+
+		if (live) {
+			as_stringmap_set(map, missing[i], live);
+		}
+	}
+
+	as_record_destroy(rec);
+
+	*result = map;
+	return AEROSPIKE_OK;
+}
+
+bool
+expbin_cache_get(as_expbin_cache* cache, const as_key* key, const char* bin,
+		int64_t now, as_val** val, uint64_t* gen)
+{
+	uint64_t hash;
+	expbin_cache_shard* shard = expbin_cache_locate(cache, (as_key*)key, bin,
+			&hash);
+
+	pthread_mutex_lock(&shard->lock);
+
+	expbin_cache_entry** ref = expbin_cache_find(shard, hash, key, bin);
+
+	if (! *ref) {
+		*gen = shard->gen;
+		shard->stats.misses++;
+		pthread_mutex_unlock(&shard->lock);
+		return false;
+	}
+
+	expbin_cache_entry* entry = *ref;
+
+	if (now >= entry->deadline) {
+		expbin_cache_unlink(shard, ref);
+		*gen = shard->gen;
+		shard->stats.misses++;
+		pthread_mutex_unlock(&shard->lock);
+
+		if (entry->val) {
+			as_val_destroy(entry->val);
+		}
+
+		free(entry);
+		return false;
+	}
+
+	if (shard->head != entry) {
+		// Move to the front of the LRU list.
+		entry->prev->next = entry->next;
+
+		if (entry->next) {
+			entry->next->prev = entry->prev;
+		}
+		else {
+			shard->tail = entry->prev;
+		}
+
+		entry->prev = NULL;
+		entry->next = shard->head;
+		shard->head->prev = entry;
+		shard->head = entry;
+	}
+
+	*val = entry->val ? as_val_reserve(entry->val) : NULL;
+	*gen = shard->gen;
+	shard->stats.hits++;
+	pthread_mutex_unlock(&shard->lock);
+
+	return true;
+}
+
+void
+expbin_cache_put(as_expbin_cache* cache, const as_key* key, const char* bin,
+		as_val* val, int64_t expiry, int64_t now, uint64_t gen)
+{
+	size_t bin_len = strlen(bin);
+
+	if (bin_len >= AS_BIN_NAME_MAX_SIZE) {
+		return;
+	}
+
+	uint64_t size = sizeof(expbin_cache_entry) +
+			(val ? expbin_cache_val_size(val) : 0);
+
+	if (size > cache->shard_bytes) {
+		return;
+	}
+
+	int64_t deadline = now + cache->config.max_ttl;
+
+	if (expiry != 0 && expiry + 1 < deadline) {
+		deadline = expiry + 1;
+	}
+
+	expbin_cache_entry* entry = malloc(sizeof(expbin_cache_entry));
+
+	if (! entry) {
+		return;
+	}
+
+	memcpy(entry->digest, as_key_digest((as_key*)key)->value,
+			AS_DIGEST_VALUE_SIZE);
+	strcpy(entry->ns, key->ns);
+	memcpy(entry->bin, bin, bin_len + 1);
+	entry->val = val ? as_val_reserve(val) : NULL;
+	entry->deadline = deadline;
+	entry->size = size;
+
+	expbin_cache_shard* shard = expbin_cache_locate(cache, (as_key*)key, bin,
+			&entry->hash);
+	expbin_cache_entry* evicted = NULL;
+
+	pthread_mutex_lock(&shard->lock);
+
+	if (shard->gen != gen) {
+		// Invalidated since the miss, the value read may predate the write.
+		pthread_mutex_unlock(&shard->lock);
+
+		if (entry->val) {
+			as_val_destroy(entry->val);
+		}
+
+		free(entry);
+		return;
+	}
+
+	expbin_cache_entry** ref = expbin_cache_find(shard, entry->hash, key, bin);
+
+	if (*ref) {
+		// Replaced, e.g. by two readers missing at once.
+		expbin_cache_entry* old = *ref;
+
+		expbin_cache_unlink(shard, ref);
+		old->next = evicted;
+		evicted = old;
+	}
+
+	expbin_cache_push(shard, entry);
+
+	while (shard->stats.bytes > cache->shard_bytes) {
+		expbin_cache_entry* lru = shard->tail;
+
+		expbin_cache_unlink(shard, expbin_cache_slot(shard, lru));
+		lru->next = evicted;
+		evicted = lru;
+		shard->stats.evictions++;
+	}
+
+	if (shard->stats.entries > shard->n_buckets) {
+		expbin_cache_grow(shard);
+	}
+
+	pthread_mutex_unlock(&shard->lock);
+
+	while (evicted) {
+		expbin_cache_entry* next = evicted->next;
+
+		if (evicted->val) {
+			as_val_destroy(evicted->val);
+		}
+
+		free(evicted);
+		evicted = next;
+	}
+}
+
+void
+expbin_cache_forget(as_expbin_cache* cache, const as_key* key, const char* bin)
+{
+	// The write may have created the record.
+	expbin_cache_forget_bin(cache, key, EXPBIN_CACHE_RECORD);
+	expbin_cache_forget_bin(cache, key, bin);
+}
+
+void
+expbin_cache_forget_entries(as_expbin_cache* cache, const as_key* key,
+		const as_list* entries)
+{
+	uint32_t n_entries = as_list_size(entries);
+
+	for (uint32_t i = 0; i < n_entries; i++) {
+		as_map* entry = as_map_fromval(as_list_get(entries, i));
+		as_string* bin = entry ?
+				as_string_fromval(as_stringmap_get(entry, "bin")) : NULL;
+
+		if (bin) {
+			expbin_cache_forget(cache, key, as_string_get(bin));
+		}
+	}
+}
+
+
+//==========================================================
+// Local Helpers
+//
+
+static expbin_cache_shard*
+expbin_cache_locate(as_expbin_cache* cache, as_key* key, const char* bin,
+		uint64_t* hash)
+{
+	// The digest is already uniformly distributed, mix in the names.
+	uint64_t h;
+
+	memcpy(&h, as_key_digest(key)->value, sizeof(h));
+
+	for (const char* p = key->ns; *p; p++) {
+		h = (h ^ (uint8_t)*p) * 0x100000001b3ULL;
+	}
+
+	for (const char* p = bin; *p; p++) {
+		h = (h ^ (uint8_t)*p) * 0x100000001b3ULL;
+	}
+
+	*hash = h;
+	return &cache->shards[(h >> 32) % cache->config.shards];
+}
+
+// The slot pointing at the matching entry, or at the end of its chain if
+// there is none. The key's digest must be set, see expbin_cache_locate().
+static expbin_cache_entry**
+expbin_cache_find(expbin_cache_shard* shard, uint64_t hash, const as_key* key,
+		const char* bin)
+{
+	expbin_cache_entry** ref = &shard->buckets[hash & (shard->n_buckets - 1)];
+
+	while (*ref) {
+		expbin_cache_entry* entry = *ref;
+
+		if (entry->hash == hash && strcmp(entry->bin, bin) == 0 &&
+				strcmp(entry->ns, key->ns) == 0 &&
+				memcmp(entry->digest, key->digest.value,
+						AS_DIGEST_VALUE_SIZE) == 0) {
+			return ref;
+		}
+
+		ref = &entry->chain;
+	}
+
+	return ref;
+}
+
+// The slot pointing at entry, which must be in the shard.
+static expbin_cache_entry**
+expbin_cache_slot(expbin_cache_shard* shard, const expbin_cache_entry* entry)
+{
+	expbin_cache_entry** ref =
+			&shard->buckets[entry->hash & (shard->n_buckets - 1)];
+
+	while (*ref != entry) {
+		ref = &(*ref)->chain;
+	}
+
+	return ref;
+}
+
+// Remove the entry *ref points at from its bucket and the LRU list.
+static void
+expbin_cache_unlink(expbin_cache_shard* shard, expbin_cache_entry** ref)
+{
+	expbin_cache_entry* entry = *ref;
+
+	*ref = entry->chain;
+
+	if (entry->prev) {
+		entry->prev->next = entry->next;
+	}
+	else {
+		shard->head = entry->next;
+	}
+
+	if (entry->next) {
+		entry->next->prev = entry->prev;
+	}
+	else {
+		shard->tail = entry->prev;
+	}
+
+	shard->stats.entries--;
+	shard->stats.bytes -= entry->size;
+}
+
+static void
+expbin_cache_push(expbin_cache_shard* shard, expbin_cache_entry* entry)
+{
+	expbin_cache_entry** bucket =
+			&shard->buckets[entry->hash & (shard->n_buckets - 1)];
+
+	entry->chain = *bucket;
+	*bucket = entry;
+
+	entry->prev = NULL;
+	entry->next = shard->head;
+
+	if (shard->head) {
+		shard->head->prev = entry;
+	}
+	else {
+		shard->tail = entry;
+	}
+
+	shard->head = entry;
+	shard->stats.entries++;
+	shard->stats.bytes += entry->size;
+}
+
+static void
+expbin_cache_grow(expbin_cache_shard* shard)
+{
+	uint32_t n_buckets = shard->n_buckets * 2;
+	expbin_cache_entry** buckets = calloc(n_buckets,
+			sizeof(expbin_cache_entry*));
+
+	if (! buckets) {
+		// Longer chains, still correct.
+		return;
+	}
+
+	for (expbin_cache_entry* entry = shard->head; entry; entry = entry->next) {
+		expbin_cache_entry** bucket = &buckets[entry->hash & (n_buckets - 1)];
+
+		entry->chain = *bucket;
+		*bucket = entry;
+	}
+
+	free(shard->buckets);
+	shard->buckets = buckets;
+	shard->n_buckets = n_buckets;
+}
+
+static uint64_t
+expbin_cache_val_size(const as_val* val)
+{
+	switch (as_val_type(val)) {
+	case AS_STRING:
+		return as_string_len((as_string*)val);
+
+	case AS_BYTES:
+		return as_bytes_size((as_bytes*)val);
+
+	case AS_LIST:
+	case AS_MAP: {
+		as_serializer ser;
+		as_msgpack_init(&ser);
+
+		uint32_t size = as_serializer_serialize_getsize(&ser, (as_val*)val);
+
+		as_serializer_destroy(&ser);
+		return size;
+	}
+
+	default:
+		return sizeof(int64_t);
+	}
+}
+
+static void
+expbin_cache_forget_bin(as_expbin_cache* cache, const as_key* key,
+		const char* bin)
+{
+	uint64_t hash;
+	expbin_cache_shard* shard = expbin_cache_locate(cache, (as_key*)key, bin,
+			&hash);
+
+	pthread_mutex_lock(&shard->lock);
+
+	expbin_cache_entry** ref = expbin_cache_find(shard, hash, key, bin);
+	expbin_cache_entry* entry = *ref;
+
+	// Even with nothing cached - a reader may be about to fill the bin.
+	shard->gen++;
+
+	if (entry) {
+		expbin_cache_unlink(shard, ref);
+		shard->stats.invalidations++;
+	}
+
+	pthread_mutex_unlock(&shard->lock);
+
+	if (entry) {
+		if (entry->val) {
+			as_val_destroy(entry->val);
+		}
+
+		free(entry);
+	}
+}
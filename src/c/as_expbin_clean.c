@@ -0,0 +1,688 @@
+/*******************************************************************************
+ * Copyright 2008-2015 by Aerospike.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ ******************************************************************************/
+
+
+
+
+//==========================================================
+// Includes
+//
+
+#include "as_expbin.h"
+#include "expbin_internal.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <aerospike/aerospike_index.h>
+#include <aerospike/aerospike_query.h>
+#include <aerospike/aerospike_scan.h>
+#include <aerospike/as_arraylist.h>
+#include <aerospike/as_partition_filter.h>
+#include <aerospike/as_query.h>
+#include <aerospike/as_record.h>
+#include <aerospike/as_scan.h>
+
+
+//==========================================================
+// Constants
+//
+
+// Queued clean applies per apply worker, past which the scans wait.
+#define EXPBIN_CLEAN_QUEUE_PER_WORKER 64
+
+
+//==========================================================
+// Typedefs
+//
+
+struct expbin_clean_job_s;
+
+typedef struct expbin_cleaner_s {
+	as_expbin* eb;
+	as_policy_scan scan_policy;
+	const as_policy_apply* apply_policy;
+	as_expbin_clean_config config;
+	const char** bins;
+	uint32_t n_bins;
+
+	// The module options passed to each clean apply, or NULL.
+	as_map* opts;
+
+	// Next range to claim, ranges are claimed in partition order.
+	uint32_t next_range;
+
+	// Guards progress, first_err and the progress calls.
+	pthread_mutex_t lock;
+	as_expbin_clean_progress progress;
+	as_error first_err;
+
+	// Rate cap on the clean applies: each takes the next slot, interval_ns
+	// apart. The scans are capped by the server, see scan_policy.
+	pthread_mutex_t limit_lock;
+	uint64_t interval_ns;
+	uint64_t next_slot_ns;
+
+	// Records with expired bins, queued by the scan callbacks for the apply
+	// workers so a scan never waits on an apply. Guarded by queue_lock, which
+	// also guards each range's pending count. Applied inline without workers.
+	pthread_mutex_t queue_lock;
+	pthread_cond_t queue_ready;
+	pthread_cond_t queue_space;
+	pthread_cond_t jobs_done;
+	struct expbin_clean_job_s** queue;
+	uint32_t queue_size;
+	uint32_t queue_head;
+	uint32_t queue_count;
+	uint32_t n_workers;
+	bool closed;
+} expbin_cleaner;
+
+typedef struct expbin_clean_ctx_s {
+	expbin_cleaner* cleaner;
+
+	// Nodes of a range are scanned in parallel, so the counts are atomic.
+	as_expbin_clean_range* range;
+	uint64_t failed;
+
+	// Queued and running applies of the range.
+	uint32_t pending;
+} expbin_clean_ctx;
+
+typedef struct expbin_clean_job_s {
+	expbin_clean_ctx* ctx;
+	as_key key;
+	uint32_t n_expired;
+	const char* expired[];
+} expbin_clean_job;
+
+
+//==========================================================
+// Forward Declarations
+//
+
+static void* expbin_clean_worker(void* udata);
+static void expbin_clean_range(expbin_cleaner* cleaner, uint32_t r);
+static bool expbin_clean_record(const as_val* val, void* udata);
+static void* expbin_clean_apply_worker(void* udata);
+static void expbin_clean_apply(expbin_cleaner* cleaner, expbin_clean_job* job);
+static void expbin_clean_throttle(expbin_cleaner* cleaner);
+static uint64_t expbin_clean_nanos(void);
+
+
+//==========================================================
+// Public API
+//
+
+as_status
+as_expbin_index_create(as_expbin* eb, as_error* err,
+		const as_policy_info* policy)
+{
+	as_error_reset(err);
+
+	return expbin_index_create(eb, err, policy, AS_EXPBIN_NEXT_BIN,
+			AS_INDEX_NUMERIC);
+}
+
+as_status
+as_expbin_clean_due(as_expbin* eb, as_error* err, const as_policy_write* policy,
+		const char* bins[])
+{
+	as_error_reset(err);
+
+	if (eb->transport) {
+		// Transports have no secondary indexes.
+		return as_expbin_clean(eb, err, NULL, bins);
+	}
+
+	uint32_t n_bins;
+
+	if (expbin_count_bins(err, bins, &n_bins) != AEROSPIKE_OK) {
+		return err->code;
+	}
+
+	// The query takes ownership of the argument list.
+	as_arraylist* arglist = as_arraylist_new(n_bins + 1, 0);
+
+	for (uint32_t i = 0; i < n_bins; i++) {
+		as_arraylist_append_str(arglist, bins[i]);
+	}
+
+	as_map* opts = expbin_opts_new(eb, AS_EXPBIN_WRITE_DEFAULT, 0);
+
+	if (opts) {
+		as_arraylist_append_map(arglist, opts);
+	}
+
+	as_query query;
+	as_query_init(&query, eb->ns, eb->set);
+	as_query_where_inita(&query, 1);
+	as_query_where(&query, AS_EXPBIN_NEXT_BIN,
+			as_integer_range(1, as_expbin_now()));
+	as_query_apply(&query, eb->module, "clean", (as_list*)arglist);
+
+	uint64_t query_id = 0;
+
+	if (aerospike_query_background(eb->as, err, policy, &query,
+			&query_id) == AEROSPIKE_OK) {
+		aerospike_query_wait(eb->as, err, NULL, &query, query_id, 0);
+	}
+
+	as_query_destroy(&query);
+
+	if (eb->cache) {
+		as_expbin_cache_clear(eb->cache);
+	}
+	return err->code;
+}
+
+void
+as_expbin_clean_config_init(as_expbin_clean_config* config)
+{
+	memset(config, 0, sizeof(as_expbin_clean_config));
+	config->threads = 4;
+	config->range_size = 1;
+	config->apply_threads = 4;
+}
+
+as_status
+as_expbin_clean_partitions(as_expbin* eb, as_error* err,
+		const as_policy_scan* scan_policy, const as_policy_apply* apply_policy,
+		const as_expbin_clean_config* config, const char* bins[],
+		as_expbin_clean_progress* totals)
+{
+	as_error_reset(err);
+
+	expbin_cleaner cleaner;
+	memset(&cleaner, 0, sizeof(expbin_cleaner));
+
+	if (config) {
+		cleaner.config = *config;
+	}
+	else {
+		as_expbin_clean_config_init(&cleaner.config);
+	}
+
+	const as_expbin_clean_config* cfg = &cleaner.config;
+
+	if (cfg->threads == 0 || cfg->range_size == 0 ||
+			cfg->range_size > AS_EXPBIN_PARTITIONS) {
+		return as_error_update(err, AEROSPIKE_ERR_PARAM,
+				"clean: bad threads %u or range size %u", cfg->threads,
+				cfg->range_size);
+	}
+
+	if (expbin_count_bins(err, bins, &cleaner.n_bins) != AEROSPIKE_OK) {
+		return err->code;
+	}
+
+	if (cleaner.n_bins == 0) {
+		return as_error_update(err, AEROSPIKE_ERR_PARAM, "clean: no bins");
+	}
+
+	if (eb->transport) {
+		// Transports only scan whole sets.
+		as_expbin_clean_range range = {
+			.part_begin = 0,
+			.part_count = AS_EXPBIN_PARTITIONS
+		};
+
+		uint64_t start = expbin_clean_nanos();
+
+		range.status = as_expbin_clean(eb, err, scan_policy, bins);
+		range.nanos = expbin_clean_nanos() - start;
+
+		cleaner.progress.ranges_done = 1;
+		cleaner.progress.ranges_total = 1;
+		cleaner.progress.ranges_failed = range.status == AEROSPIKE_OK ? 0 : 1;
+		cleaner.progress.range = &range;
+
+		if (cfg->progress) {
+			cfg->progress(&cleaner.progress, cfg->udata);
+		}
+
+		cleaner.progress.range = NULL;
+
+		if (totals) {
+			*totals = cleaner.progress;
+		}
+
+		return range.status;
+	}
+
+	cleaner.eb = eb;
+	as_policy_scan_copy(scan_policy ? scan_policy :
+			&eb->as->config.policies.scan, &cleaner.scan_policy);
+	cleaner.apply_policy = apply_policy;
+	cleaner.bins = bins;
+	cleaner.progress.ranges_total =
+			(AS_EXPBIN_PARTITIONS + cfg->range_size - 1) / cfg->range_size;
+	cleaner.interval_ns = cfg->max_rps ? 1000000000ULL / cfg->max_rps : 0;
+	as_error_init(&cleaner.first_err);
+	pthread_mutex_init(&cleaner.lock, NULL);
+	pthread_mutex_init(&cleaner.limit_lock, NULL);
+	pthread_mutex_init(&cleaner.queue_lock, NULL);
+	pthread_cond_init(&cleaner.queue_ready, NULL);
+	pthread_cond_init(&cleaner.queue_space, NULL);
+	pthread_cond_init(&cleaner.jobs_done, NULL);
+	cleaner.opts = expbin_opts_new(eb, AS_EXPBIN_WRITE_DEFAULT, 0);
+
+	// Every record checks expiry, so read the clock from a plain load. It
+	// only slows the checks if the thread can't start.
+	as_error clock_err;
+	bool clock = as_expbin_clock_start(&clock_err) == AEROSPIKE_OK;
+
+	// The calling thread is one of the workers.
+	uint32_t n_threads = cfg->threads < cleaner.progress.ranges_total ?
+			cfg->threads : cleaner.progress.ranges_total;
+	pthread_t threads[n_threads];
+	uint32_t started = 0;
+	pthread_t workers[cfg->apply_threads ? cfg->apply_threads : 1];
+
+	cleaner.queue_size = cfg->apply_threads * EXPBIN_CLEAN_QUEUE_PER_WORKER;
+	cleaner.queue = cleaner.queue_size ?
+			malloc(cleaner.queue_size * sizeof(expbin_clean_job*)) : NULL;
+
+	while (cleaner.queue && cleaner.n_workers < cfg->apply_threads &&
+			pthread_create(&workers[cleaner.n_workers], NULL,
+					expbin_clean_apply_worker, &cleaner) == 0) {
+		cleaner.n_workers++;
+	}
+
+	if (cfg->max_rps != 0 && cleaner.scan_policy.records_per_second == 0) {
+		// Have the server pace the reads, throttling in the scan callback
+		// would stall the scan's socket instead.
+		uint32_t rps = cfg->max_rps / n_threads;
+
+		cleaner.scan_policy.records_per_second = rps ? rps : 1;
+	}
+
+	while (started < n_threads - 1 &&
+			pthread_create(&threads[started], NULL, expbin_clean_worker,
+					&cleaner) == 0) {
+		started++;
+	}
+
+	expbin_clean_worker(&cleaner);
+
+	for (uint32_t i = 0; i < started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	// Each range waited for its applies, the queue is empty.
+	pthread_mutex_lock(&cleaner.queue_lock);
+	cleaner.closed = true;
+	pthread_cond_broadcast(&cleaner.queue_ready);
+	pthread_mutex_unlock(&cleaner.queue_lock);
+
+	for (uint32_t i = 0; i < cleaner.n_workers; i++) {
+		pthread_join(workers[i], NULL);
+	}
+
+	free(cleaner.queue);
+
+	if (clock) {
+		as_expbin_clock_stop();
+	}
+
+	if (cleaner.opts) {
+		as_map_destroy(cleaner.opts);
+	}
+
+	pthread_cond_destroy(&cleaner.jobs_done);
+	pthread_cond_destroy(&cleaner.queue_space);
+	pthread_cond_destroy(&cleaner.queue_ready);
+	pthread_mutex_destroy(&cleaner.queue_lock);
+	pthread_mutex_destroy(&cleaner.limit_lock);
+	pthread_mutex_destroy(&cleaner.lock);
+
+	cleaner.progress.range = NULL;
+
+	if (totals) {
+		*totals = cleaner.progress;
+	}
+
+	if (cleaner.first_err.code != AEROSPIKE_OK) {
+		as_error_copy(err, &cleaner.first_err);
+	}
+
+	return err->code;
+}
+
+
+//==========================================================
+// Internal API
+//
+
+as_status
+expbin_index_create(as_expbin* eb, as_error* err, const as_policy_info* policy,
+		const char* bin, as_index_type type)
+{
+	char name[AS_SET_MAX_SIZE + AS_BIN_NAME_MAX_SIZE];
+
+	snprintf(name, sizeof(name), "%s_%s", eb->set, bin);
+
+	as_index_task task;
+
+	if (aerospike_index_create(eb->as, err, &task, policy, eb->ns,
+			eb->set[0] ? eb->set : NULL, bin, name, type) == AEROSPIKE_OK) {
+		return aerospike_index_create_wait(err, &task, 0);
+	}
+
+	if (err->code == AEROSPIKE_ERR_INDEX_FOUND) {
+		as_error_reset(err);
+	}
+
+	return err->code;
+}
+
+
+//==========================================================
+// Local Helpers
+//
+
+static void*
+expbin_clean_worker(void* udata)
+{
+	expbin_cleaner* cleaner = (expbin_cleaner*)udata;
+	uint32_t r;
+
+	while ((r = __atomic_fetch_add(&cleaner->next_range, 1, __ATOMIC_RELAXED)) <
+			cleaner->progress.ranges_total) {
+		expbin_clean_range(cleaner, r);
+	}
+
+	return NULL;
+}
+
+static void
+expbin_clean_range(expbin_cleaner* cleaner, uint32_t r)
+{
+	uint32_t begin = r * cleaner->config.range_size;
+	as_expbin_clean_range range = {
+		.part_begin = begin,
+		.part_count = AS_EXPBIN_PARTITIONS - begin < cleaner->config.range_size ?
+				AS_EXPBIN_PARTITIONS - begin : cleaner->config.range_size
+	};
+
+	expbin_clean_ctx ctx = {
+		.cleaner = cleaner,
+		.range = &range
+	};
+
+	as_scan scan;
+	as_scan_init(&scan, cleaner->eb->ns, cleaner->eb->set);
+	as_scan_select_init(&scan, (uint16_t)cleaner->n_bins);
+
+	for (uint32_t i = 0; i < cleaner->n_bins; i++) {
+		as_scan_select(&scan, cleaner->bins[i]);
+	}
+
+	as_partition_filter pf;
+	as_partition_filter_set_range(&pf, range.part_begin, range.part_count);
+
+	as_error err;
+	as_error_init(&err);
+
+	uint64_t start = expbin_clean_nanos();
+
+	range.status = aerospike_scan_partitions(cleaner->eb->as, &err,
+			&cleaner->scan_policy, &scan, &pf, expbin_clean_record, &ctx);
+
+	as_scan_destroy(&scan);
+
+	// The jobs point at ctx, and the range's counts include its applies.
+	pthread_mutex_lock(&cleaner->queue_lock);
+
+	while (ctx.pending != 0) {
+		pthread_cond_wait(&cleaner->jobs_done, &cleaner->queue_lock);
+	}
+
+	pthread_mutex_unlock(&cleaner->queue_lock);
+
+	range.nanos = expbin_clean_nanos() - start;
+
+	pthread_mutex_lock(&cleaner->lock);
+
+	as_expbin_clean_progress* progress = &cleaner->progress;
+
+	progress->ranges_done++;
+	progress->scanned += range.scanned;
+	progress->cleaned += range.cleaned;
+	progress->failed += ctx.failed;
+
+	if (range.status != AEROSPIKE_OK) {
+		progress->ranges_failed++;
+
+		if (cleaner->first_err.code == AEROSPIKE_OK) {
+			as_error_copy(&cleaner->first_err, &err);
+		}
+	}
+
+	if (cleaner->config.progress) {
+		progress->range = &range;
+		cleaner->config.progress(progress, cleaner->config.udata);
+		progress->range = NULL;
+	}
+
+	pthread_mutex_unlock(&cleaner->lock);
+}
+
+// Only the bins found expired here are passed to clean, and a record with
+// none is not written at all. Waits only while the apply queue is full.
+static bool
+expbin_clean_record(const as_val* val, void* udata)
+{
+	if (! val) {
+		return true;
+	}
+
+	expbin_clean_ctx* ctx = (expbin_clean_ctx*)udata;
+	expbin_cleaner* cleaner = ctx->cleaner;
+	as_record* rec = as_record_fromval(val);
+
+	if (! rec) {
+		return true;
+	}
+
+	__atomic_fetch_add(&ctx->range->scanned, 1, __ATOMIC_RELAXED);
+
+	int64_t now = as_expbin_now();
+	const char* expired[AS_EXPBIN_MAX_BINS];
+	uint32_t n_expired = 0;
+
+	for (uint32_t i = 0; i < cleaner->n_bins; i++) {
+		as_val* stored = (as_val*)as_record_get(rec, cleaner->bins[i]);
+		as_val* data;
+
+		if (stored &&
+				as_expbin_eval(stored, now, &data, NULL) == AS_EXPBIN_EXPIRED) {
+			expired[n_expired++] = cleaner->bins[i];
+		}
+	}
+
+	if (n_expired == 0) {
+		return true;
+	}
+
+	expbin_clean_job* job = malloc(sizeof(expbin_clean_job) +
+			n_expired * sizeof(const char*));
+
+	if (! job) {
+		__atomic_fetch_add(&ctx->failed, 1, __ATOMIC_RELAXED);
+		return true;
+	}
+
+	job->ctx = ctx;
+	as_key_init_digest(&job->key, rec->key.ns, rec->key.set,
+			rec->key.digest.value);
+	job->n_expired = n_expired;
+	memcpy(job->expired, expired, n_expired * sizeof(const char*));
+
+	if (cleaner->n_workers == 0) {
+		expbin_clean_apply(cleaner, job);
+		return true;
+	}
+
+	pthread_mutex_lock(&cleaner->queue_lock);
+
+	while (cleaner->queue_count == cleaner->queue_size) {
+		pthread_cond_wait(&cleaner->queue_space, &cleaner->queue_lock);
+	}
+
+	cleaner->queue[(cleaner->queue_head + cleaner->queue_count) %
+			cleaner->queue_size] = job;
+	cleaner->queue_count++;
+	ctx->pending++;
+	pthread_cond_signal(&cleaner->queue_ready);
+	pthread_mutex_unlock(&cleaner->queue_lock);
+
+	return true;
+}
+
+static void*
+expbin_clean_apply_worker(void* udata)
+{
+	expbin_cleaner* cleaner = (expbin_cleaner*)udata;
+
+	pthread_mutex_lock(&cleaner->queue_lock);
+
+	while (true) {
+		while (cleaner->queue_count == 0 && ! cleaner->closed) {
+			pthread_cond_wait(&cleaner->queue_ready, &cleaner->queue_lock);
+		}
+
+		if (cleaner->queue_count == 0) {
+			break;
+		}
+
+		expbin_clean_job* job = cleaner->queue[cleaner->queue_head];
+		expbin_clean_ctx* ctx = job->ctx;
+
+		cleaner->queue_head = (cleaner->queue_head + 1) % cleaner->queue_size;
+		cleaner->queue_count--;
+		pthread_cond_signal(&cleaner->queue_space);
+		pthread_mutex_unlock(&cleaner->queue_lock);
+
+		expbin_clean_apply(cleaner, job);
+
+		pthread_mutex_lock(&cleaner->queue_lock);
+
+		if (--ctx->pending == 0) {
+			pthread_cond_broadcast(&cleaner->jobs_done);
+		}
+	}
+
+	pthread_mutex_unlock(&cleaner->queue_lock);
+	return NULL;
+}
+
+// Frees the job.
+static void
+expbin_clean_apply(expbin_cleaner* cleaner, expbin_clean_job* job)
+{
+	expbin_clean_ctx* ctx = job->ctx;
+
+	expbin_clean_throttle(cleaner);
+
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, job->n_expired + 1);
+	expbin_append_names(&arglist, job->expired, job->n_expired);
+
+	if (cleaner->opts) {
+		as_arraylist_append(&arglist, as_val_reserve(cleaner->opts));
+	}
+
+	as_error err;
+	as_error_init(&err);
+
+	as_val* result = NULL;
+	as_status rc = expbin_apply(cleaner->eb, &err, cleaner->apply_policy,
+			&job->key, "clean", (as_list*)&arglist, &result);
+
+	as_arraylist_destroy(&arglist);
+
+	if (cleaner->eb->cache) {
+		for (uint32_t i = 0; i < job->n_expired; i++) {
+			expbin_cache_forget(cleaner->eb->cache, &job->key, job->expired[i]);
+		}
+	}
+
+	if (rc == AEROSPIKE_OK) {
+		rc = expbin_check_code(&err, "clean", result);
+	}
+
+	as_val_destroy(result);
+
+	if (rc == AEROSPIKE_OK) {
+		__atomic_fetch_add(&ctx->range->cleaned, 1, __ATOMIC_RELAXED);
+	}
+	else {
+		__atomic_fetch_add(&ctx->failed, 1, __ATOMIC_RELAXED);
+	}
+
+	as_key_destroy(&job->key);
+	free(job);
+}
+
+// Unused time is not banked, so a slow stretch is not followed by a burst.
+static void
+expbin_clean_throttle(expbin_cleaner* cleaner)
+{
+	if (cleaner->interval_ns == 0) {
+		return;
+	}
+
+	pthread_mutex_lock(&cleaner->limit_lock);
+
+	uint64_t now = expbin_clean_nanos();
+
+	if (cleaner->next_slot_ns < now) {
+		cleaner->next_slot_ns = now;
+	}
+
+	uint64_t wait = cleaner->next_slot_ns - now;
+
+	cleaner->next_slot_ns += cleaner->interval_ns;
+
+	pthread_mutex_unlock(&cleaner->limit_lock);
+
+	if (wait) {
+		struct timespec ts = {
+			.tv_sec = (time_t)(wait / 1000000000),
+			.tv_nsec = (long)(wait % 1000000000)
+		};
+
+		nanosleep(&ts, NULL);
+	}
+}
+
+static uint64_t
+expbin_clean_nanos(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
@@ -0,0 +1,142 @@
+/*******************************************************************************
+ * Copyright 2008-2015 by Aerospike.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ ******************************************************************************/
+
+
+
+//==========================================================
+// Includes
+//
+
+#include "as_expbin.h"
+
+#include <pthread.h>
+#include <time.h>
+
+
+//==========================================================
+// Constants
+//
+
+// Period of the clock thread. Its copy of the time lags by at most this.
+#define EXPBIN_CLOCK_TICK_MS 100
+
+
+//==========================================================
+// Forward Declarations
+//
+
+static void* expbin_clock_run(void* udata);
+static inline int64_t expbin_clock_read(void);
+
+
+//==========================================================
+// Globals
+//
+
+// The clock thread's copy of as_expbin_now(), 0 while it isn't running.
+static int64_t g_clock_now;
+static bool g_clock_stopping;
+
+// Guards starting and stopping the clock thread.
+static pthread_mutex_t g_clock_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t g_clock_users;
+static pthread_t g_clock_thread;
+
+
+//==========================================================
+// Public API
+//
+
+int64_t
+as_expbin_now(void)
+{
+	int64_t now = __atomic_load_n(&g_clock_now, __ATOMIC_RELAXED);
+
+	return now != 0 ? now : expbin_clock_read();
+}
+
+as_status
+as_expbin_clock_start(as_error* err)
+{
+	as_error_reset(err);
+
+	pthread_mutex_lock(&g_clock_lock);
+
+	if (g_clock_users == 0) {
+		__atomic_store_n(&g_clock_stopping, false, __ATOMIC_RELAXED);
+		__atomic_store_n(&g_clock_now, expbin_clock_read(), __ATOMIC_RELAXED);
+
+		if (pthread_create(&g_clock_thread, NULL, expbin_clock_run, NULL) != 0) {
+			__atomic_store_n(&g_clock_now, 0, __ATOMIC_RELAXED);
+			pthread_mutex_unlock(&g_clock_lock);
+			return as_error_update(err, AEROSPIKE_ERR_CLIENT,
+					"clock: thread failed to start");
+		}
+	}
+
+	g_clock_users++;
+	pthread_mutex_unlock(&g_clock_lock);
+
+	return AEROSPIKE_OK;
+}
+
+void
+as_expbin_clock_stop(void)
+{
+	pthread_mutex_lock(&g_clock_lock);
+
+	if (g_clock_users != 0 && --g_clock_users == 0) {
+		// The thread doesn't take the lock, so it can be joined under it.
+		__atomic_store_n(&g_clock_stopping, true, __ATOMIC_RELAXED);
+		pthread_join(g_clock_thread, NULL);
+		__atomic_store_n(&g_clock_now, 0, __ATOMIC_RELAXED);
+	}
+
+	pthread_mutex_unlock(&g_clock_lock);
+}
+
+
+//==========================================================
+// Local Helpers
+//
+
+static void*
+expbin_clock_run(void* udata)
+{
+	struct timespec tick = { 0, EXPBIN_CLOCK_TICK_MS * 1000000L };
+
+	while (! __atomic_load_n(&g_clock_stopping, __ATOMIC_RELAXED)) {
+		nanosleep(&tick, NULL);
+		__atomic_store_n(&g_clock_now, expbin_clock_read(), __ATOMIC_RELAXED);
+	}
+
+	return NULL;
+}
+
+static inline int64_t
+expbin_clock_read(void)
+{
+	// On Linux time() reads the kernel's coarse clock seconds through the
+	// vDSO, cheaper than clock_gettime(CLOCK_REALTIME_COARSE) and all the
+	// resolution expiry needs.
+	return (int64_t)time(NULL) - AS_EXPBIN_CITRUSLEAF_EPOCH;
+}
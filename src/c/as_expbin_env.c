@@ -0,0 +1,174 @@
+/*******************************************************************************
+ * Copyright 2008-2015 by Aerospike.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ ******************************************************************************/
+
+
+
+//==========================================================
+// Includes
+//
+
+#include "as_expbin.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <aerospike/as_bytes.h>
+#include <aerospike/as_integer.h>
+#include <aerospike/as_string.h>
+
+
+//==========================================================
+// Forward Declarations
+//
+
+static inline void expbin_put_be32(uint8_t* p, uint32_t v);
+static inline uint32_t expbin_get_be32(const uint8_t* p);
+static inline uint64_t expbin_get_be64(const uint8_t* p);
+
+
+//==========================================================
+// Public API
+//
+
+as_bytes*
+as_expbin_env_encode(as_bytes* env, uint8_t* buf, uint32_t capacity,
+		uint32_t expiry, as_bytes_type type, const uint8_t* payload,
+		uint32_t size)
+{
+	if (capacity < AS_EXPBIN_ENV_HEADER_SIZE ||
+			size > capacity - AS_EXPBIN_ENV_HEADER_SIZE) {
+		return NULL;
+	}
+
+	buf[0] = AS_EXPBIN_ENV_MAGIC0;
+	buf[1] = AS_EXPBIN_ENV_MAGIC1;
+	buf[2] = AS_EXPBIN_ENV_VERSION;
+	buf[3] = (uint8_t)type;
+	expbin_put_be32(buf + 4, expiry);
+
+	uint8_t* dst = buf + AS_EXPBIN_ENV_HEADER_SIZE;
+
+	if (payload != dst) {
+		memmove(dst, payload, size);
+	}
+
+	return as_bytes_init_wrap(env, buf, AS_EXPBIN_ENV_HEADER_SIZE + size,
+			false);
+}
+
+bool
+as_expbin_is_env(const as_val* stored)
+{
+	as_bytes* b = as_bytes_fromval(stored);
+
+	if (! b || as_bytes_size(b) < AS_EXPBIN_ENV_HEADER_SIZE) {
+		return false;
+	}
+
+	const uint8_t* p = as_bytes_get(b);
+
+	return p[0] == AS_EXPBIN_ENV_MAGIC0 && p[1] == AS_EXPBIN_ENV_MAGIC1 &&
+			p[2] == AS_EXPBIN_ENV_VERSION;
+}
+
+bool
+as_expbin_env_decode(const as_bytes* env, uint32_t* expiry,
+		as_bytes_type* type, as_bytes* payload)
+{
+	if (! as_expbin_is_env((const as_val*)env)) {
+		return false;
+	}
+
+	uint8_t* p = as_bytes_get(env);
+
+	*expiry = expbin_get_be32(p + 4);
+	*type = (as_bytes_type)p[3];
+	as_bytes_init_wrap(payload, p + AS_EXPBIN_ENV_HEADER_SIZE,
+			as_bytes_size(env) - AS_EXPBIN_ENV_HEADER_SIZE, false);
+
+	return true;
+}
+
+as_val*
+as_expbin_env_to_val(const as_bytes* env)
+{
+	uint32_t expiry;
+	as_bytes_type type;
+	as_bytes payload;
+
+	if (! as_expbin_env_decode(env, &expiry, &type, &payload)) {
+		return NULL;
+	}
+
+	uint32_t size = as_bytes_size(&payload);
+	const uint8_t* p = as_bytes_get(&payload);
+
+	if (type == AS_BYTES_INTEGER) {
+		if (size != sizeof(uint64_t)) {
+			return NULL;
+		}
+
+		return (as_val*)as_integer_new((int64_t)expbin_get_be64(p));
+	}
+
+	uint8_t* copy = malloc(size + 1);
+
+	if (! copy) {
+		return NULL;
+	}
+
+	memcpy(copy, p, size);
+
+	if (type == AS_BYTES_STRING) {
+		copy[size] = '\0';
+		return (as_val*)as_string_new_wlen((char*)copy, size, true);
+	}
+
+	return (as_val*)as_bytes_new_wrap(copy, size, true);
+}
+
+
+//==========================================================
+// Local Helpers
+//
+
+static inline void
+expbin_put_be32(uint8_t* p, uint32_t v)
+{
+	p[0] = (uint8_t)(v >> 24);
+	p[1] = (uint8_t)(v >> 16);
+	p[2] = (uint8_t)(v >> 8);
+	p[3] = (uint8_t)v;
+}
+
+static inline uint32_t
+expbin_get_be32(const uint8_t* p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+			((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static inline uint64_t
+expbin_get_be64(const uint8_t* p)
+{
+	return ((uint64_t)expbin_get_be32(p) << 32) | expbin_get_be32(p + 4);
+}
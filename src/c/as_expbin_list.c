@@ -0,0 +1,200 @@
+/*******************************************************************************
+ * Copyright 2008-2015 by Aerospike.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ ******************************************************************************/
+
+
+
+//==========================================================
+// Includes
+//
+
+#include "as_expbin.h"
+#include "expbin_internal.h"
+
+#include <aerospike/aerospike_key.h>
+#include <aerospike/as_arraylist.h>
+#include <aerospike/as_hashmap.h>
+#include <aerospike/as_integer.h>
+#include <aerospike/as_record.h>
+#include <aerospike/as_string.h>
+#include <aerospike/as_stringmap.h>
+
+
+//==========================================================
+// Forward Declarations
+//
+
+static as_status expbin_lget_native(as_expbin* eb, as_error* err, const as_policy_apply* policy, const as_key* key, const char* bin, as_list** result);
+static as_status expbin_lwrite(as_expbin* eb, as_error* err, const as_policy_apply* policy, const as_key* key, const char* fn, const char* bin, int64_t index, as_list* entries);
+
+
+//==========================================================
+// Public API
+//
+
+as_status
+as_expbin_lget(as_expbin* eb, as_error* err, const as_policy_apply* policy,
+		const as_key* key, const char* bin, as_list** result)
+{
+	if (eb->read_mode == AS_EXPBIN_READ_NATIVE) {
+		return expbin_lget_native(eb, err, policy, key, bin, result);
+	}
+
+	as_string bin_str;
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 1);
+	as_arraylist_append(&arglist,
+			(as_val*)as_string_init(&bin_str, (char*)bin, false));
+
+	as_val* val = NULL;
+	as_status rc = expbin_apply(eb, err, policy, key, "lget",
+			(as_list*)&arglist, &val);
+
+	as_arraylist_destroy(&arglist);
+
+	if (rc != AEROSPIKE_OK) {
+		return rc;
+	}
+
+	if (! as_list_fromval(val)) {
+		// The module answers 1 instead of a list when the record is missing.
+		as_val_destroy(val);
+		return as_error_update(err, AEROSPIKE_ERR_RECORD_NOT_FOUND,
+				"lget: record not found");
+	}
+
+	*result = (as_list*)val;
+	return AEROSPIKE_OK;
+}
+
+as_status
+as_expbin_lappend(as_expbin* eb, as_error* err, const as_policy_apply* policy,
+		const as_key* key, const char* bin, as_list* entries)
+{
+	return expbin_lwrite(eb, err, policy, key, "lappend", bin, -1, entries);
+}
+
+as_status
+as_expbin_linsert(as_expbin* eb, as_error* err, const as_policy_apply* policy,
+		const as_key* key, const char* bin, uint32_t index, as_list* entries)
+{
+	// The module counts from 1.
+	return expbin_lwrite(eb, err, policy, key, "linsert", bin,
+			(int64_t)index + 1, entries);
+}
+
+as_map*
+as_expbin_elem_new(as_val* val, int64_t bin_ttl)
+{
+	as_hashmap* map = as_hashmap_new(2);
+	as_stringmap_set((as_map*)map, "val", val);
+	as_stringmap_set_int64((as_map*)map, "bin_ttl", bin_ttl);
+
+	return (as_map*)map;
+}
+
+
+//==========================================================
+// Local Helpers
+//
+
+static as_status
+expbin_lget_native(as_expbin* eb, as_error* err, const as_policy_apply* policy,
+		const as_key* key, const char* bin, as_list** result)
+{
+	as_policy_read read;
+	expbin_read_policy(&read, policy);
+
+	const char* bins[] = { bin, NULL };
+	as_record* rec = NULL;
+	as_status rc = expbin_select(eb, err, &read, key, bins, &rec);
+
+	if (rc != AEROSPIKE_OK) {
+		return rc;
+	}
+
+	int64_t now = as_expbin_now();
+	as_list* stored = as_record_get_list(rec, bin);
+	uint32_t size = stored ? as_list_size(stored) : 0;
+	as_arraylist* list = as_arraylist_new(size == 0 ? 1 : size, 0);
+
+	// Mirrors lget() in expire_bin.lua.
+	for (uint32_t i = 0; i < size; i++) {
+		as_val* val = expbin_field_eval(as_list_get(stored, i), now, NULL);
+
+		if (val) {
+			as_arraylist_append(list, as_val_reserve(val));
+		}
+	}
+
+	as_record_destroy(rec);
+
+	*result = (as_list*)list;
+	return AEROSPIKE_OK;
+}
+
+// A negative index appends.
+static as_status
+expbin_lwrite(as_expbin* eb, as_error* err, const as_policy_apply* policy,
+		const as_key* key, const char* fn, const char* bin, int64_t index,
+		as_list* entries)
+{
+	uint32_t n_entries = as_list_size(entries);
+
+	as_string bin_str;
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, n_entries + 3);
+	as_arraylist_append(&arglist,
+			(as_val*)as_string_init(&bin_str, (char*)bin, false));
+
+	if (index >= 0) {
+		as_arraylist_append_int64(&arglist, index);
+	}
+
+	for (uint32_t i = 0; i < n_entries; i++) {
+		as_arraylist_append(&arglist, as_val_reserve(as_list_get(entries, i)));
+	}
+
+	as_map* opts = expbin_opts_new(eb, AS_EXPBIN_WRITE_DEFAULT,
+			expbin_write_ttl(eb, policy));
+
+	if (opts) {
+		as_arraylist_append_map(&arglist, opts);
+	}
+
+	as_val* result = NULL;
+	as_status rc = expbin_apply(eb, err, policy, key, fn, (as_list*)&arglist,
+			&result);
+
+	as_arraylist_destroy(&arglist);
+
+	if (eb->cache) {
+		expbin_cache_forget(eb->cache, key, bin);
+	}
+
+	if (rc != AEROSPIKE_OK) {
+		return rc;
+	}
+
+	rc = expbin_check_code(err, fn, result);
+	as_val_destroy(result);
+	return rc;
+}
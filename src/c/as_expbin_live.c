@@ -0,0 +1,249 @@
+/*******************************************************************************
+ * Copyright 2008-2015 by Aerospike.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ ******************************************************************************/
+
+
+
+
+//==========================================================
+// Includes
+//
+
+#include "as_expbin_live.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define EXPBIN_LIVE_X86
+#include <immintrin.h>
+#endif
+
+
+//==========================================================
+// Typedefs
+//
+
+typedef uint32_t (*expbin_live_fn)(const uint32_t* expiry, uint32_t n, uint32_t now, uint64_t* mask);
+
+
+//==========================================================
+// Forward Declarations
+//
+
+static uint32_t live_mask_scalar(const uint32_t* expiry, uint32_t n, uint32_t now, uint64_t* mask);
+static inline uint64_t live_word(const uint32_t* expiry, uint32_t n, uint32_t now);
+static expbin_live_fn live_fn(as_expbin_isa isa);
+
+#ifdef EXPBIN_LIVE_X86
+static uint32_t live_mask_sse42(const uint32_t* expiry, uint32_t n, uint32_t now, uint64_t* mask);
+static uint32_t live_mask_avx2(const uint32_t* expiry, uint32_t n, uint32_t now, uint64_t* mask);
+#endif
+
+
+//==========================================================
+// Globals
+//
+
+// Resolved on first use. Racing threads store the same value.
+static expbin_live_fn g_live_fn;
+
+
+//==========================================================
+// Public API
+//
+
+uint32_t
+as_expbin_live_mask(const uint32_t* expiry, uint32_t n, uint32_t now,
+		uint64_t* mask)
+{
+	expbin_live_fn fn = __atomic_load_n(&g_live_fn, __ATOMIC_RELAXED);
+
+	if (! fn) {
+		fn = live_fn(as_expbin_live_isa());
+		__atomic_store_n(&g_live_fn, fn, __ATOMIC_RELAXED);
+	}
+
+	return fn(expiry, n, now, mask);
+}
+
+as_expbin_isa
+as_expbin_live_isa(void)
+{
+#ifdef EXPBIN_LIVE_X86
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2")) {
+		return AS_EXPBIN_ISA_AVX2;
+	}
+
+	if (__builtin_cpu_supports("sse4.2")) {
+		return AS_EXPBIN_ISA_SSE42;
+	}
+#endif
+
+	return AS_EXPBIN_ISA_SCALAR;
+}
+
+uint32_t
+as_expbin_live_mask_isa(as_expbin_isa isa, const uint32_t* expiry, uint32_t n,
+		uint32_t now, uint64_t* mask)
+{
+	return live_fn(isa)(expiry, n, now, mask);
+}
+
+
+//==========================================================
+// Local Helpers
+//
+
+static expbin_live_fn
+live_fn(as_expbin_isa isa)
+{
+	switch (isa) {
+#ifdef EXPBIN_LIVE_X86
+	case AS_EXPBIN_ISA_AVX2:
+		return live_mask_avx2;
+	case AS_EXPBIN_ISA_SSE42:
+		return live_mask_sse42;
+#endif
+	default:
+		return live_mask_scalar;
+	}
+}
+
+// Up to 64 expiry times, branch free.
+static inline uint64_t
+live_word(const uint32_t* expiry, uint32_t n, uint32_t now)
+{
+	uint64_t word = 0;
+
+	for (uint32_t i = 0; i < n; i++) {
+		uint32_t e = expiry[i];
+
+		word |= (uint64_t)((e == 0) | (now <= e)) << i;
+	}
+
+	return word;
+}
+
+static uint32_t
+live_mask_scalar(const uint32_t* expiry, uint32_t n, uint32_t now,
+		uint64_t* mask)
+{
+	uint32_t full = n & ~63u;
+	uint32_t live = 0;
+
+	// Whole words first, with a constant trip count the compiler can unroll.
+	for (uint32_t i = 0; i < full; i += 64) {
+		uint64_t word = live_word(expiry + i, 64, now);
+
+		mask[i / 64] = word;
+		live += (uint32_t)__builtin_popcountll(word);
+	}
+
+	if (full < n) {
+		uint64_t word = live_word(expiry + full, n - full, now);
+
+		mask[full / 64] = word;
+		live += (uint32_t)__builtin_popcountll(word);
+	}
+
+	return live;
+}
+
+#ifdef EXPBIN_LIVE_X86
+
+// There is no unsigned compare before AVX-512, so now <= e is tested as
+// max(e, now) == e. Each pass builds one mask word from 64 expiry times, the
+// remainder goes through live_word().
+
+__attribute__((target("sse4.2,popcnt")))
+static uint32_t
+live_mask_sse42(const uint32_t* expiry, uint32_t n, uint32_t now,
+		uint64_t* mask)
+{
+	const __m128i vnow = _mm_set1_epi32((int)now);
+	const __m128i zero = _mm_setzero_si128();
+	uint32_t full = n & ~63u;
+	uint32_t live = 0;
+
+	for (uint32_t i = 0; i < full; i += 64) {
+		uint64_t word = 0;
+
+		for (uint32_t j = 0; j < 64; j += 4) {
+			__m128i e = _mm_loadu_si128((const __m128i*)(expiry + i + j));
+			__m128i ok = _mm_or_si128(
+					_mm_cmpeq_epi32(_mm_max_epu32(e, vnow), e),
+					_mm_cmpeq_epi32(e, zero));
+
+			word |= (uint64_t)_mm_movemask_ps(_mm_castsi128_ps(ok)) << j;
+		}
+
+		mask[i / 64] = word;
+		live += (uint32_t)__builtin_popcountll(word);
+	}
+
+	if (full < n) {
+		uint64_t word = live_word(expiry + full, n - full, now);
+
+		mask[full / 64] = word;
+		live += (uint32_t)__builtin_popcountll(word);
+	}
+
+	return live;
+}
+
+__attribute__((target("avx2,popcnt")))
+static uint32_t
+live_mask_avx2(const uint32_t* expiry, uint32_t n, uint32_t now,
+		uint64_t* mask)
+{
+	const __m256i vnow = _mm256_set1_epi32((int)now);
+	const __m256i zero = _mm256_setzero_si256();
+	uint32_t full = n & ~63u;
+	uint32_t live = 0;
+
+	for (uint32_t i = 0; i < full; i += 64) {
+		uint64_t word = 0;
+
+		for (uint32_t j = 0; j < 64; j += 8) {
+			__m256i e = _mm256_loadu_si256((const __m256i*)(expiry + i + j));
+			__m256i ok = _mm256_or_si256(
+					_mm256_cmpeq_epi32(_mm256_max_epu32(e, vnow), e),
+					_mm256_cmpeq_epi32(e, zero));
+
+			word |= (uint64_t)(uint32_t)_mm256_movemask_ps(
+					_mm256_castsi256_ps(ok)) << j;
+		}
+
+		mask[i / 64] = word;
+		live += (uint32_t)__builtin_popcountll(word);
+	}
+
+	if (full < n) {
+		uint64_t word = live_word(expiry + full, n - full, now);
+
+		mask[full / 64] = word;
+		live += (uint32_t)__builtin_popcountll(word);
+	}
+
+	return live;
+}
+
+#endif
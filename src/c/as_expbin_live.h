@@ -0,0 +1,81 @@
+/*******************************************************************************
+ * Copyright 2008-2015 by Aerospike.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ ******************************************************************************/
+
+
+#pragma once
+
+//==========================================================
+// Includes
+//
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//==========================================================
+// Typedefs
+//
+
+/*
+ * Instruction set of an as_expbin_live_mask() implementation.
+ */
+typedef enum as_expbin_isa_e {
+	AS_EXPBIN_ISA_SCALAR,
+	AS_EXPBIN_ISA_SSE42,
+	AS_EXPBIN_ISA_AVX2
+} as_expbin_isa;
+
+//==========================================================
+// Public API
+//
+
+/*
+ * Evaluate many stored expiry times at once. Bit i of the mask is set if
+ * expiry[i] is live, i.e. 0 (never expires) or not before now, the module's
+ * not_expired() check. Uses the widest instruction set the CPU supports,
+ * picked on first use.
+ *
+ * \param expiry - Expiry times, e.g. from as_expbin_eval() or compact
+ *                 envelope headers. No alignment needed.
+ * \param n      - Number of expiry times.
+ * \param now    - Current time, e.g. as_expbin_now().
+ * \param mask   - (n + 63) / 64 words. Bits past n are cleared.
+ * \return       - Number of live expiry times.
+ */
+uint32_t as_expbin_live_mask(const uint32_t* expiry, uint32_t n, uint32_t now, uint64_t* mask);
+
+/*
+ * The instruction set as_expbin_live_mask() uses on this CPU.
+ */
+as_expbin_isa as_expbin_live_isa(void);
+
+/*
+ * as_expbin_live_mask() with a given instruction set, for benchmarks. The
+ * CPU must support it, see as_expbin_live_isa().
+ */
+uint32_t as_expbin_live_mask_isa(as_expbin_isa isa, const uint32_t* expiry, uint32_t n, uint32_t now, uint64_t* mask);
+
+#ifdef __cplusplus
+} // end extern "C"
+#endif
@@ -0,0 +1,356 @@
+/*******************************************************************************
+ * Copyright 2008-2015 by Aerospike.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ ******************************************************************************/
+
+
+
+//==========================================================
+// Includes
+//
+
+#include "as_expbin.h"
+#include "expbin_internal.h"
+
+#include <aerospike/aerospike_key.h>
+#include <aerospike/as_arraylist.h>
+#include <aerospike/as_hashmap.h>
+#include <aerospike/as_integer.h>
+#include <aerospike/as_record.h>
+#include <aerospike/as_string.h>
+#include <aerospike/as_stringmap.h>
+
+
+//==========================================================
+// Typedefs
+//
+
+typedef struct expbin_collect_s {
+	as_map* result;
+	int64_t now;
+} expbin_collect;
+
+
+//==========================================================
+// Forward Declarations
+//
+
+static as_status expbin_mget_native(as_expbin* eb, as_error* err, const as_policy_apply* policy, const as_key* key, const char* bin, const char* fields[], uint32_t n_fields, as_map** result);
+static as_status expbin_mttl_native(as_expbin* eb, as_error* err, const as_policy_apply* policy, const as_key* key, const char* bin, const char* field, int64_t* ttl);
+static as_status expbin_mwrite(as_expbin* eb, as_error* err, const as_policy_apply* policy, const as_key* key, const char* fn, const char* bin, as_list* entries);
+static bool expbin_collect_live(const as_val* key, const as_val* val, void* udata);
+
+
+//==========================================================
+// Public API
+//
+
+as_status
+as_expbin_mget(as_expbin* eb, as_error* err, const as_policy_apply* policy,
+		const as_key* key, const char* bin, const char* fields[],
+		as_map** result)
+{
+	uint32_t n_fields;
+
+	if (expbin_count_bins(err, fields, &n_fields) != AEROSPIKE_OK) {
+		return err->code;
+	}
+
+	if (eb->read_mode == AS_EXPBIN_READ_NATIVE) {
+		return expbin_mget_native(eb, err, policy, key, bin, fields, n_fields,
+				result);
+	}
+
+	as_string bin_str;
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, n_fields + 1);
+	as_arraylist_append(&arglist,
+			(as_val*)as_string_init(&bin_str, (char*)bin, false));
+	expbin_append_names(&arglist, fields, n_fields);
+
+	as_val* val = NULL;
+	as_status rc = expbin_apply(eb, err, policy, key, "mget",
+			(as_list*)&arglist, &val);
+
+	as_arraylist_destroy(&arglist);
+
+	if (rc != AEROSPIKE_OK) {
+		return rc;
+	}
+
+	rc = expbin_check_map(err, val);
+
+	if (rc != AEROSPIKE_OK) {
+		as_val_destroy(val);
+		return rc;
+	}
+
+	*result = (as_map*)val;
+	return AEROSPIKE_OK;
+}
+
+as_status
+as_expbin_mput(as_expbin* eb, as_error* err, const as_policy_apply* policy,
+		const as_key* key, const char* bin, as_list* entries)
+{
+	return expbin_mwrite(eb, err, policy, key, "mput", bin, entries);
+}
+
+as_status
+as_expbin_mtouch(as_expbin* eb, as_error* err, const as_policy_apply* policy,
+		const as_key* key, const char* bin, as_list* entries)
+{
+	return expbin_mwrite(eb, err, policy, key, "mtouch", bin, entries);
+}
+
+as_status
+as_expbin_mttl(as_expbin* eb, as_error* err, const as_policy_apply* policy,
+		const as_key* key, const char* bin, const char* field, int64_t* ttl)
+{
+	if (eb->read_mode == AS_EXPBIN_READ_NATIVE) {
+		return expbin_mttl_native(eb, err, policy, key, bin, field, ttl);
+	}
+
+	as_string bin_str;
+	as_string field_str;
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, 2);
+	as_arraylist_append(&arglist,
+			(as_val*)as_string_init(&bin_str, (char*)bin, false));
+	as_arraylist_append(&arglist,
+			(as_val*)as_string_init(&field_str, (char*)field, false));
+
+	as_val* result = NULL;
+	as_status rc = expbin_apply(eb, err, policy, key, "mttl",
+			(as_list*)&arglist, &result);
+
+	as_arraylist_destroy(&arglist);
+
+	if (rc != AEROSPIKE_OK) {
+		return rc;
+	}
+
+	rc = expbin_check_ttl(err, field, result, ttl);
+	as_val_destroy(result);
+	return rc;
+}
+
+as_status
+as_expbin_mclean(as_expbin* eb, as_error* err, const as_policy_scan* policy,
+		const char* bins[])
+{
+	as_status rc = expbin_scan_apply(eb, err, policy, "mclean", bins, NULL);
+
+	if (eb->cache) {
+		as_expbin_cache_clear(eb->cache);
+	}
+
+	return rc;
+}
+
+as_map*
+as_expbin_field_new(const char* field, as_val* val, int64_t bin_ttl)
+{
+	as_hashmap* map = as_hashmap_new(3);
+	as_stringmap_set_str((as_map*)map, "field", field);
+
+	if (val) {
+		as_stringmap_set((as_map*)map, "val", val);
+	}
+
+	as_stringmap_set_int64((as_map*)map, "bin_ttl", bin_ttl);
+
+	return (as_map*)map;
+}
+
+
+//==========================================================
+// Internal API
+//
+
+// Mirrors field_live() in expire_bin.lua.
+as_val*
+expbin_field_eval(const as_val* entry, int64_t now, int64_t* expiry)
+{
+	as_list* list = as_list_fromval((as_val*)entry);
+
+	if (! list || as_list_size(list) < 2) {
+		return NULL;
+	}
+
+	as_integer* i = as_integer_fromval(as_list_get(list, 0));
+
+	if (! i) {
+		return NULL;
+	}
+
+	int64_t exp = as_integer_get(i);
+
+	if (exp != 0 && now > exp) {
+		return NULL;
+	}
+
+	if (expiry) {
+		*expiry = exp;
+	}
+
+	as_val* val = as_list_get(list, 1);
+
+	return as_val_type(val) == AS_NIL ? NULL : val;
+}
+
+
+//==========================================================
+// Local Helpers
+//
+
+static as_status
+expbin_mget_native(as_expbin* eb, as_error* err, const as_policy_apply* policy,
+		const as_key* key, const char* bin, const char* fields[],
+		uint32_t n_fields, as_map** result)
+{
+	as_policy_read read;
+	expbin_read_policy(&read, policy);
+
+	const char* bins[] = { bin, NULL };
+	as_record* rec = NULL;
+	as_status rc = expbin_select(eb, err, &read, key, bins, &rec);
+
+	if (rc != AEROSPIKE_OK) {
+		return rc;
+	}
+
+	expbin_collect collect = {
+		.result = (as_map*)as_hashmap_new(n_fields == 0 ? 32 : n_fields),
+		.now = as_expbin_now()
+	};
+
+	as_map* stored = as_record_get_map(rec, bin);
+
+	if (stored && n_fields == 0) {
+		as_map_foreach(stored, expbin_collect_live, &collect);
+	}
+	else if (stored) {
+		for (uint32_t i = 0; i < n_fields; i++) {
+			as_val* val = expbin_field_eval(
+					as_stringmap_get(stored, fields[i]), collect.now, NULL);
+
+			if (val) {
+				as_stringmap_set(collect.result, fields[i],
+						as_val_reserve(val));
+			}
+		}
+	}
+
+	as_record_destroy(rec);
+
+	*result = collect.result;
+	return AEROSPIKE_OK;
+}
+
+static as_status
+expbin_mttl_native(as_expbin* eb, as_error* err, const as_policy_apply* policy,
+		const as_key* key, const char* bin, const char* field, int64_t* ttl)
+{
+	as_policy_read read;
+	expbin_read_policy(&read, policy);
+
+	const char* bins[] = { bin, NULL };
+	as_record* rec = NULL;
+	as_status rc = expbin_select(eb, err, &read, key, bins, &rec);
+
+	if (rc != AEROSPIKE_OK && rc != AEROSPIKE_ERR_RECORD_NOT_FOUND) {
+		return rc;
+	}
+
+	int64_t now = as_expbin_now();
+	int64_t expiry;
+	as_map* stored = rec ? as_record_get_map(rec, bin) : NULL;
+	as_val* val = stored ?
+			expbin_field_eval(as_stringmap_get(stored, field), now, &expiry) :
+			NULL;
+
+	if (rec) {
+		as_record_destroy(rec);
+	}
+
+	if (! val) {
+		return as_error_update(err, AEROSPIKE_ERR_BIN_NOT_FOUND,
+				"mttl: field %s has no ttl", field);
+	}
+
+	*ttl = expiry == 0 ? AS_EXPBIN_TTL_NEVER : expiry - now;
+	return AEROSPIKE_OK;
+}
+
+static as_status
+expbin_mwrite(as_expbin* eb, as_error* err, const as_policy_apply* policy,
+		const as_key* key, const char* fn, const char* bin, as_list* entries)
+{
+	uint32_t n_entries = as_list_size(entries);
+
+	as_string bin_str;
+	as_arraylist arglist;
+	as_arraylist_inita(&arglist, n_entries + 2);
+	as_arraylist_append(&arglist,
+			(as_val*)as_string_init(&bin_str, (char*)bin, false));
+
+	for (uint32_t i = 0; i < n_entries; i++) {
+		as_arraylist_append(&arglist, as_val_reserve(as_list_get(entries, i)));
+	}
+
+	as_map* opts = expbin_opts_new(eb, AS_EXPBIN_WRITE_DEFAULT,
+			expbin_write_ttl(eb, policy));
+
+	if (opts) {
+		as_arraylist_append_map(&arglist, opts);
+	}
+
+	as_val* result = NULL;
+	as_status rc = expbin_apply(eb, err, policy, key, fn, (as_list*)&arglist,
+			&result);
+
+	as_arraylist_destroy(&arglist);
+
+	if (eb->cache) {
+		expbin_cache_forget(eb->cache, key, bin);
+	}
+
+	if (rc != AEROSPIKE_OK) {
+		return rc;
+	}
+
+	rc = expbin_check_code(err, fn, result);
+	as_val_destroy(result);
+	return rc;
+}
+
+static bool
+expbin_collect_live(const as_val* key, const as_val* val, void* udata)
+{
+	expbin_collect* collect = (expbin_collect*)udata;
+	as_val* live = expbin_field_eval(val, collect->now, NULL);
+
+	if (live) {
+		as_map_set(collect->result, as_val_reserve(key), as_val_reserve(live));
+	}
+
+	return true;
+}
@@ -0,0 +1,582 @@
+/*******************************************************************************
+ * Copyright 2008-2015 by Aerospike.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ ******************************************************************************/
+
+
+
+//==========================================================
+// Includes
+//
+
+#include "as_expbin.h"
+#include "expbin_internal.h"
+
+#include <string.h>
+
+#include <aerospike/aerospike_batch.h>
+#include <aerospike/aerospike_key.h>
+#include <aerospike/as_batch.h>
+#include <aerospike/as_bit_operations.h>
+#include <aerospike/as_exp.h>
+#include <aerospike/as_hashmap.h>
+#include <aerospike/as_integer.h>
+#include <aerospike/as_map_operations.h>
+#include <aerospike/as_operations.h>
+#include <aerospike/as_record.h>
+#include <aerospike/as_string.h>
+#include <aerospike/as_stringmap.h>
+
+
+//==========================================================
+// Typedefs
+//
+
+typedef struct expbin_touch_entry_s {
+	const char* bin;
+	int64_t bin_ttl;
+
+	// 0 for never.
+	int64_t expiry;
+} expbin_touch_entry;
+
+typedef struct expbin_many_s {
+	as_map** results;
+	const char** bins;
+	uint32_t n_bins;
+	int64_t now;
+} expbin_many;
+
+
+//==========================================================
+// Forward Declarations
+//
+
+static as_map* expbin_live_map(const as_record* rec, const char* bins[], uint32_t n_bins, int64_t now);
+static bool expbin_many_cb(const as_batch_read* reads, uint32_t n, void* udata);
+static bool expbin_touch_entry_get(as_list* entries, uint32_t i, expbin_touch_entry* touch);
+static as_status expbin_touch_op(as_expbin* eb, as_error* err, const as_policy_operate* policy, const as_key* key, const expbin_touch_entry* touches, uint32_t n_touches);
+static void expbin_apply_policy(as_policy_apply* apply, const as_policy_operate* policy);
+
+
+//==========================================================
+// Public API
+//
+
+// Mirrors is_expbin(), not_expired() and get_bin() in expire_bin.lua.
+as_expbin_state
+as_expbin_eval(const as_val* stored, int64_t now, as_val** data,
+		int64_t* expiry)
+{
+	uint32_t env_exp;
+	as_bytes_type type;
+	as_bytes payload;
+	as_bytes* env = as_bytes_fromval(stored);
+
+	if (env && as_expbin_env_decode(env, &env_exp, &type, &payload)) {
+		if (expiry) {
+			*expiry = env_exp;
+		}
+
+		if (env_exp != 0 && now > env_exp) {
+			*data = NULL;
+			return AS_EXPBIN_EXPIRED;
+		}
+
+		*data = (as_val*)stored;
+		return AS_EXPBIN_LIVE;
+	}
+
+	as_map* map = as_map_fromval(stored);
+	as_val* exp_id = map ? as_stringmap_get(map, AS_EXPBIN_EXP_ID) : NULL;
+
+	if (! exp_id || as_val_type(exp_id) == AS_NIL) {
+		*data = (as_val*)stored;
+		return AS_EXPBIN_PLAIN;
+	}
+
+	as_integer* i = as_integer_fromval(exp_id);
+	int64_t exp = i ? as_integer_get(i) : -1;
+
+	if (expiry) {
+		*expiry = exp;
+	}
+
+	if (! i || (exp != 0 && now > exp)) {
+		*data = NULL;
+		return AS_EXPBIN_EXPIRED;
+	}
+
+	as_val* val = as_stringmap_get(map, AS_EXPBIN_DATA);
+
+	*data = as_val_type(val) == AS_NIL ? NULL : val;
+	return AS_EXPBIN_LIVE;
+}
+
+as_status
+as_expbin_get_many(as_expbin* eb, as_error* err, const as_policy_batch* policy,
+		const as_batch* batch, const char* bins[], as_map* results[])
+{
+	as_error_reset(err);
+
+	uint32_t n_bins;
+
+	if (expbin_count_bins(err, bins, &n_bins) != AEROSPIKE_OK) {
+		return err->code;
+	}
+
+	uint32_t n_keys = batch->keys.size;
+
+	memset(results, 0, n_keys * sizeof(as_map*));
+
+	if (n_keys == 0) {
+		return AEROSPIKE_OK;
+	}
+
+	expbin_many many = {
+		.results = results,
+		.bins = bins,
+		.n_bins = n_bins,
+		.now = as_expbin_now()
+	};
+
+	if (! eb->transport) {
+		if (aerospike_batch_get_bins(eb->as, err, policy, batch, bins, n_bins,
+				expbin_many_cb, &many) == AEROSPIKE_OK) {
+			return AEROSPIKE_OK;
+		}
+	}
+	else {
+		// Transports only read single records.
+		as_policy_read read;
+		as_policy_read_init(&read);
+
+		if (policy) {
+			read.base = policy->base;
+		}
+
+		for (uint32_t i = 0; i < n_keys; i++) {
+			as_record* rec = NULL;
+			as_status rc = expbin_select(eb, err, &read,
+					as_batch_keyat(batch, i), bins, &rec);
+
+			if (rc == AEROSPIKE_ERR_RECORD_NOT_FOUND) {
+				as_error_reset(err);
+				continue;
+			}
+
+			if (rc != AEROSPIKE_OK) {
+				break;
+			}
+
+			results[i] = expbin_live_map(rec, bins, n_bins, many.now);
+			as_record_destroy(rec);
+		}
+
+		if (err->code == AEROSPIKE_OK) {
+			return AEROSPIKE_OK;
+		}
+	}
+
+	for (uint32_t i = 0; i < n_keys; i++) {
+		if (results[i]) {
+			as_map_destroy(results[i]);
+			results[i] = NULL;
+		}
+	}
+
+	return err->code;
+}
+
+as_status
+as_expbin_touch_native(as_expbin* eb, as_error* err,
+		const as_policy_operate* policy, const as_key* key, as_list* entries,
+		uint32_t flags)
+{
+	as_error_reset(err);
+
+	uint32_t n_entries = as_list_size(entries);
+	expbin_touch_entry touches[AS_EXPBIN_NATIVE_TOUCH_MAX];
+
+	// Shadow bins and a raised record TTL need the module, and so do more
+	// entries than the filter covers or any it can't read.
+	bool native = ! eb->transport && eb->shadow_prefix[0] == '\0' &&
+			(flags & AS_EXPBIN_WRITE_EXTEND_TTL) == 0 &&
+			n_entries != 0 && n_entries <= AS_EXPBIN_NATIVE_TOUCH_MAX;
+
+	for (uint32_t i = 0; native && i < n_entries; i++) {
+		native = expbin_touch_entry_get(entries, i, &touches[i]);
+	}
+
+	as_status rc = AEROSPIKE_FILTERED_OUT;
+
+	if (native) {
+		rc = expbin_touch_op(eb, err, policy, key, touches, n_entries);
+	}
+
+	if (rc == AEROSPIKE_FILTERED_OUT ||
+			rc == AEROSPIKE_ERR_BIN_INCOMPATIBLE_TYPE ||
+			rc == AEROSPIKE_ERR_FAIL_ELEMENT_NOT_FOUND) {
+		// Not all in the handle's format, not all expire bins, or a bin TTL
+		// the record TTL rejects - the module sorts it out as touch does.
+		as_error_reset(err);
+
+		as_policy_apply apply;
+		expbin_apply_policy(&apply, policy);
+
+		// Forgets the entries itself.
+		return as_expbin_touch_flags(eb, err, &apply, key, entries, flags);
+	}
+
+	if (eb->cache) {
+		expbin_cache_forget_entries(eb->cache, key, entries);
+	}
+
+	return rc;
+}
+
+
+//==========================================================
+// Internal API
+//
+
+as_status
+expbin_get_native(as_expbin* eb, as_error* err, const as_policy_apply* policy,
+		const as_key* key, const char* bins[], uint32_t n_bins,
+		as_map** result)
+{
+	as_policy_read read;
+	expbin_read_policy(&read, policy);
+
+	as_record* rec = NULL;
+	as_status rc = expbin_select(eb, err, &read, key, bins, &rec);
+
+	if (rc != AEROSPIKE_OK) {
+		return rc;
+	}
+
+	*result = expbin_live_map(rec, bins, n_bins, as_expbin_now());
+
+	as_record_destroy(rec);
+	return AEROSPIKE_OK;
+}
+
+as_status
+expbin_ttl_native(as_expbin* eb, as_error* err, const as_policy_apply* policy,
+		const as_key* key, const char* bin, int64_t* ttl)
+{
+	as_policy_read read;
+	expbin_read_policy(&read, policy);
+
+	const char* bins[] = { bin, NULL };
+	as_record* rec = NULL;
+	as_status rc = expbin_select(eb, err, &read, key, bins, &rec);
+
+	if (rc == AEROSPIKE_ERR_RECORD_NOT_FOUND) {
+		// The module answers nil for a missing record too.
+		return as_error_update(err, AEROSPIKE_ERR_BIN_NOT_FOUND,
+				"ttl: bin %s has no ttl", bin);
+	}
+
+	if (rc != AEROSPIKE_OK) {
+		return rc;
+	}
+
+	int64_t now = as_expbin_now();
+	as_val* data;
+	int64_t expiry;
+	as_val* stored = (as_val*)as_record_get(rec, bin);
+
+	if (! stored ||
+			as_expbin_eval(stored, now, &data, &expiry) != AS_EXPBIN_LIVE) {
+		as_record_destroy(rec);
+		return as_error_update(err, AEROSPIKE_ERR_BIN_NOT_FOUND,
+				"ttl: bin %s has no ttl", bin);
+	}
+
+	*ttl = expiry == 0 ? AS_EXPBIN_TTL_NEVER : expiry - now;
+
+	as_record_destroy(rec);
+	return AEROSPIKE_OK;
+}
+
+as_val*
+expbin_live_val(const as_val* stored, int64_t now)
+{
+	as_val* data;
+
+	as_expbin_eval(stored, now, &data, NULL);
+
+	if (! data || as_val_type(data) == AS_NIL) {
+		return NULL;
+	}
+
+	if (as_expbin_is_env(data)) {
+		return as_expbin_env_to_val((as_bytes*)data);
+	}
+
+	return as_val_reserve(data);
+}
+
+void
+expbin_read_policy(as_policy_read* read, const as_policy_apply* policy)
+{
+	as_policy_read_init(read);
+
+	if (policy) {
+		read->base = policy->base;
+		read->key = policy->key;
+	}
+}
+
+
+//==========================================================
+// Local Helpers
+//
+
+// Map of the live values of bins in rec, as get answers it.
+static as_map*
+expbin_live_map(const as_record* rec, const char* bins[], uint32_t n_bins,
+		int64_t now)
+{
+	as_hashmap* map = as_hashmap_new(n_bins == 0 ? 1 : n_bins);
+
+	for (uint32_t i = 0; i < n_bins; i++) {
+		as_val* stored = (as_val*)as_record_get(rec, bins[i]);
+
+		if (! stored) {
+			continue;
+		}
+
+		as_val* live = expbin_live_val(stored, now);
+
+		if (live) {
+			as_stringmap_set((as_map*)map, bins[i], live);
+		}
+	}
+
+	return (as_map*)map;
+}
+
+// Batch results arrive in batch order. Records that are missing, or failed
+// on their own, leave their slot NULL.
+static bool
+expbin_many_cb(const as_batch_read* reads, uint32_t n, void* udata)
+{
+	expbin_many* many = (expbin_many*)udata;
+
+	for (uint32_t i = 0; i < n; i++) {
+		if (reads[i].result == AEROSPIKE_OK) {
+			many->results[i] = expbin_live_map(&reads[i].record, many->bins,
+					many->n_bins, many->now);
+		}
+	}
+
+	return true;
+}
+
+// Reads entry i of a touch entry list, false if it is not a valid entry.
+static bool
+expbin_touch_entry_get(as_list* entries, uint32_t i, expbin_touch_entry* touch)
+{
+	as_map* entry = as_map_fromval(as_list_get(entries, i));
+
+	if (! entry) {
+		return false;
+	}
+
+	as_string* bin = as_string_fromval(as_stringmap_get(entry, "bin"));
+	as_integer* bin_ttl = as_integer_fromval(
+			as_stringmap_get(entry, "bin_ttl"));
+
+	if (! bin || ! bin_ttl) {
+		return false;
+	}
+
+	touch->bin = as_string_get(bin);
+	touch->bin_ttl = as_integer_get(bin_ttl);
+
+	if (touch->bin_ttl < 0 && touch->bin_ttl != AS_EXPBIN_TTL_NEVER) {
+		return false;
+	}
+
+	touch->expiry = touch->bin_ttl == AS_EXPBIN_TTL_NEVER ?
+			0 : as_expbin_now() + touch->bin_ttl;
+	return true;
+}
+
+// The header check of a compact envelope bin.
+#define EXPBIN_ENV_CHECK(__bin) \
+		as_exp_cmp_eq( \
+			as_exp_bit_get(0, 24, as_exp_bin_blob(__bin)), \
+			as_exp_bytes(magic, sizeof(magic)))
+
+// One operate rewriting only the stored expiry of each bin, in the handle's
+// format, and the record's AS_EXPBIN_NEXT_BIN.
+// The filter mirrors touch()'s valid_time() check for the longest bin TTL,
+// and for compact envelopes their header check, so nothing is written if
+// any fails. A map put on a bin that is not a map expire bin fails the
+// whole operate too.
+static as_status
+expbin_touch_op(as_expbin* eb, as_error* err, const as_policy_operate* policy,
+		const as_key* key, const expbin_touch_entry* touches,
+		uint32_t n_touches)
+{
+	// Records that never expire report a TTL of -1.
+	int64_t min_ttl = 0;
+	int64_t next_expiry = 0;
+
+	for (uint32_t i = 0; i < n_touches; i++) {
+		if (touches[i].bin_ttl > min_ttl) {
+			min_ttl = touches[i].bin_ttl;
+		}
+
+		if (touches[i].expiry != 0 &&
+				(next_expiry == 0 || touches[i].expiry < next_expiry)) {
+			next_expiry = touches[i].expiry;
+		}
+	}
+
+	uint8_t magic[] = {
+		AS_EXPBIN_ENV_MAGIC0, AS_EXPBIN_ENV_MAGIC1, AS_EXPBIN_ENV_VERSION
+	};
+
+	as_exp* filter;
+	as_exp* next = NULL;
+	as_operations ops;
+	as_operations_inita(&ops, n_touches + 1);
+	ops.ttl = AS_RECORD_NO_CHANGE_TTL;
+
+	// Must outlive the operate.
+	uint8_t be[AS_EXPBIN_NATIVE_TOUCH_MAX][4];
+
+	if (eb->format == AS_EXPBIN_FORMAT_COMPACT) {
+		// Unused checks repeat the first bin's.
+		const char* b[AS_EXPBIN_NATIVE_TOUCH_MAX];
+
+		for (uint32_t i = 0; i < AS_EXPBIN_NATIVE_TOUCH_MAX; i++) {
+			b[i] = touches[i < n_touches ? i : 0].bin;
+		}
+
+		as_exp_build(compact,
+				as_exp_and(
+					EXPBIN_ENV_CHECK(b[0]), EXPBIN_ENV_CHECK(b[1]),
+					EXPBIN_ENV_CHECK(b[2]), EXPBIN_ENV_CHECK(b[3]),
+					EXPBIN_ENV_CHECK(b[4]), EXPBIN_ENV_CHECK(b[5]),
+					EXPBIN_ENV_CHECK(b[6]), EXPBIN_ENV_CHECK(b[7]),
+					as_exp_or(
+						as_exp_cmp_eq(as_exp_ttl(), as_exp_int(-1)),
+						as_exp_cmp_ge(as_exp_ttl(), as_exp_int(min_ttl)))));
+		filter = compact;
+
+		as_bit_policy bit_policy;
+		as_bit_policy_init(&bit_policy);
+
+		for (uint32_t i = 0; i < n_touches; i++) {
+			int64_t expiry = touches[i].expiry;
+
+			be[i][0] = (uint8_t)(expiry >> 24);
+			be[i][1] = (uint8_t)(expiry >> 16);
+			be[i][2] = (uint8_t)(expiry >> 8);
+			be[i][3] = (uint8_t)expiry;
+
+			as_operations_bit_set(&ops, touches[i].bin, NULL, &bit_policy, 32,
+					32, sizeof(be[i]), be[i]);
+		}
+	}
+	else {
+		as_exp_build(map,
+				as_exp_or(
+					as_exp_cmp_eq(as_exp_ttl(), as_exp_int(-1)),
+					as_exp_cmp_ge(as_exp_ttl(), as_exp_int(min_ttl))));
+		filter = map;
+
+		// Update only: a map without the expiry key is not an expire bin.
+		as_map_policy map_policy;
+		as_map_policy_set_flags(&map_policy, AS_MAP_UNORDERED,
+				AS_MAP_WRITE_UPDATE_ONLY);
+
+		for (uint32_t i = 0; i < n_touches; i++) {
+			as_operations_map_put(&ops, touches[i].bin, NULL, &map_policy,
+					(as_val*)as_string_new((char*)AS_EXPBIN_EXP_ID, false),
+					(as_val*)as_integer_new(touches[i].expiry));
+		}
+	}
+
+	if (next_expiry != 0) {
+		// Lower the record's earliest expiry, as the module's lower_next().
+		as_exp_build(lower,
+				as_exp_cond(
+					as_exp_and(
+						as_exp_bin_exists(AS_EXPBIN_NEXT_BIN),
+						as_exp_cmp_le(as_exp_bin_int(AS_EXPBIN_NEXT_BIN),
+								as_exp_int(next_expiry))),
+					as_exp_bin_int(AS_EXPBIN_NEXT_BIN),
+					as_exp_int(next_expiry)));
+		next = lower;
+
+		as_operations_exp_write(&ops, AS_EXPBIN_NEXT_BIN, next,
+				AS_EXP_WRITE_DEFAULT);
+	}
+
+	as_policy_operate op_policy;
+
+	if (policy) {
+		as_policy_operate_copy(policy, &op_policy);
+	}
+	else {
+		as_policy_operate_init(&op_policy);
+	}
+
+	op_policy.base.filter_exp = filter;
+	op_policy.exists = AS_POLICY_EXISTS_UPDATE;
+
+	as_record* rec = NULL;
+	as_status rc = aerospike_key_operate(eb->as, err, &op_policy, key, &ops,
+			&rec);
+
+	if (rec) {
+		as_record_destroy(rec);
+	}
+
+	as_operations_destroy(&ops);
+	as_exp_destroy(filter);
+
+	if (next) {
+		as_exp_destroy(next);
+	}
+
+	return rc;
+}
+
+// The apply policy a native call falls back to the module with.
+static void
+expbin_apply_policy(as_policy_apply* apply, const as_policy_operate* policy)
+{
+	as_policy_apply_init(apply);
+
+	if (policy) {
+		apply->base = policy->base;
+		apply->key = policy->key;
+		apply->replica = policy->replica;
+		apply->commit_level = policy->commit_level;
+		apply->durable_delete = policy->durable_delete;
+	}
+}
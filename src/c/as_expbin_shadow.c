@@ -0,0 +1,164 @@
+/*******************************************************************************
+ * Copyright 2008-2015 by Aerospike.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ ******************************************************************************/
+
+
+
+//==========================================================
+// Includes
+//
+
+#include "as_expbin.h"
+#include "expbin_internal.h"
+
+#include <string.h>
+
+#include <aerospike/aerospike_query.h>
+#include <aerospike/as_query.h>
+#include <aerospike/as_record.h>
+
+
+//==========================================================
+// Typedefs
+//
+
+typedef struct expbin_shadow_query_s {
+	const char* bin;
+	int64_t now;
+	as_expbin_query_fn callback;
+	void* udata;
+} expbin_shadow_query;
+
+
+//==========================================================
+// Forward Declarations
+//
+
+static bool expbin_shadow_record(const as_val* val, void* udata);
+
+
+//==========================================================
+// Public API
+//
+
+as_status
+as_expbin_shadow_name(const as_expbin* eb, as_error* err, const char* bin,
+		as_bin_name name)
+{
+	if (eb->shadow_prefix[0] == '\0') {
+		return as_error_update(err, AEROSPIKE_ERR_PARAM,
+				"shadow: handle has no shadow prefix");
+	}
+
+	size_t prefix_len = strlen(eb->shadow_prefix);
+	size_t bin_len = strlen(bin);
+
+	if (prefix_len + bin_len > AS_BIN_NAME_MAX_LEN) {
+		return as_error_update(err, AEROSPIKE_ERR_PARAM,
+				"shadow: name %s%s is too long", eb->shadow_prefix, bin);
+	}
+
+	memcpy(name, eb->shadow_prefix, prefix_len);
+	memcpy(name + prefix_len, bin, bin_len + 1);
+
+	return AEROSPIKE_OK;
+}
+
+as_status
+as_expbin_shadow_index_create(as_expbin* eb, as_error* err,
+		const as_policy_info* policy, const char* bin, as_index_type type)
+{
+	as_error_reset(err);
+
+	as_bin_name name;
+
+	if (as_expbin_shadow_name(eb, err, bin, name) != AEROSPIKE_OK) {
+		return err->code;
+	}
+
+	return expbin_index_create(eb, err, policy, name, type);
+}
+
+as_status
+as_expbin_query_shadow(as_expbin* eb, as_error* err,
+		const as_policy_query* policy, as_query* query, const char* bin,
+		as_expbin_query_fn callback, void* udata)
+{
+	as_error_reset(err);
+
+	if (eb->transport) {
+		return as_error_update(err, AEROSPIKE_ERR_UNSUPPORTED_FEATURE,
+				"shadow: queries are not supported by the transport");
+	}
+
+	// Heap allocated, the query outlives this frame.
+	as_query_select_init(query, 1);
+	as_query_select(query, bin);
+
+	expbin_shadow_query sq = {
+		.bin = bin,
+		.now = as_expbin_now(),
+		.callback = callback,
+		.udata = udata
+	};
+
+	return aerospike_query_foreach(eb->as, err, policy, query,
+			expbin_shadow_record, &sq);
+}
+
+
+//==========================================================
+// Local Helpers
+//
+
+static bool
+expbin_shadow_record(const as_val* val, void* udata)
+{
+	if (! val) {
+		// End of the query.
+		return true;
+	}
+
+	expbin_shadow_query* sq = (expbin_shadow_query*)udata;
+	as_record* rec = as_record_fromval(val);
+
+	if (! rec) {
+		return true;
+	}
+
+	as_val* stored = (as_val*)as_record_get(rec, sq->bin);
+
+	if (! stored) {
+		return true;
+	}
+
+	// Expired but not yet cleaned - the shadow still matched.
+	as_val* live = expbin_live_val(stored, sq->now);
+
+	if (! live) {
+		return true;
+	}
+
+	bool more = sq->callback(&rec->key, live, sq->udata);
+
+	as_val_destroy(live);
+	return more;
+}
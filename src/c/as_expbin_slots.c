@@ -0,0 +1,230 @@
+/*******************************************************************************
+ * Copyright 2008-2015 by Aerospike.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ ******************************************************************************/
+
+
+
+//==========================================================
+// Includes
+//
+
+#include "as_expbin.h"
+#include "expbin_internal.h"
+
+#include <aerospike/aerospike_key.h>
+#include <aerospike/as_bytes.h>
+#include <aerospike/as_double.h>
+#include <aerospike/as_integer.h>
+#include <aerospike/as_record.h>
+#include <aerospike/as_string.h>
+
+
+//==========================================================
+// Forward Declarations
+//
+
+static void expbin_slot_decode(as_expbin_slot* slot, const as_val* stored, int64_t now);
+static void expbin_slot_decode_env(as_expbin_slot* slot, const as_bytes* env);
+
+
+//==========================================================
+// Public API
+//
+
+as_status
+as_expbin_get_slots(as_expbin* eb, as_error* err,
+		const as_policy_apply* policy, const as_key* key,
+		as_expbin_slot slots[], uint32_t n_slots, as_record** rec)
+{
+	if (n_slots > AS_EXPBIN_MAX_BINS) {
+		return as_error_update(err, AEROSPIKE_ERR_PARAM,
+				"more than %u bins requested", AS_EXPBIN_MAX_BINS);
+	}
+
+	if (! rec) {
+		// The slots' views borrow from the record.
+		return as_error_update(err, AEROSPIKE_ERR_PARAM,
+				"get_slots: no record to read into");
+	}
+
+	const char* bins[n_slots + 1];
+
+	for (uint32_t i = 0; i < n_slots; i++) {
+		bins[i] = slots[i].bin;
+		slots[i].status = AS_EXPBIN_SLOT_MISSING;
+		slots[i].val_type = AS_UNDEF;
+	}
+
+	bins[n_slots] = NULL;
+
+	as_policy_read read;
+	expbin_read_policy(&read, policy);
+
+	as_status rc = expbin_select(eb, err, &read, key, bins, rec);
+
+	if (rc != AEROSPIKE_OK) {
+		return rc;
+	}
+
+	int64_t now = as_expbin_now();
+
+	for (uint32_t i = 0; i < n_slots; i++) {
+		as_val* stored = (as_val*)as_record_get(*rec, slots[i].bin);
+
+		if (stored) {
+			expbin_slot_decode(&slots[i], stored, now);
+		}
+	}
+
+	return AEROSPIKE_OK;
+}
+
+
+//==========================================================
+// Local Helpers
+//
+
+// Mirrors expbin_live_val(), without copying anything out of the record.
+static void
+expbin_slot_decode(as_expbin_slot* slot, const as_val* stored, int64_t now)
+{
+	as_val* data;
+
+	if (as_expbin_eval(stored, now, &data, NULL) == AS_EXPBIN_EXPIRED) {
+		slot->status = AS_EXPBIN_SLOT_EXPIRED;
+		return;
+	}
+
+	if (! data || as_val_type(data) == AS_NIL) {
+		return;
+	}
+
+	if (as_expbin_is_env(data)) {
+		expbin_slot_decode_env(slot, (as_bytes*)data);
+		return;
+	}
+
+	slot->val_type = as_val_type(data);
+	slot->status = AS_EXPBIN_SLOT_OK;
+
+	switch (slot->type) {
+	case AS_EXPBIN_SLOT_INT64:
+		if (slot->val_type == AS_INTEGER) {
+			slot->value.i64 = as_integer_get((as_integer*)data);
+			return;
+		}
+		break;
+	case AS_EXPBIN_SLOT_DOUBLE:
+		// Integral numbers written through the module are stored as
+		// integers.
+		if (slot->val_type == AS_DOUBLE) {
+			slot->value.f64 = as_double_get((as_double*)data);
+			return;
+		}
+
+		if (slot->val_type == AS_INTEGER) {
+			slot->value.f64 = (double)as_integer_get((as_integer*)data);
+			return;
+		}
+		break;
+	case AS_EXPBIN_SLOT_VIEW:
+		if (slot->val_type == AS_STRING) {
+			as_string* s = (as_string*)data;
+
+			slot->value.view.data = (const uint8_t*)as_string_get(s);
+			slot->value.view.size = (uint32_t)as_string_len(s);
+			return;
+		}
+
+		if (slot->val_type == AS_BYTES) {
+			as_bytes* b = (as_bytes*)data;
+
+			slot->value.view.data = as_bytes_get(b);
+			slot->value.view.size = as_bytes_size(b);
+			return;
+		}
+		break;
+	case AS_EXPBIN_SLOT_PRESENCE:
+		return;
+	}
+
+	slot->status = AS_EXPBIN_SLOT_WRONG_TYPE;
+}
+
+static void
+expbin_slot_decode_env(as_expbin_slot* slot, const as_bytes* env)
+{
+	uint32_t expiry;
+	as_bytes_type type;
+	as_bytes payload;
+
+	as_expbin_env_decode(env, &expiry, &type, &payload);
+
+	const uint8_t* p = as_bytes_get(&payload);
+	uint32_t size = as_bytes_size(&payload);
+
+	if (type == AS_BYTES_INTEGER) {
+		slot->val_type = AS_INTEGER;
+
+		if (size != sizeof(uint64_t)) {
+			// As as_expbin_env_to_val(), a malformed integer has no value.
+			slot->val_type = AS_UNDEF;
+			return;
+		}
+	}
+	else {
+		slot->val_type = type == AS_BYTES_STRING ? AS_STRING : AS_BYTES;
+	}
+
+	slot->status = AS_EXPBIN_SLOT_OK;
+
+	switch (slot->type) {
+	case AS_EXPBIN_SLOT_INT64:
+	case AS_EXPBIN_SLOT_DOUBLE:
+		if (slot->val_type == AS_INTEGER) {
+			int64_t v = 0;
+
+			for (uint32_t i = 0; i < sizeof(uint64_t); i++) {
+				v = (int64_t)(((uint64_t)v << 8) | p[i]);
+			}
+
+			if (slot->type == AS_EXPBIN_SLOT_INT64) {
+				slot->value.i64 = v;
+			}
+			else {
+				slot->value.f64 = (double)v;
+			}
+			return;
+		}
+		break;
+	case AS_EXPBIN_SLOT_VIEW:
+		if (slot->val_type != AS_INTEGER) {
+			slot->value.view.data = p;
+			slot->value.view.size = size;
+			return;
+		}
+		break;
+	case AS_EXPBIN_SLOT_PRESENCE:
+		return;
+	}
+
+	slot->status = AS_EXPBIN_SLOT_WRONG_TYPE;
+}
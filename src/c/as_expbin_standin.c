@@ -0,0 +1,1224 @@
+/*******************************************************************************
+ * Copyright 2008-2015 by Aerospike.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ ******************************************************************************/
+
+
+
+//==========================================================
+// Includes
+//
+
+#include "as_expbin_standin.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <aerospike/as_arraylist.h>
+#include <aerospike/as_boolean.h>
+#include <aerospike/as_bytes.h>
+#include <aerospike/as_double.h>
+#include <aerospike/as_hashmap.h>
+#include <aerospike/as_integer.h>
+#include <aerospike/as_key.h>
+#include <aerospike/as_nil.h>
+#include <aerospike/as_record.h>
+#include <aerospike/as_string.h>
+#include <aerospike/as_stringmap.h>
+
+#include <lauxlib.h>
+#include <lua.h>
+#include <lualib.h>
+
+
+//==========================================================
+// Constants
+//
+
+#define STANDIN_BUCKETS (1 << 16)
+
+// record.ttl() of a record that never expires.
+#define STANDIN_TTL_NEVER 0xFFFFFFFF
+
+// The server's Lua environment, as far as the module uses it.
+static const char STANDIN_PRELUDE[] =
+	"-- Stand-in for the server's Lua environment. map, list, bytes and records\n"
+	"-- are userdata proxies, as on the server, backed by plain tables in data.\n"
+	"local P = ...;\n"
+	"local data = setmetatable({}, {__mode = \"k\"});\n"
+	"local protos = {};\n"
+	"local traceback = debug.traceback;\n"
+	"P.data = data;\n"
+	"\n"
+	"local function proto(kind)\n"
+	"	local u = newproxy(true);\n"
+	"	protos[kind] = u;\n"
+	"	return getmetatable(u);\n"
+	"end\n"
+	"\n"
+	"local function new(kind)\n"
+	"	local u = newproxy(protos[kind]);\n"
+	"	local t = {kind = kind, v = {}, n = 0};\n"
+	"	data[u] = t;\n"
+	"	return u, t;\n"
+	"end\n"
+	"P.new = new;\n"
+	"\n"
+	"local function show(u)\n"
+	"	local t = data[u];\n"
+	"	local s = {};\n"
+	"	for k, x in pairs(t.v) do\n"
+	"		s[#s + 1] = tostring(k) .. \"=\" .. tostring(x);\n"
+	"	end\n"
+	"	return t.kind .. \"(\" .. table.concat(s, \", \") .. \")\";\n"
+	"end\n"
+	"\n"
+	"local function index(u, k)\n"
+	"	return data[u].v[k];\n"
+	"end\n"
+	"\n"
+	"local function length(u)\n"
+	"	return data[u].n;\n"
+	"end\n"
+	"\n"
+	"-- map ---------------------------------------------------------------------\n"
+	"local Map = proto(\"map\");\n"
+	"Map.__index = index;\n"
+	"Map.__len = length;\n"
+	"Map.__tostring = show;\n"
+	"Map.__newindex = function(u, k, x)\n"
+	"	local t = data[u];\n"
+	"	local old = t.v[k];\n"
+	"	if (old == nil and x ~= nil) then\n"
+	"		t.n = t.n + 1;\n"
+	"	elseif (old ~= nil and x == nil) then\n"
+	"		t.n = t.n - 1;\n"
+	"	end\n"
+	"	t.v[k] = x;\n"
+	"end\n"
+	"\n"
+	"map = setmetatable({}, {__call = function(_, init)\n"
+	"	local u = new(\"map\");\n"
+	"	if (init ~= nil) then\n"
+	"		for k, x in pairs(init) do\n"
+	"			u[k] = x;\n"
+	"		end\n"
+	"	end\n"
+	"	return u;\n"
+	"end});\n"
+	"\n"
+	"function map.size(u) return data[u].n; end\n"
+	"function map.pairs(u) return next, data[u].v, nil; end\n"
+	"function map.remove(u, k) u[k] = nil; end\n"
+	"\n"
+	"-- list --------------------------------------------------------------------\n"
+	"local List = proto(\"list\");\n"
+	"List.__index = index;\n"
+	"List.__len = length;\n"
+	"List.__tostring = show;\n"
+	"List.__newindex = function(u, i, x)\n"
+	"	local t = data[u];\n"
+	"	t.v[i] = x;\n"
+	"	if (i > t.n) then\n"
+	"		t.n = i;\n"
+	"	end\n"
+	"end\n"
+	"\n"
+	"list = setmetatable({}, {__call = function(_, init)\n"
+	"	local u, t = new(\"list\");\n"
+	"	if (init ~= nil) then\n"
+	"		t.n = #init;\n"
+	"		for i = 1, t.n do\n"
+	"			t.v[i] = init[i];\n"
+	"		end\n"
+	"	end\n"
+	"	return u;\n"
+	"end});\n"
+	"\n"
+	"function list.size(u) return data[u].n; end\n"
+	"\n"
+	"function list.append(u, x)\n"
+	"	local t = data[u];\n"
+	"	t.n = t.n + 1;\n"
+	"	t.v[t.n] = x;\n"
+	"end\n"
+	"\n"
+	"function list.insert(u, i, x)\n"
+	"	local t = data[u];\n"
+	"	for j = t.n, i, -1 do\n"
+	"		t.v[j + 1] = t.v[j];\n"
+	"	end\n"
+	"	t.v[i] = x;\n"
+	"	t.n = t.n + 1;\n"
+	"end\n"
+	"\n"
+	"function list.prepend(u, x) list.insert(u, 1, x); end\n"
+	"\n"
+	"function list.remove(u, i)\n"
+	"	local t = data[u];\n"
+	"	for j = i, t.n - 1 do\n"
+	"		t.v[j] = t.v[j + 1];\n"
+	"	end\n"
+	"	t.v[t.n] = nil;\n"
+	"	t.n = t.n - 1;\n"
+	"end\n"
+	"\n"
+	"-- bytes -------------------------------------------------------------------\n"
+	"local Bytes = proto(\"bytes\");\n"
+	"Bytes.__index = index;\n"
+	"Bytes.__len = length;\n"
+	"Bytes.__tostring = show;\n"
+	"\n"
+	"local function put(t, i, x)\n"
+	"	t.v[i] = x % 256;\n"
+	"	if (i > t.n) then\n"
+	"		t.n = i;\n"
+	"	end\n"
+	"end\n"
+	"\n"
+	"local function put_be(t, i, x, n)\n"
+	"	for k = n - 1, 0, -1 do\n"
+	"		put(t, i + k, x);\n"
+	"		x = math.floor(x / 256);\n"
+	"	end\n"
+	"	return true;\n"
+	"end\n"
+	"\n"
+	"local function get_be(t, i, n)\n"
+	"	local x = 0;\n"
+	"	for k = 0, n - 1 do\n"
+	"		x = x * 256 + (t.v[i + k] or 0);\n"
+	"	end\n"
+	"	-- Two's complement, computed on the complement to stay exact.\n"
+	"	if ((t.v[i] or 0) >= 128) then\n"
+	"		x = 0;\n"
+	"		for k = 0, n - 1 do\n"
+	"			x = x * 256 + (255 - (t.v[i + k] or 0));\n"
+	"		end\n"
+	"		x = -x - 1;\n"
+	"	end\n"
+	"	return x;\n"
+	"end\n"
+	"\n"
+	"Bytes.__newindex = function(u, i, x)\n"
+	"	put(data[u], i, x);\n"
+	"end\n"
+	"\n"
+	"bytes = setmetatable({}, {__call = function(_, n)\n"
+	"	return (new(\"bytes\"));\n"
+	"end});\n"
+	"\n"
+	"function bytes.size(u) return data[u].n; end\n"
+	"function bytes.get_byte(u, i) return data[u].v[i]; end\n"
+	"function bytes.set_byte(u, i, x) put(data[u], i, x); return true; end\n"
+	"function bytes.append_byte(u, x) local t = data[u]; put(t, t.n + 1, x); return true; end\n"
+	"function bytes.get_int32_be(u, i) return get_be(data[u], i, 4); end\n"
+	"function bytes.get_int64_be(u, i) return get_be(data[u], i, 8); end\n"
+	"function bytes.set_int32_be(u, i, x) return put_be(data[u], i, x, 4); end\n"
+	"function bytes.append_int32_be(u, x) local t = data[u]; return put_be(t, t.n + 1, x, 4); end\n"
+	"function bytes.append_int64_be(u, x) local t = data[u]; return put_be(t, t.n + 1, x, 8); end\n"
+	"\n"
+	"function bytes.append_string(u, s)\n"
+	"	local t = data[u];\n"
+	"	for k = 1, string.len(s) do\n"
+	"		put(t, t.n + 1, string.byte(s, k));\n"
+	"	end\n"
+	"	return true;\n"
+	"end\n"
+	"\n"
+	"function bytes.append_bytes(u, b, len)\n"
+	"	local t, s = data[u], data[b];\n"
+	"	for k = 1, (len or s.n) do\n"
+	"		put(t, t.n + 1, s.v[k]);\n"
+	"	end\n"
+	"	return true;\n"
+	"end\n"
+	"\n"
+	"function bytes.get_string(u, i, len)\n"
+	"	local t = data[u];\n"
+	"	local c = {};\n"
+	"	for k = 0, len - 1 do\n"
+	"		c[k + 1] = string.char(t.v[i + k]);\n"
+	"	end\n"
+	"	return table.concat(c);\n"
+	"end\n"
+	"\n"
+	"function bytes.get_bytes(u, i, len)\n"
+	"	local s = data[u];\n"
+	"	local b, t = new(\"bytes\");\n"
+	"	for k = 0, len - 1 do\n"
+	"		put(t, k + 1, s.v[i + k]);\n"
+	"	end\n"
+	"	return b;\n"
+	"end\n"
+	"\n"
+	"-- record ------------------------------------------------------------------\n"
+	"local Record = proto(\"record\");\n"
+	"Record.__index = index;\n"
+	"Record.__tostring = show;\n"
+	"Record.__newindex = function(u, k, x)\n"
+	"	data[u].v[k] = x;\n"
+	"end\n"
+	"\n"
+	"record = {};\n"
+	"\n"
+	"function record.ttl(u) return data[u].ttl; end\n"
+	"\n"
+	"-- Applies with the next write, as on the server.\n"
+	"function record.set_ttl(u, ttl) data[u].set_ttl = ttl; end\n"
+	"\n"
+	"-- A plain table, not a list, as on the server.\n"
+	"function record.bin_names(u)\n"
+	"	local names = {};\n"
+	"	for k in pairs(data[u].v) do\n"
+	"		names[#names + 1] = k;\n"
+	"	end\n"
+	"	return names;\n"
+	"end\n"
+	"\n"
+	"-- Called by the C side for each apply, which fills the returned bin table.\n"
+	"function P.record(exists, ttl)\n"
+	"	local u, t = new(\"record\");\n"
+	"	t.exists = exists;\n"
+	"	t.ttl = ttl;\n"
+	"	return u, t.v;\n"
+	"end\n"
+	"\n"
+	"-- aerospike ---------------------------------------------------------------\n"
+	"aerospike = {};\n"
+	"\n"
+	"local function commit(u, op)\n"
+	"	local t = data[u];\n"
+	"	t.ttl = P.write(op, t.v, t.set_ttl);\n"
+	"	t.exists = true;\n"
+	"	return 0;\n"
+	"end\n"
+	"\n"
+	"function aerospike:exists(u)\n"
+	"	return data[u].exists;\n"
+	"end\n"
+	"\n"
+	"function aerospike:create(u)\n"
+	"	if (data[u].exists) then\n"
+	"		return 1;\n"
+	"	end\n"
+	"	return commit(u, \"create\");\n"
+	"end\n"
+	"\n"
+	"function aerospike:update(u)\n"
+	"	return commit(u, \"update\");\n"
+	"end\n"
+	"\n"
+	"function aerospike:remove(u)\n"
+	"	local t = data[u];\n"
+	"	if (not t.exists) then\n"
+	"		return 1;\n"
+	"	end\n"
+	"	P.write(\"remove\");\n"
+	"	t.exists = false;\n"
+	"	t.ttl = 0;\n"
+	"	t.v = {};\n"
+	"	return 0;\n"
+	"end\n"
+	"\n"
+	"-- logging -----------------------------------------------------------------\n"
+	"-- The server formats every message before checking the log level, so the\n"
+	"-- stand-in does too.\n"
+	"local function logger(level)\n"
+	"	return function(m, ...)\n"
+	"		return P.log(level, string.format(m, ...));\n"
+	"	end\n"
+	"end\n"
+	"\n"
+	"warn = logger(2);\n"
+	"info = logger(3);\n"
+	"debug = logger(4);\n"
+	"trace = logger(5);\n"
+	"\n"
+	"function P.traceback(e)\n"
+	"	return traceback(tostring(e), 2);\n"
+	"end\n";
+
+
+//==========================================================
+// Typedefs
+//
+
+typedef struct standin_rec_s {
+	struct standin_rec_s* next;
+	uint8_t digest[AS_DIGEST_VALUE_SIZE];
+	char ns[AS_NAMESPACE_MAX_SIZE];
+	char set[AS_SET_MAX_SIZE];
+
+	// Bin name to value. Empty only while an apply that created the record
+	// runs.
+	as_hashmap* bins;
+
+	// Expiry in as_expbin_now() seconds, 0 if the record never expires.
+	uint32_t void_time;
+
+	uint16_t gen;
+} standin_rec;
+
+struct as_expbin_standin_s {
+	as_expbin_transport transport;
+	pthread_mutex_t lock;
+	uint32_t default_ttl;
+	FILE* log;
+
+	lua_State* L;
+
+	// Registry references to the registered module's table and to prelude
+	// members used on every call.
+	int module_ref;
+	int data_ref;
+	int new_ref;
+	int record_ref;
+	int traceback_ref;
+
+	standin_rec** buckets;
+	uint32_t n_records;
+
+	// The record an apply is running against, for aerospike:create, update
+	// and remove.
+	const char* cur_ns;
+	const char* cur_set;
+	const uint8_t* cur_digest;
+};
+
+typedef struct standin_push_s {
+	as_expbin_standin* si;
+	lua_State* L;
+} standin_push;
+
+
+//==========================================================
+// Forward Declarations
+//
+
+static as_status standin_apply(void* udata, as_error* err, const as_policy_apply* policy, const as_key* key, const char* module, const char* fn, as_list* arglist, as_val** result);
+static as_status standin_scan_apply(void* udata, as_error* err, const as_policy_scan* policy, const char* ns, const char* set, const char* module, const char* fn, as_list* arglist);
+static as_status standin_select(void* udata, as_error* err, const as_policy_read* policy, const as_key* key, const char* bins[], as_record** rec);
+static as_status standin_udf_put(void* udata, as_error* err, const char* filename, const as_bytes* content);
+static as_status standin_info(void* udata, as_error* err, const char* request, char** response);
+
+static as_status standin_run(as_expbin_standin* si, as_error* err, const char* ns, const char* set, const uint8_t* digest, const char* fn, as_list* arglist, as_val** result);
+static int standin_lua_write(lua_State* L);
+static int standin_lua_log(lua_State* L);
+
+static standin_rec* standin_find(as_expbin_standin* si, const uint8_t* digest);
+static standin_rec* standin_create(as_expbin_standin* si, const char* ns, const char* set, const uint8_t* digest);
+static void standin_remove(as_expbin_standin* si, const uint8_t* digest);
+static uint32_t standin_ttl(const standin_rec* rec);
+
+static void standin_push_val(as_expbin_standin* si, lua_State* L, const as_val* val);
+static bool standin_push_entry(const as_val* key, const as_val* val, void* udata);
+static void standin_push_new(as_expbin_standin* si, lua_State* L, const char* kind);
+static as_val* standin_to_val(as_expbin_standin* si, lua_State* L, int idx);
+static bool standin_set_bin(const as_val* key, const as_val* val, void* udata);
+
+
+//==========================================================
+// Public API
+//
+
+as_expbin_standin*
+as_expbin_standin_new(uint32_t default_ttl)
+{
+	as_expbin_standin* si = calloc(1, sizeof(as_expbin_standin));
+
+	if (! si) {
+		return NULL;
+	}
+
+	si->buckets = calloc(STANDIN_BUCKETS, sizeof(standin_rec*));
+	si->L = luaL_newstate();
+
+	if (! si->buckets || ! si->L) {
+		free(si->buckets);
+
+		if (si->L) {
+			lua_close(si->L);
+		}
+
+		free(si);
+		return NULL;
+	}
+
+	lua_State* L = si->L;
+
+	luaL_openlibs(L);
+
+	if (luaL_loadbuffer(L, STANDIN_PRELUDE, sizeof(STANDIN_PRELUDE) - 1,
+			"=standin") != 0) {
+		lua_close(L);
+		free(si->buckets);
+		free(si);
+		return NULL;
+	}
+
+	// The prelude's table, with the callbacks into the store.
+	lua_newtable(L);
+	lua_pushlightuserdata(L, si);
+	lua_pushcclosure(L, standin_lua_write, 1);
+	lua_setfield(L, -2, "write");
+	lua_pushlightuserdata(L, si);
+	lua_pushcclosure(L, standin_lua_log, 1);
+	lua_setfield(L, -2, "log");
+	lua_pushvalue(L, -1);
+	lua_insert(L, -3);
+
+	if (lua_pcall(L, 1, 0, 0) != 0) {
+		lua_close(L);
+		free(si->buckets);
+		free(si);
+		return NULL;
+	}
+
+	lua_getfield(L, -1, "data");
+	si->data_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+	lua_getfield(L, -1, "new");
+	si->new_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+	lua_getfield(L, -1, "record");
+	si->record_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+	lua_getfield(L, -1, "traceback");
+	si->traceback_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+	lua_pop(L, 1);
+
+	si->module_ref = LUA_NOREF;
+	si->default_ttl = default_ttl;
+	pthread_mutex_init(&si->lock, NULL);
+
+	si->transport.apply = standin_apply;
+	si->transport.scan_apply = standin_scan_apply;
+	si->transport.select = standin_select;
+	si->transport.udf_put = standin_udf_put;
+	si->transport.info = standin_info;
+	si->transport.udata = si;
+
+	return si;
+}
+
+void
+as_expbin_standin_destroy(as_expbin_standin* si)
+{
+	for (uint32_t i = 0; i < STANDIN_BUCKETS; i++) {
+		standin_rec* rec = si->buckets[i];
+
+		while (rec) {
+			standin_rec* next = rec->next;
+
+			as_hashmap_destroy(rec->bins);
+			free(rec);
+			rec = next;
+		}
+	}
+
+	lua_close(si->L);
+	pthread_mutex_destroy(&si->lock);
+	free(si->buckets);
+	free(si);
+}
+
+void
+as_expbin_standin_attach(as_expbin_standin* si, as_expbin* eb)
+{
+	eb->transport = &si->transport;
+}
+
+void
+as_expbin_standin_log(as_expbin_standin* si, FILE* out)
+{
+	pthread_mutex_lock(&si->lock);
+	si->log = out;
+	pthread_mutex_unlock(&si->lock);
+}
+
+
+//==========================================================
+// Local Helpers - transport
+//
+
+static as_status
+standin_apply(void* udata, as_error* err, const as_policy_apply* policy,
+		const as_key* key, const char* module, const char* fn,
+		as_list* arglist, as_val** result)
+{
+	as_expbin_standin* si = (as_expbin_standin*)udata;
+	as_digest* digest = as_key_digest((as_key*)key);
+
+	if (! digest) {
+		return as_error_update(err, AEROSPIKE_ERR_PARAM, "invalid key");
+	}
+
+	as_error_reset(err);
+
+	pthread_mutex_lock(&si->lock);
+
+	as_status rc = standin_run(si, err, key->ns, key->set, digest->value, fn,
+			arglist, result);
+
+	pthread_mutex_unlock(&si->lock);
+	return rc;
+}
+
+static as_status
+standin_scan_apply(void* udata, as_error* err, const as_policy_scan* policy,
+		const char* ns, const char* set, const char* module, const char* fn,
+		as_list* arglist)
+{
+	as_expbin_standin* si = (as_expbin_standin*)udata;
+
+	as_error_reset(err);
+
+	pthread_mutex_lock(&si->lock);
+
+	// Collect the records first, the UDF may remove them as it goes.
+	uint8_t (*digests)[AS_DIGEST_VALUE_SIZE] =
+			malloc((si->n_records + 1) * AS_DIGEST_VALUE_SIZE);
+	uint32_t n = 0;
+
+	if (! digests) {
+		pthread_mutex_unlock(&si->lock);
+		return as_error_update(err, AEROSPIKE_ERR_CLIENT, "out of memory");
+	}
+
+	for (uint32_t i = 0; i < STANDIN_BUCKETS; i++) {
+		for (standin_rec* rec = si->buckets[i]; rec; rec = rec->next) {
+			if (strcmp(rec->ns, ns) == 0 &&
+					(! set || ! *set || strcmp(rec->set, set) == 0)) {
+				memcpy(digests[n++], rec->digest, AS_DIGEST_VALUE_SIZE);
+			}
+		}
+	}
+
+	// As in a background scan, a failure on one record doesn't stop the
+	// others and isn't reported.
+	for (uint32_t i = 0; i < n; i++) {
+		standin_rec* rec = standin_find(si, digests[i]);
+
+		if (! rec) {
+			continue;
+		}
+
+		// The UDF may remove and recreate the record, copy its names.
+		char rec_ns[AS_NAMESPACE_MAX_SIZE];
+		char rec_set[AS_SET_MAX_SIZE];
+		as_error rec_err;
+		as_val* result = NULL;
+
+		strcpy(rec_ns, rec->ns);
+		strcpy(rec_set, rec->set);
+		as_error_init(&rec_err);
+
+		if (standin_run(si, &rec_err, rec_ns, rec_set, digests[i], fn,
+				arglist, &result) == AEROSPIKE_OK) {
+			as_val_destroy(result);
+		}
+	}
+
+	pthread_mutex_unlock(&si->lock);
+	free(digests);
+	return AEROSPIKE_OK;
+}
+
+static as_status
+standin_select(void* udata, as_error* err, const as_policy_read* policy,
+		const as_key* key, const char* bins[], as_record** rec)
+{
+	as_expbin_standin* si = (as_expbin_standin*)udata;
+	as_digest* digest = as_key_digest((as_key*)key);
+
+	if (! digest) {
+		return as_error_update(err, AEROSPIKE_ERR_PARAM, "invalid key");
+	}
+
+	pthread_mutex_lock(&si->lock);
+
+	standin_rec* stored = standin_find(si, digest->value);
+
+	if (! stored) {
+		pthread_mutex_unlock(&si->lock);
+		return as_error_update(err, AEROSPIKE_ERR_RECORD_NOT_FOUND,
+				"record not found");
+	}
+
+	as_record* r;
+
+	if (bins) {
+		uint32_t n_bins = 0;
+
+		while (bins[n_bins]) {
+			n_bins++;
+		}
+
+		r = as_record_new((uint16_t)(n_bins ? n_bins : 1));
+
+		for (uint32_t i = 0; i < n_bins; i++) {
+			as_val* val = as_stringmap_get((as_map*)stored->bins, bins[i]);
+
+			if (val) {
+				as_record_set(r, bins[i], (as_bin_value*)as_val_reserve(val));
+			}
+		}
+	}
+	else {
+		r = as_record_new((uint16_t)as_hashmap_size(stored->bins));
+		as_map_foreach((as_map*)stored->bins, standin_set_bin, r);
+	}
+
+	r->ttl = standin_ttl(stored);
+	r->gen = stored->gen;
+
+	pthread_mutex_unlock(&si->lock);
+
+	as_error_reset(err);
+	*rec = r;
+	return AEROSPIKE_OK;
+}
+
+static as_status
+standin_udf_put(void* udata, as_error* err, const char* filename,
+		const as_bytes* content)
+{
+	as_expbin_standin* si = (as_expbin_standin*)udata;
+	lua_State* L = si->L;
+	as_status rc = AEROSPIKE_OK;
+
+	as_error_reset(err);
+
+	pthread_mutex_lock(&si->lock);
+
+	if (luaL_loadbuffer(L, (const char*)content->value, content->size,
+			filename) != 0 || lua_pcall(L, 0, 1, 0) != 0) {
+		rc = as_error_update(err, AEROSPIKE_ERR_UDF, "%s: %s", filename,
+				lua_tostring(L, -1));
+		lua_pop(L, 1);
+	}
+	else if (! lua_istable(L, -1)) {
+		rc = as_error_update(err, AEROSPIKE_ERR_UDF,
+				"%s: module did not return a table", filename);
+		lua_pop(L, 1);
+	}
+	else {
+		luaL_unref(L, LUA_REGISTRYINDEX, si->module_ref);
+		si->module_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+	}
+
+	pthread_mutex_unlock(&si->lock);
+	return rc;
+}
+
+// Answers namespace/<ns> with the default-ttl, nothing else.
+static as_status
+standin_info(void* udata, as_error* err, const char* request, char** response)
+{
+	as_expbin_standin* si = (as_expbin_standin*)udata;
+
+	if (strncmp(request, "namespace/", 10) != 0) {
+		return as_error_update(err, AEROSPIKE_ERR_REQUEST_INVALID,
+				"unsupported info request %s", request);
+	}
+
+	char* buf = malloc(64);
+
+	if (! buf) {
+		return as_error_update(err, AEROSPIKE_ERR_CLIENT, "out of memory");
+	}
+
+	snprintf(buf, 64, "%s\tdefault-ttl=%u\n", request, si->default_ttl);
+
+	as_error_reset(err);
+	*response = buf;
+	return AEROSPIKE_OK;
+}
+
+
+//==========================================================
+// Local Helpers - Lua
+//
+
+// Call module function fn on a record, under the lock.
+static as_status
+standin_run(as_expbin_standin* si, as_error* err, const char* ns,
+		const char* set, const uint8_t* digest, const char* fn,
+		as_list* arglist, as_val** result)
+{
+	lua_State* L = si->L;
+	int top = lua_gettop(L);
+	uint32_t n_args = arglist ? as_list_size(arglist) : 0;
+
+	if (si->module_ref == LUA_NOREF) {
+		return as_error_update(err, AEROSPIKE_ERR_UDF, "no module registered");
+	}
+
+	if (! lua_checkstack(L, (int)n_args + 8)) {
+		return as_error_update(err, AEROSPIKE_ERR_UDF, "too many arguments");
+	}
+
+	lua_rawgeti(L, LUA_REGISTRYINDEX, si->traceback_ref);
+	lua_rawgeti(L, LUA_REGISTRYINDEX, si->module_ref);
+	lua_getfield(L, -1, fn);
+	lua_remove(L, -2);
+
+	if (! lua_isfunction(L, -1)) {
+		lua_settop(L, top);
+		return as_error_update(err, AEROSPIKE_ERR_UDF,
+				"function %s not found", fn);
+	}
+
+	standin_rec* rec = standin_find(si, digest);
+
+	// The record's view for this call, with a copy of every stored bin.
+	lua_rawgeti(L, LUA_REGISTRYINDEX, si->record_ref);
+	lua_pushboolean(L, rec != NULL);
+	lua_pushnumber(L, rec ? (lua_Number)standin_ttl(rec) : 0);
+	lua_call(L, 2, 2);
+
+	if (rec) {
+		standin_push push = { si, L };
+		as_map_foreach((as_map*)rec->bins, standin_push_entry, &push);
+	}
+
+	lua_pop(L, 1);
+
+	for (uint32_t i = 0; i < n_args; i++) {
+		standin_push_val(si, L, as_list_get(arglist, i));
+	}
+
+	si->cur_ns = ns;
+	si->cur_set = set;
+	si->cur_digest = digest;
+
+	as_status rc = AEROSPIKE_OK;
+
+	if (lua_pcall(L, (int)n_args + 1, 1, top + 1) != 0) {
+		rc = as_error_update(err, AEROSPIKE_ERR_UDF, "%s: %s", fn,
+				lua_tostring(L, -1));
+	}
+	else {
+		*result = standin_to_val(si, L, lua_gettop(L));
+	}
+
+	si->cur_digest = NULL;
+	lua_settop(L, top);
+
+	// As on the server, a record left with no bins is not kept.
+	rec = standin_find(si, digest);
+
+	if (rec && as_hashmap_size(rec->bins) == 0) {
+		standin_remove(si, digest);
+	}
+
+	return rc;
+}
+
+// write(op, bins, ttl) - store a record's bins, or remove it. A ttl set by
+// record.set_ttl() replaces the record's: -1 never expires, 0 is the
+// default-ttl. Returns the record's ttl.
+static int
+standin_lua_write(lua_State* L)
+{
+	as_expbin_standin* si = (as_expbin_standin*)lua_touserdata(L,
+			lua_upvalueindex(1));
+	const char* op = luaL_checkstring(L, 1);
+
+	if (! si->cur_digest) {
+		return luaL_error(L, "no record");
+	}
+
+	if (strcmp(op, "remove") == 0) {
+		standin_remove(si, si->cur_digest);
+		lua_pushnil(L);
+		return 1;
+	}
+
+	luaL_checktype(L, 2, LUA_TTABLE);
+
+	as_hashmap* bins = as_hashmap_new(32);
+
+	lua_pushnil(L);
+
+	while (lua_next(L, 2) != 0) {
+		if (lua_type(L, -2) == LUA_TSTRING) {
+			as_val* val = standin_to_val(si, L, lua_gettop(L));
+
+			if (val) {
+				as_stringmap_set((as_map*)bins, lua_tostring(L, -2), val);
+			}
+		}
+
+		lua_pop(L, 1);
+	}
+
+	standin_rec* rec = standin_find(si, si->cur_digest);
+
+	if (! rec) {
+		rec = standin_create(si, si->cur_ns, si->cur_set, si->cur_digest);
+
+		if (! rec) {
+			as_hashmap_destroy(bins);
+			return luaL_error(L, "out of memory");
+		}
+	}
+	else {
+		as_hashmap_destroy(rec->bins);
+	}
+
+	rec->bins = bins;
+	rec->gen++;
+
+	if (lua_isnumber(L, 3)) {
+		lua_Number ttl = lua_tonumber(L, 3);
+
+		if (ttl < 0) {
+			rec->void_time = 0;
+		}
+		else if (ttl == 0) {
+			rec->void_time = si->default_ttl == 0 ? 0 :
+					(uint32_t)as_expbin_now() + si->default_ttl;
+		}
+		else {
+			rec->void_time = (uint32_t)as_expbin_now() + (uint32_t)ttl;
+		}
+	}
+
+	lua_pushnumber(L, (lua_Number)standin_ttl(rec));
+	return 1;
+}
+
+// log(level, message)
+static int
+standin_lua_log(lua_State* L)
+{
+	as_expbin_standin* si = (as_expbin_standin*)lua_touserdata(L,
+			lua_upvalueindex(1));
+
+	if (si->log) {
+		fprintf(si->log, "lua(%d): %s\n", (int)luaL_checkinteger(L, 1),
+				luaL_checkstring(L, 2));
+	}
+
+	return 0;
+}
+
+
+//==========================================================
+// Local Helpers - record store
+//
+
+static inline standin_rec**
+standin_bucket(as_expbin_standin* si, const uint8_t* digest)
+{
+	uint32_t h;
+
+	memcpy(&h, digest, sizeof(h));
+	return &si->buckets[h & (STANDIN_BUCKETS - 1)];
+}
+
+// Find a live record, removing it if it has expired.
+static standin_rec*
+standin_find(as_expbin_standin* si, const uint8_t* digest)
+{
+	standin_rec** p = standin_bucket(si, digest);
+
+	for (standin_rec* rec = *p; rec; p = &rec->next, rec = rec->next) {
+		if (memcmp(rec->digest, digest, AS_DIGEST_VALUE_SIZE) != 0) {
+			continue;
+		}
+
+		if (rec->void_time != 0 && as_expbin_now() >= rec->void_time) {
+			*p = rec->next;
+			as_hashmap_destroy(rec->bins);
+			free(rec);
+			si->n_records--;
+			return NULL;
+		}
+
+		return rec;
+	}
+
+	return NULL;
+}
+
+static standin_rec*
+standin_create(as_expbin_standin* si, const char* ns, const char* set,
+		const uint8_t* digest)
+{
+	standin_rec* rec = calloc(1, sizeof(standin_rec));
+
+	if (! rec) {
+		return NULL;
+	}
+
+	standin_rec** p = standin_bucket(si, digest);
+
+	memcpy(rec->digest, digest, AS_DIGEST_VALUE_SIZE);
+	strncpy(rec->ns, ns, sizeof(rec->ns) - 1);
+
+	if (set) {
+		strncpy(rec->set, set, sizeof(rec->set) - 1);
+	}
+
+	rec->void_time = si->default_ttl == 0 ? 0 :
+			(uint32_t)as_expbin_now() + si->default_ttl;
+	rec->next = *p;
+	*p = rec;
+	si->n_records++;
+
+	return rec;
+}
+
+static void
+standin_remove(as_expbin_standin* si, const uint8_t* digest)
+{
+	standin_rec** p = standin_bucket(si, digest);
+
+	for (standin_rec* rec = *p; rec; p = &rec->next, rec = rec->next) {
+		if (memcmp(rec->digest, digest, AS_DIGEST_VALUE_SIZE) == 0) {
+			*p = rec->next;
+			as_hashmap_destroy(rec->bins);
+			free(rec);
+			si->n_records--;
+			return;
+		}
+	}
+}
+
+static uint32_t
+standin_ttl(const standin_rec* rec)
+{
+	if (rec->void_time == 0) {
+		return STANDIN_TTL_NEVER;
+	}
+
+	return rec->void_time - (uint32_t)as_expbin_now();
+}
+
+
+//==========================================================
+// Local Helpers - value conversion
+//
+
+static void
+standin_push_val(as_expbin_standin* si, lua_State* L, const as_val* val)
+{
+	lua_checkstack(L, 8);
+
+	switch (as_val_type(val)) {
+	case AS_BOOLEAN:
+		lua_pushboolean(L, as_boolean_get((as_boolean*)val));
+		break;
+	case AS_INTEGER:
+		lua_pushnumber(L, (lua_Number)as_integer_get((as_integer*)val));
+		break;
+	case AS_DOUBLE:
+		lua_pushnumber(L, as_double_get((as_double*)val));
+		break;
+	case AS_STRING:
+		lua_pushstring(L, as_string_get((as_string*)val));
+		break;
+	case AS_BYTES: {
+		as_bytes* b = (as_bytes*)val;
+
+		standin_push_new(si, L, "bytes");
+		lua_getfield(L, -1, "v");
+
+		for (uint32_t i = 0; i < b->size; i++) {
+			lua_pushinteger(L, b->value[i]);
+			lua_rawseti(L, -2, (int)i + 1);
+		}
+
+		lua_pop(L, 1);
+		lua_pushinteger(L, b->size);
+		lua_setfield(L, -2, "n");
+		lua_pop(L, 1);
+		break;
+	}
+	case AS_LIST: {
+		as_list* list = (as_list*)val;
+		uint32_t n = as_list_size(list);
+
+		standin_push_new(si, L, "list");
+		lua_getfield(L, -1, "v");
+
+		for (uint32_t i = 0; i < n; i++) {
+			standin_push_val(si, L, as_list_get(list, i));
+			lua_rawseti(L, -2, (int)i + 1);
+		}
+
+		lua_pop(L, 1);
+		lua_pushinteger(L, n);
+		lua_setfield(L, -2, "n");
+		lua_pop(L, 1);
+		break;
+	}
+	case AS_MAP: {
+		as_map* map = (as_map*)val;
+		standin_push push = { si, L };
+
+		standin_push_new(si, L, "map");
+		lua_getfield(L, -1, "v");
+		as_map_foreach(map, standin_push_entry, &push);
+		lua_pop(L, 1);
+		lua_pushinteger(L, as_map_size(map));
+		lua_setfield(L, -2, "n");
+		lua_pop(L, 1);
+		break;
+	}
+	default:
+		lua_pushnil(L);
+		break;
+	}
+}
+
+// Set key = val in the table on top of the stack.
+static bool
+standin_push_entry(const as_val* key, const as_val* val, void* udata)
+{
+	standin_push* push = (standin_push*)udata;
+
+	standin_push_val(push->si, push->L, key);
+	standin_push_val(push->si, push->L, val);
+	lua_rawset(push->L, -3);
+	return true;
+}
+
+// Push a new proxy of kind and its backing table.
+static void
+standin_push_new(as_expbin_standin* si, lua_State* L, const char* kind)
+{
+	lua_rawgeti(L, LUA_REGISTRYINDEX, si->new_ref);
+	lua_pushstring(L, kind);
+	lua_call(L, 1, 2);
+}
+
+// Convert the Lua value at absolute index idx. Returns NULL for nil and for
+// values with no as_val form.
+static as_val*
+standin_to_val(as_expbin_standin* si, lua_State* L, int idx)
+{
+	lua_checkstack(L, 8);
+
+	switch (lua_type(L, idx)) {
+	case LUA_TBOOLEAN:
+		return (as_val*)as_boolean_new(lua_toboolean(L, idx));
+	case LUA_TNUMBER: {
+		lua_Number d = lua_tonumber(L, idx);
+
+		if (d == floor(d) && d >= -9.2e18 && d <= 9.2e18) {
+			return (as_val*)as_integer_new((int64_t)d);
+		}
+
+		return (as_val*)as_double_new(d);
+	}
+	case LUA_TSTRING:
+		return (as_val*)as_string_new_strdup(lua_tostring(L, idx));
+	case LUA_TUSERDATA:
+		break;
+	default:
+		return NULL;
+	}
+
+	// A map, list or bytes proxy - read its backing table.
+	lua_rawgeti(L, LUA_REGISTRYINDEX, si->data_ref);
+	lua_pushvalue(L, idx);
+	lua_rawget(L, -2);
+	lua_remove(L, -2);
+
+	int t = lua_gettop(L);
+
+	if (! lua_istable(L, t)) {
+		lua_pop(L, 1);
+		return NULL;
+	}
+
+	lua_getfield(L, t, "kind");
+	lua_getfield(L, t, "n");
+	lua_getfield(L, t, "v");
+
+	const char* kind = lua_tostring(L, t + 1);
+	uint32_t n = (uint32_t)lua_tointeger(L, t + 2);
+	int v = t + 3;
+	as_val* result = NULL;
+
+	if (strcmp(kind, "bytes") == 0) {
+		uint8_t* buf = malloc(n ? n : 1);
+
+		for (uint32_t i = 0; i < n; i++) {
+			lua_rawgeti(L, v, (int)i + 1);
+			buf[i] = (uint8_t)lua_tointeger(L, -1);
+			lua_pop(L, 1);
+		}
+
+		result = (as_val*)as_bytes_new_wrap(buf, n, true);
+	}
+	else if (strcmp(kind, "list") == 0) {
+		as_arraylist* list = as_arraylist_new(n ? n : 1, 0);
+
+		for (uint32_t i = 0; i < n; i++) {
+			lua_rawgeti(L, v, (int)i + 1);
+
+			as_val* elem = standin_to_val(si, L, lua_gettop(L));
+
+			as_arraylist_append(list, elem ? elem : (as_val*)&as_nil);
+			lua_pop(L, 1);
+		}
+
+		result = (as_val*)list;
+	}
+	else if (strcmp(kind, "map") == 0) {
+		as_hashmap* map = as_hashmap_new(n ? n : 1);
+
+		lua_pushnil(L);
+
+		while (lua_next(L, v) != 0) {
+			as_val* key = standin_to_val(si, L, lua_gettop(L) - 1);
+			as_val* val = standin_to_val(si, L, lua_gettop(L));
+
+			if (key && val) {
+				as_hashmap_set(map, key, val);
+			}
+			else {
+				as_val_destroy(key);
+				as_val_destroy(val);
+			}
+
+			lua_pop(L, 1);
+		}
+
+		result = (as_val*)map;
+	}
+
+	lua_settop(L, t - 1);
+	return result;
+}
+
+static bool
+standin_set_bin(const as_val* key, const as_val* val, void* udata)
+{
+	as_record* r = (as_record*)udata;
+
+	as_record_set(r, as_string_get((as_string*)key),
+			(as_bin_value*)as_val_reserve((as_val*)val));
+	return true;
+}
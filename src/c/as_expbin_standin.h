@@ -0,0 +1,88 @@
+/*******************************************************************************
+ * Copyright 2008-2015 by Aerospike.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ ******************************************************************************/
+
+
+#pragma once
+
+// An in-process stand-in for an Aerospike node. It runs the expire bin Lua
+// module in an embedded Lua VM against an in-memory record store, so the
+// full C to Lua path runs without a server.
+
+//==========================================================
+// Includes
+//
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "as_expbin.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//==========================================================
+// Typedefs
+//
+
+typedef struct as_expbin_standin_s as_expbin_standin;
+
+//==========================================================
+// Public API
+//
+
+/*
+ * Create an empty stand-in. Calls into it are serialized, one at a time, on
+ * a single Lua VM.
+ *
+ * Differences from a server: Lua numbers are doubles, so integers beyond
+ * 2^53 lose precision. Records get default_ttl when created and keep their
+ * expiry when updated, whatever the policy says. Scans run in the calling
+ * thread before the call returns.
+ *
+ * \param default_ttl - Record TTL in seconds, as the namespace default-ttl,
+ *                      or 0 for records that never expire.
+ * \return            - The stand-in, or NULL if the Lua VM failed to start.
+ */
+as_expbin_standin* as_expbin_standin_new(uint32_t default_ttl);
+
+/*
+ * Destroy a stand-in and every record in it. Detach handles first.
+ */
+void as_expbin_standin_destroy(as_expbin_standin* si);
+
+/*
+ * Route a handle's synchronous operations into the stand-in, see
+ * as_expbin_transport. Register the module afterwards with
+ * as_expbin_register(), exactly as against a server.
+ */
+void as_expbin_standin_attach(as_expbin_standin* si, as_expbin* eb);
+
+/*
+ * Send the module's warn, info, debug and trace output to out, or discard it
+ * if out is NULL, the default.
+ */
+void as_expbin_standin_log(as_expbin_standin* si, FILE* out);
+
+#ifdef __cplusplus
+} // end extern "C"
+#endif
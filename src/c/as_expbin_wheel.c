@@ -0,0 +1,255 @@
+/*******************************************************************************
+ * Copyright 2008-2015 by Aerospike.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ ******************************************************************************/
+
+
+
+//==========================================================
+// Includes
+//
+
+#include "as_expbin_wheel.h"
+
+#include <string.h>
+
+
+//==========================================================
+// Constants
+//
+
+#define WHEEL_MASK (AS_EXPBIN_WHEEL_SLOTS - 1)
+#define WHEEL_SLOT_DUE 0xFFFF
+
+
+//==========================================================
+// Forward Declarations
+//
+
+static inline void wheel_link(as_expbin_wheel* wheel, as_expbin_timer* timer);
+static inline void wheel_unlink(as_expbin_wheel* wheel, as_expbin_timer* timer);
+static inline void wheel_push(as_expbin_timer* head, as_expbin_timer* timer);
+static void wheel_cascade(as_expbin_wheel* wheel, uint32_t level);
+static uint32_t wheel_fire(as_expbin_wheel* wheel, as_expbin_timer* head, as_expbin_wheel_fn fn, void* udata);
+static uint32_t wheel_next_slot(const as_expbin_wheel* wheel, uint32_t from);
+
+
+//==========================================================
+// Public API
+//
+
+void
+as_expbin_wheel_init(as_expbin_wheel* wheel, uint32_t now)
+{
+	wheel->now = now;
+	wheel->count = 0;
+	wheel->due.next = wheel->due.prev = &wheel->due;
+	memset(wheel->occupied, 0, sizeof(wheel->occupied));
+
+	for (uint32_t l = 0; l < AS_EXPBIN_WHEEL_LEVELS; l++) {
+		for (uint32_t s = 0; s < AS_EXPBIN_WHEEL_SLOTS; s++) {
+			as_expbin_timer* head = &wheel->slots[l][s];
+			head->next = head->prev = head;
+		}
+	}
+}
+
+void
+as_expbin_wheel_insert(as_expbin_wheel* wheel, as_expbin_timer* timer, uint32_t expiry)
+{
+	if (as_expbin_timer_pending(timer)) {
+		wheel_unlink(wheel, timer);
+	}
+	else {
+		wheel->count++;
+	}
+
+	timer->expiry = expiry;
+	wheel_link(wheel, timer);
+}
+
+void
+as_expbin_wheel_cancel(as_expbin_wheel* wheel, as_expbin_timer* timer)
+{
+	if (as_expbin_timer_pending(timer)) {
+		wheel_unlink(wheel, timer);
+		wheel->count--;
+	}
+}
+
+uint32_t
+as_expbin_wheel_advance(as_expbin_wheel* wheel, uint32_t now, as_expbin_wheel_fn fn, void* udata)
+{
+	uint32_t fired = wheel_fire(wheel, &wheel->due, fn, udata);
+
+	while (wheel->now < now) {
+		if (wheel->count == 0) {
+			wheel->now = now;
+			break;
+		}
+
+		// Jump straight to the next occupied level 0 slot, or to the end of
+		// this level 0 revolution, where the higher levels cascade.
+		uint32_t base = wheel->now & ~(uint32_t)WHEEL_MASK;
+		uint32_t slot = wheel_next_slot(wheel, (wheel->now & WHEEL_MASK) + 1);
+		uint64_t next = (uint64_t)base + slot;
+
+		if (next > now) {
+			wheel->now = now;
+			break;
+		}
+
+		uint32_t tick = (uint32_t)next;
+
+		wheel->now = tick;
+
+		if (slot == AS_EXPBIN_WHEEL_SLOTS) {
+			// Cascade from the top so timers fall through every level that
+			// turns over on this tick.
+			for (uint32_t l = AS_EXPBIN_WHEEL_LEVELS - 1; l > 0; l--) {
+				uint32_t low = tick & ((1u << (l * AS_EXPBIN_WHEEL_BITS)) - 1);
+
+				if (low == 0) {
+					wheel_cascade(wheel, l);
+				}
+			}
+
+			fired += wheel_fire(wheel, &wheel->due, fn, udata);
+		}
+
+		fired += wheel_fire(wheel, &wheel->slots[0][tick & WHEEL_MASK], fn, udata);
+	}
+
+	return fired;
+}
+
+
+//==========================================================
+// Local Helpers
+//
+
+static inline void
+wheel_link(as_expbin_wheel* wheel, as_expbin_timer* timer)
+{
+	uint32_t expiry = timer->expiry;
+
+	if (expiry <= wheel->now) {
+		timer->slot = WHEEL_SLOT_DUE;
+		wheel_push(&wheel->due, timer);
+		return;
+	}
+
+	// The level is the highest 8 bit group in which expiry and now differ,
+	// so a timer only cascades once that group of the clock catches up.
+	uint32_t diff = expiry ^ wheel->now;
+	uint32_t level = 0;
+
+	while (level < AS_EXPBIN_WHEEL_LEVELS - 1 &&
+			diff >> ((level + 1) * AS_EXPBIN_WHEEL_BITS) != 0) {
+		level++;
+	}
+
+	uint32_t slot = (expiry >> (level * AS_EXPBIN_WHEEL_BITS)) & WHEEL_MASK;
+
+	timer->slot = (uint16_t)(level * AS_EXPBIN_WHEEL_SLOTS + slot);
+	wheel_push(&wheel->slots[level][slot], timer);
+
+	if (level == 0) {
+		wheel->occupied[slot / 64] |= 1ULL << (slot % 64);
+	}
+}
+
+static inline void
+wheel_unlink(as_expbin_wheel* wheel, as_expbin_timer* timer)
+{
+	as_expbin_timer* next = timer->next;
+
+	timer->prev->next = next;
+	next->prev = timer->prev;
+	timer->next = timer->prev = NULL;
+
+	// Keep the level 0 occupancy exact so advance never visits empty slots.
+	if (timer->slot < AS_EXPBIN_WHEEL_SLOTS && next == next->prev) {
+		uint32_t slot = timer->slot;
+		wheel->occupied[slot / 64] &= ~(1ULL << (slot % 64));
+	}
+}
+
+static inline void
+wheel_push(as_expbin_timer* head, as_expbin_timer* timer)
+{
+	timer->next = head;
+	timer->prev = head->prev;
+	head->prev->next = timer;
+	head->prev = timer;
+}
+
+static void
+wheel_cascade(as_expbin_wheel* wheel, uint32_t level)
+{
+	uint32_t slot = (wheel->now >> (level * AS_EXPBIN_WHEEL_BITS)) & WHEEL_MASK;
+	as_expbin_timer* head = &wheel->slots[level][slot];
+	as_expbin_timer* timer = head->next;
+
+	head->next = head->prev = head;
+
+	while (timer != head) {
+		as_expbin_timer* next = timer->next;
+
+		wheel_link(wheel, timer);
+		timer = next;
+	}
+}
+
+static uint32_t
+wheel_fire(as_expbin_wheel* wheel, as_expbin_timer* head, as_expbin_wheel_fn fn, void* udata)
+{
+	uint32_t fired = 0;
+
+	// Unlink before each call, the callback may re-insert or free the timer.
+	while (head->next != head) {
+		as_expbin_timer* timer = head->next;
+
+		wheel_unlink(wheel, timer);
+		wheel->count--;
+		fired++;
+		fn(timer, udata);
+	}
+
+	return fired;
+}
+
+static uint32_t
+wheel_next_slot(const as_expbin_wheel* wheel, uint32_t from)
+{
+	for (uint32_t w = from / 64; w < AS_EXPBIN_WHEEL_SLOTS / 64; w++) {
+		uint64_t bits = wheel->occupied[w];
+
+		if (w == from / 64) {
+			bits &= ~0ULL << (from % 64);
+		}
+
+		if (bits != 0) {
+			return w * 64 + (uint32_t)__builtin_ctzll(bits);
+		}
+	}
+
+	return AS_EXPBIN_WHEEL_SLOTS;
+}
@@ -0,0 +1,147 @@
+/*******************************************************************************
+ * Copyright 2008-2015 by Aerospike.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ ******************************************************************************/
+
+#pragma once
+
+//==========================================================
+// Includes
+//
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//==========================================================
+// Constants
+//
+
+// Four levels of 256 slots cover the whole 32 bit range of expiry times, so
+// no overflow list is needed.
+#define AS_EXPBIN_WHEEL_LEVELS 4
+#define AS_EXPBIN_WHEEL_BITS 8
+#define AS_EXPBIN_WHEEL_SLOTS (1 << AS_EXPBIN_WHEEL_BITS)
+
+//==========================================================
+// Typedefs
+//
+
+/*
+ * A timer. Embed it in the object that expires and recover the object in the
+ * callback with AS_EXPBIN_TIMER_OWNER(). Zero it before first use. The wheel
+ * never allocates.
+ */
+typedef struct as_expbin_timer_s {
+	struct as_expbin_timer_s* next;
+	struct as_expbin_timer_s* prev;
+
+	// Expiry time, in the same seconds as the wheel's clock.
+	uint32_t expiry;
+
+	// Slot the timer is linked into, for cancel.
+	uint16_t slot;
+} as_expbin_timer;
+
+/*
+ * Called for each timer that fires. The timer is already unlinked and may be
+ * inserted again or freed.
+ */
+typedef void (*as_expbin_wheel_fn)(as_expbin_timer* timer, void* udata);
+
+/*
+ * Hierarchical timing wheel with seconds granularity. Insert and cancel are
+ * O(1). Advancing visits each due timer once, plus one cascade per timer per
+ * level it descends, and skips empty stretches of time. Not thread safe.
+ */
+typedef struct as_expbin_wheel_s {
+	// Every timer with expiry <= now has fired.
+	uint32_t now;
+
+	// Number of pending timers.
+	uint32_t count;
+
+	// Timers inserted already due. They fire on the next advance.
+	as_expbin_timer due;
+
+	// Occupancy of level 0, one bit per slot, for skipping empty slots.
+	uint64_t occupied[AS_EXPBIN_WHEEL_SLOTS / 64];
+
+	// List heads, one per slot per level.
+	as_expbin_timer slots[AS_EXPBIN_WHEEL_LEVELS][AS_EXPBIN_WHEEL_SLOTS];
+} as_expbin_wheel;
+
+//==========================================================
+// Public API
+//
+
+#define AS_EXPBIN_TIMER_OWNER(_timer, _type, _member) \
+	((_type*)((char*)(_timer) - offsetof(_type, _member)))
+
+/*
+ * Initialize a wheel.
+ *
+ * \param wheel - The wheel to initialize.
+ * \param now   - Current time, e.g. as_expbin_now().
+ */
+void as_expbin_wheel_init(as_expbin_wheel* wheel, uint32_t now);
+
+/*
+ * Schedule a timer, rescheduling it if it is already pending.
+ *
+ * \param wheel  - The wheel.
+ * \param timer  - The timer. Must stay valid until it fires or is cancelled.
+ * \param expiry - Time at which the timer fires. A time not after the wheel's
+ *                 clock fires on the next advance.
+ */
+void as_expbin_wheel_insert(as_expbin_wheel* wheel, as_expbin_timer* timer, uint32_t expiry);
+
+/*
+ * Cancel a pending timer. Does nothing if the timer is not pending.
+ */
+void as_expbin_wheel_cancel(as_expbin_wheel* wheel, as_expbin_timer* timer);
+
+/*
+ * Advance the wheel's clock, firing every timer that expires on the way.
+ *
+ * \param wheel - The wheel.
+ * \param now   - New time. Moving backwards only fires already due timers.
+ * \param fn    - Called for each timer that fires.
+ * \param udata - Passed to fn.
+ * \return      - Number of timers fired.
+ */
+uint32_t as_expbin_wheel_advance(as_expbin_wheel* wheel, uint32_t now, as_expbin_wheel_fn fn, void* udata);
+
+/*
+ * Check whether a timer is pending. A zeroed timer is not.
+ */
+static inline bool
+as_expbin_timer_pending(const as_expbin_timer* timer)
+{
+	return timer->next != NULL;
+}
+
+#ifdef __cplusplus
+} // end extern "C"
+#endif
@@ -0,0 +1,1012 @@
+/*******************************************************************************
+ * Copyright 2008-2015 by Aerospike.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ ******************************************************************************/
+
+
+
+//==========================================================
+// Includes
+//
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <aerospike/aerospike.h>
+#include <aerospike/aerospike_key.h>
+#include <aerospike/as_arraylist.h>
+#include <aerospike/as_batch.h>
+#include <aerospike/as_bytes.h>
+#include <aerospike/as_config.h>
+#include <aerospike/as_map.h>
+
+#include "as_expbin.h"
+#include "as_expbin_standin.h"
+
+
+//==========================================================
+// Constants
+//
+
+#define BENCH_MAX_BINS 64
+#define BENCH_MAX_TTLS 16
+#define BENCH_BIN_NAME_SIZE 16
+
+// Record TTL of the stand-in, the server's default-ttl default.
+#define BENCH_STANDIN_TTL (30 * 86400)
+
+// Latencies go in log2 buckets of nanoseconds, each split into 16 linear
+// sub-buckets, so a reported percentile is within 1/16 of the true value.
+#define HIST_SUB_BITS 4
+#define HIST_SUBS (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS (64 * HIST_SUBS)
+
+typedef enum bench_op_e {
+	OP_PUT,
+	OP_PUTS,
+	OP_GET,
+	OP_TOUCH,
+	OP_TTL,
+	OP_CLEAN,
+	OP_MANY,
+	OP_MAX
+} bench_op;
+
+static const char* const OP_NAMES[OP_MAX] = {
+	"put", "puts", "get", "touch", "ttl", "clean", "many"
+};
+
+
+//==========================================================
+// Typedefs
+//
+
+typedef struct bench_config_s {
+	const char* host;
+	int port;
+	const char* ns;
+	const char* set;
+	const char* udf_path;
+	const char* json_path;
+	uint32_t threads;
+	uint32_t keys;
+	uint32_t bins;
+	uint32_t value_size;
+	uint32_t duration;
+	uint32_t batch;
+	uint32_t cache_mb;
+	uint32_t repair;
+	bool load;
+	bool native;
+	bool compact;
+	bool standin;
+	bool slots;
+
+	uint32_t op_weights[OP_MAX];
+	uint32_t op_total;
+
+	int64_t ttls[BENCH_MAX_TTLS];
+	uint32_t ttl_weights[BENCH_MAX_TTLS];
+	uint32_t n_ttls;
+	uint32_t ttl_total;
+} bench_config;
+
+typedef struct bench_hist_s {
+	uint64_t counts[HIST_BUCKETS];
+	uint64_t n;
+	uint64_t max;
+} bench_hist;
+
+typedef struct bench_stats_s {
+	bench_hist hist[OP_MAX];
+
+	// ok + miss + errors == hist.n. A miss is a read of a missing record or
+	// bin, which is expected once bins start expiring.
+	uint64_t ok[OP_MAX];
+	uint64_t miss[OP_MAX];
+	uint64_t errors[OP_MAX];
+
+	as_error first_err;
+} bench_stats;
+
+typedef struct bench_thread_s {
+	pthread_t thread;
+	uint32_t id;
+	as_expbin* eb;
+	const bench_config* cfg;
+	uint64_t seed;
+	uint8_t* value;
+	as_expbin_args* args;
+	bench_stats stats;
+} bench_thread;
+
+
+//==========================================================
+// Globals
+//
+
+static char g_bin_names[BENCH_MAX_BINS][BENCH_BIN_NAME_SIZE];
+static const char* g_bins[BENCH_MAX_BINS + 1];
+
+
+//==========================================================
+// Forward Declarations
+//
+
+static bool bench_connect(const bench_config* cfg, aerospike* as);
+static int bench_run(const bench_config* cfg, as_expbin* eb);
+static void bench_usage(const char* prog);
+static bool bench_parse_ops(bench_config* cfg, const char* spec);
+static bool bench_parse_ttls(bench_config* cfg, const char* spec);
+static void* bench_load_thread(void* udata);
+static void* bench_run_thread(void* udata);
+static as_status bench_do(bench_thread* t, bench_op op, as_error* err);
+static void bench_key(bench_thread* t, uint32_t k, as_key* key);
+static int64_t bench_pick_ttl(bench_thread* t);
+static uint32_t bench_rand(uint64_t* seed);
+static uint64_t bench_nanos(void);
+static void hist_add(bench_hist* h, uint64_t v);
+static void hist_merge(bench_hist* into, const bench_hist* from);
+static double hist_percentile(const bench_hist* h, double p);
+static void bench_report(const bench_config* cfg, const bench_stats* total, double secs);
+static bool bench_report_json(const bench_config* cfg, const bench_stats* total, double secs);
+
+
+//==========================================================
+// Expire Bin Benchmark
+//
+
+int
+main(int argc, char* argv[])
+{
+	bench_config cfg = {
+		.host = "127.0.0.1",
+		.port = 3000,
+		.ns = "test",
+		.set = "expbin_bench",
+		.udf_path = "../../" AS_EXPBIN_MODULE ".lua",
+		.threads = 4,
+		.keys = 10000,
+		.bins = 4,
+		.value_size = 16,
+		.duration = 10,
+		.batch = 100,
+		.load = true
+	};
+
+	bench_parse_ops(&cfg, "put:20,puts:10,get:40,touch:10,ttl:20");
+	bench_parse_ttls(&cfg, "60:40,3600:40,-1:20");
+
+	int c;
+
+	while ((c = getopt(argc, argv, "h:p:n:s:u:t:k:b:v:d:m:c:r:o:T:j:LNCSD")) != -1) {
+		switch (c) {
+		case 'h':
+			cfg.host = optarg;
+			break;
+		case 'p':
+			cfg.port = atoi(optarg);
+			break;
+		case 'n':
+			cfg.ns = optarg;
+			break;
+		case 's':
+			cfg.set = optarg;
+			break;
+		case 'u':
+			cfg.udf_path = optarg;
+			break;
+		case 't':
+			cfg.threads = (uint32_t)strtoul(optarg, NULL, 10);
+			break;
+		case 'k':
+			cfg.keys = (uint32_t)strtoul(optarg, NULL, 10);
+			break;
+		case 'b':
+			cfg.bins = (uint32_t)strtoul(optarg, NULL, 10);
+			break;
+		case 'v':
+			cfg.value_size = (uint32_t)strtoul(optarg, NULL, 10);
+			break;
+		case 'd':
+			cfg.duration = (uint32_t)strtoul(optarg, NULL, 10);
+			break;
+		case 'm':
+			cfg.batch = (uint32_t)strtoul(optarg, NULL, 10);
+			break;
+		case 'c':
+			cfg.cache_mb = (uint32_t)strtoul(optarg, NULL, 10);
+			break;
+		case 'r':
+			cfg.repair = (uint32_t)strtoul(optarg, NULL, 10);
+			break;
+		case 'o':
+			if (! bench_parse_ops(&cfg, optarg)) {
+				fprintf(stderr, "bad operation mix: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'T':
+			if (! bench_parse_ttls(&cfg, optarg)) {
+				fprintf(stderr, "bad ttl mix: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'j':
+			cfg.json_path = optarg;
+			break;
+		case 'L':
+			cfg.load = false;
+			break;
+		case 'N':
+			cfg.native = true;
+			break;
+		case 'C':
+			cfg.compact = true;
+			break;
+		case 'S':
+			cfg.standin = true;
+			break;
+		case 'D':
+			cfg.slots = true;
+			break;
+		default:
+			bench_usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (cfg.threads == 0 || cfg.keys == 0 || cfg.duration == 0 ||
+			cfg.batch == 0 || cfg.bins == 0 || cfg.bins > BENCH_MAX_BINS) {
+		bench_usage(argv[0]);
+		return 1;
+	}
+
+	for (uint32_t i = 0; i < cfg.bins; i++) {
+		snprintf(g_bin_names[i], BENCH_BIN_NAME_SIZE, "bin%u", i);
+		g_bins[i] = g_bin_names[i];
+	}
+
+	g_bins[cfg.bins] = NULL;
+
+	aerospike as;
+	as_error err;
+	as_expbin eb;
+	as_expbin_standin* standin = NULL;
+
+	if (cfg.standin) {
+		standin = as_expbin_standin_new(BENCH_STANDIN_TTL);
+
+		if (! standin) {
+			fprintf(stderr, "stand-in failed to start\n");
+			return 1;
+		}
+	}
+	else if (! bench_connect(&cfg, &as)) {
+		return 1;
+	}
+
+	int rc = 1;
+
+	if (as_expbin_init(&eb, standin ? NULL : &as, cfg.ns, cfg.set)) {
+		if (standin) {
+			as_expbin_standin_attach(standin, &eb);
+		}
+
+		eb.read_mode = cfg.native ? AS_EXPBIN_READ_NATIVE : AS_EXPBIN_READ_UDF;
+		eb.format = cfg.compact ? AS_EXPBIN_FORMAT_COMPACT : AS_EXPBIN_FORMAT_MAP;
+		eb.repair_min_bytes = cfg.repair;
+
+		// Measure the module as it would run in production, debug lines off.
+		eb.log_level = AS_EXPBIN_LOG_OFF;
+
+		if (cfg.cache_mb != 0) {
+			as_expbin_cache_config cache_cfg;
+			as_expbin_cache_config_init(&cache_cfg);
+			cache_cfg.max_bytes = (uint64_t)cfg.cache_mb * 1024 * 1024;
+			eb.cache = as_expbin_cache_new(&cache_cfg);
+		}
+
+		if (as_expbin_register(&eb, &err, cfg.udf_path) == AEROSPIKE_OK) {
+			rc = bench_run(&cfg, &eb);
+		}
+		else {
+			fprintf(stderr, "register %s failed: %d - %s\n", cfg.udf_path,
+					err.code, err.message);
+		}
+
+		if (eb.cache) {
+			as_expbin_cache_stats stats;
+			as_expbin_cache_stats_get(eb.cache, &stats);
+			printf("cache: %" PRIu64 " hits %" PRIu64 " misses %" PRIu64
+					" evictions %" PRIu64 " invalidations %" PRIu64 " bytes\n",
+					stats.hits, stats.misses, stats.evictions,
+					stats.invalidations, stats.bytes);
+			as_expbin_cache_destroy(eb.cache);
+		}
+
+		if (cfg.repair != 0) {
+			as_expbin_repair_stats stats;
+			as_expbin_repair_stats_get(&eb, &stats);
+			printf("repair: %" PRIu64 " gets %" PRIu64 " bins %" PRIu64
+					" bytes\n", stats.repairs, stats.bins, stats.bytes);
+		}
+
+		as_expbin_destroy(&eb);
+	}
+	else {
+		fprintf(stderr, "bad namespace or set name\n");
+	}
+
+	if (standin) {
+		as_expbin_standin_destroy(standin);
+	}
+	else {
+		aerospike_close(&as, &err);
+		aerospike_destroy(&as);
+	}
+
+	return rc;
+}
+
+
+//==========================================================
+// Local Helpers
+//
+
+static bool
+bench_connect(const bench_config* cfg, aerospike* as)
+{
+	as_config config;
+	as_error err;
+
+	as_config_init(&config);
+	as_config_add_host(&config, cfg->host, cfg->port);
+	aerospike_init(as, &config);
+
+	if (aerospike_connect(as, &err) != AEROSPIKE_OK) {
+		fprintf(stderr, "connect to %s:%d failed: %d - %s\n", cfg->host,
+				cfg->port, err.code, err.message);
+		aerospike_destroy(as);
+		return false;
+	}
+
+	return true;
+}
+
+static int
+bench_run(const bench_config* cfg, as_expbin* eb)
+{
+	bench_thread* threads = calloc(cfg->threads, sizeof(bench_thread));
+	bench_stats* total = calloc(1, sizeof(bench_stats));
+
+	if (! threads || ! total) {
+		fprintf(stderr, "out of memory\n");
+		free(threads);
+		free(total);
+		return 1;
+	}
+
+	for (uint32_t i = 0; i < cfg->threads; i++) {
+		bench_thread* t = &threads[i];
+
+		t->id = i;
+		t->eb = eb;
+		t->cfg = cfg;
+		t->seed = 0x9E3779B97F4A7C15ULL * (i + 1);
+		t->value = malloc(cfg->value_size ? cfg->value_size : 1);
+		t->args = as_expbin_args_new(cfg->bins);
+
+		for (uint32_t b = 0; b < cfg->value_size; b++) {
+			t->value[b] = (uint8_t)bench_rand(&t->seed);
+		}
+	}
+
+	if (cfg->load) {
+		uint64_t start = bench_nanos();
+
+		for (uint32_t i = 0; i < cfg->threads; i++) {
+			pthread_create(&threads[i].thread, NULL, bench_load_thread,
+					&threads[i]);
+		}
+
+		uint64_t errors = 0;
+
+		for (uint32_t i = 0; i < cfg->threads; i++) {
+			pthread_join(threads[i].thread, NULL);
+			errors += threads[i].stats.errors[OP_PUTS];
+		}
+
+		printf("loaded %u records x %u bins in %.2f s, %" PRIu64 " errors\n",
+				cfg->keys, cfg->bins, (bench_nanos() - start) / 1e9, errors);
+
+		for (uint32_t i = 0; i < cfg->threads; i++) {
+			memset(&threads[i].stats, 0, sizeof(bench_stats));
+		}
+	}
+
+	uint64_t start = bench_nanos();
+
+	for (uint32_t i = 0; i < cfg->threads; i++) {
+		pthread_create(&threads[i].thread, NULL, bench_run_thread, &threads[i]);
+	}
+
+	for (uint32_t i = 0; i < cfg->threads; i++) {
+		pthread_join(threads[i].thread, NULL);
+	}
+
+	double secs = (bench_nanos() - start) / 1e9;
+
+	for (uint32_t i = 0; i < cfg->threads; i++) {
+		bench_stats* s = &threads[i].stats;
+
+		for (uint32_t op = 0; op < OP_MAX; op++) {
+			hist_merge(&total->hist[op], &s->hist[op]);
+			total->ok[op] += s->ok[op];
+			total->miss[op] += s->miss[op];
+			total->errors[op] += s->errors[op];
+		}
+
+		if (total->first_err.code == AEROSPIKE_OK) {
+			total->first_err = s->first_err;
+		}
+
+		free(threads[i].value);
+		as_expbin_args_destroy(threads[i].args);
+	}
+
+	bench_report(cfg, total, secs);
+
+	int rc = cfg->json_path && ! bench_report_json(cfg, total, secs) ? 1 : 0;
+
+	free(total);
+	free(threads);
+	return rc;
+}
+
+static void
+bench_usage(const char* prog)
+{
+	fprintf(stderr,
+			"usage: %s [options]\n"
+			"  -h host      server host (127.0.0.1)\n"
+			"  -p port      server port (3000)\n"
+			"  -n ns        namespace (test)\n"
+			"  -s set       set (expbin_bench)\n"
+			"  -u path      path of expire_bin.lua (../../expire_bin.lua)\n"
+			"  -t threads   worker threads (4)\n"
+			"  -k keys      key space (10000)\n"
+			"  -b bins      bins per record, at most %d (4)\n"
+			"  -v bytes     value size (16)\n"
+			"  -d secs      run time (10)\n"
+			"  -m keys      keys per many, a batch get_many (100)\n"
+			"  -c MiB       client read cache for get, 0 for none (0)\n"
+			"  -r bytes     read repair threshold for get, 0 for none (0)\n"
+			"  -o mix       operation weights (put:20,puts:10,get:40,touch:10,ttl:20)\n"
+			"               clean runs a full scan per operation, weigh it lightly\n"
+			"  -T mix       bin ttl weights, -1 never, none normal bin (60:40,3600:40,-1:20)\n"
+			"  -j path      also write the results as JSON, - for stdout\n"
+			"  -L           skip loading every record before the run\n"
+			"  -N           native read mode for get and ttl, native touch\n"
+			"  -C           compact envelope format for writes\n"
+			"  -S           run against the in-process stand-in, not a server\n"
+			"  -D           get decodes into typed slots, see as_expbin_get_slots()\n",
+			prog, BENCH_MAX_BINS);
+}
+
+static bool
+bench_parse_ops(bench_config* cfg, const char* spec)
+{
+	uint32_t weights[OP_MAX] = { 0 };
+	uint32_t total = 0;
+	const char* p = spec;
+
+	while (*p) {
+		const char* colon = strchr(p, ':');
+
+		if (! colon) {
+			return false;
+		}
+
+		uint32_t op = 0;
+
+		while (op < OP_MAX && (strlen(OP_NAMES[op]) != (size_t)(colon - p) ||
+				strncmp(p, OP_NAMES[op], colon - p) != 0)) {
+			op++;
+		}
+
+		if (op == OP_MAX) {
+			return false;
+		}
+
+		char* end;
+		weights[op] = (uint32_t)strtoul(colon + 1, &end, 10);
+		total += weights[op];
+
+		if (*end != ',' && *end != '\0') {
+			return false;
+		}
+
+		p = *end ? end + 1 : end;
+	}
+
+	if (total == 0) {
+		return false;
+	}
+
+	memcpy(cfg->op_weights, weights, sizeof(weights));
+	cfg->op_total = total;
+	return true;
+}
+
+static bool
+bench_parse_ttls(bench_config* cfg, const char* spec)
+{
+	uint32_t n = 0;
+	uint32_t total = 0;
+	const char* p = spec;
+
+	while (*p) {
+		if (n == BENCH_MAX_TTLS) {
+			return false;
+		}
+
+		char* end;
+
+		if (strncmp(p, "none", 4) == 0) {
+			cfg->ttls[n] = AS_EXPBIN_TTL_NONE;
+			end = (char*)p + 4;
+		}
+		else {
+			cfg->ttls[n] = strtoll(p, &end, 10);
+
+			if (end == p || cfg->ttls[n] == 0 || cfg->ttls[n] < -1) {
+				return false;
+			}
+		}
+
+		if (*end != ':') {
+			return false;
+		}
+
+		p = end + 1;
+		cfg->ttl_weights[n] = (uint32_t)strtoul(p, &end, 10);
+		total += cfg->ttl_weights[n++];
+
+		if (*end != ',' && *end != '\0') {
+			return false;
+		}
+
+		p = *end ? end + 1 : end;
+	}
+
+	if (total == 0) {
+		return false;
+	}
+
+	cfg->n_ttls = n;
+	cfg->ttl_total = total;
+	return true;
+}
+
+static void*
+bench_load_thread(void* udata)
+{
+	bench_thread* t = (bench_thread*)udata;
+	const bench_config* cfg = t->cfg;
+	as_error err;
+
+	// Each thread loads its own slice of the key space with one puts per
+	// record.
+	for (uint32_t k = t->id; k < cfg->keys; k += cfg->threads) {
+		as_key key;
+		bench_key(t, k, &key);
+
+		as_bytes val;
+		as_bytes_init_wrap(&val, t->value, cfg->value_size, false);
+
+		for (uint32_t b = 0; b < cfg->bins; b++) {
+			as_expbin_args_add(t->args, g_bins[b], (as_val*)&val,
+					bench_pick_ttl(t));
+		}
+
+		if (as_expbin_puts(t->eb, &err, NULL, &key,
+				as_expbin_args_list(t->args)) != AEROSPIKE_OK) {
+			t->stats.errors[OP_PUTS]++;
+		}
+
+		as_expbin_args_reset(t->args);
+		as_bytes_destroy(&val);
+		as_key_destroy(&key);
+	}
+
+	return NULL;
+}
+
+static void*
+bench_run_thread(void* udata)
+{
+	bench_thread* t = (bench_thread*)udata;
+	const bench_config* cfg = t->cfg;
+	uint64_t end = bench_nanos() + (uint64_t)cfg->duration * 1000000000;
+	uint64_t now = bench_nanos();
+	as_error err;
+
+	while (now < end) {
+		uint32_t pick = bench_rand(&t->seed) % cfg->op_total;
+		bench_op op = 0;
+
+		while (pick >= cfg->op_weights[op]) {
+			pick -= cfg->op_weights[op++];
+		}
+
+		as_error_reset(&err);
+
+		as_status rc = bench_do(t, op, &err);
+		uint64_t done = bench_nanos();
+
+		hist_add(&t->stats.hist[op], done - now);
+
+		if (rc == AEROSPIKE_OK) {
+			t->stats.ok[op]++;
+		}
+		else if (rc == AEROSPIKE_ERR_RECORD_NOT_FOUND ||
+				rc == AEROSPIKE_ERR_BIN_NOT_FOUND) {
+			t->stats.miss[op]++;
+		}
+		else {
+			t->stats.errors[op]++;
+
+			if (t->stats.first_err.code == AEROSPIKE_OK) {
+				t->stats.first_err = err;
+			}
+		}
+
+		now = done;
+	}
+
+	return NULL;
+}
+
+static as_status
+bench_do(bench_thread* t, bench_op op, as_error* err)
+{
+	const bench_config* cfg = t->cfg;
+	const char* bin = g_bins[bench_rand(&t->seed) % cfg->bins];
+	as_status rc;
+
+	if (op == OP_CLEAN) {
+		return as_expbin_clean(t->eb, err, NULL, g_bins);
+	}
+
+	as_key key;
+	bench_key(t, bench_rand(&t->seed) % cfg->keys, &key);
+
+	switch (op) {
+	case OP_PUT: {
+		as_bytes val;
+		as_bytes_init_wrap(&val, t->value, cfg->value_size, false);
+		rc = as_expbin_put(t->eb, err, NULL, &key, bin, (as_val*)&val,
+				bench_pick_ttl(t));
+		as_bytes_destroy(&val);
+		break;
+	}
+	case OP_PUTS: {
+		as_bytes val;
+		as_bytes_init_wrap(&val, t->value, cfg->value_size, false);
+
+		for (uint32_t b = 0; b < cfg->bins; b++) {
+			as_expbin_args_add(t->args, g_bins[b], (as_val*)&val,
+					bench_pick_ttl(t));
+		}
+
+		rc = as_expbin_puts(t->eb, err, NULL, &key,
+				as_expbin_args_list(t->args));
+		as_expbin_args_reset(t->args);
+		as_bytes_destroy(&val);
+		break;
+	}
+	case OP_GET: {
+		if (cfg->slots) {
+			as_expbin_slot slots[cfg->bins];
+
+			for (uint32_t b = 0; b < cfg->bins; b++) {
+				slots[b].bin = g_bins[b];
+				slots[b].type = AS_EXPBIN_SLOT_VIEW;
+			}
+
+			as_record* rec = NULL;
+			rc = as_expbin_get_slots(t->eb, err, NULL, &key, slots, cfg->bins,
+					&rec);
+
+			if (rec) {
+				as_record_destroy(rec);
+			}
+			break;
+		}
+
+		as_map* result = NULL;
+		rc = as_expbin_get(t->eb, err, NULL, &key, g_bins, &result);
+
+		if (result) {
+			as_map_destroy(result);
+		}
+		break;
+	}
+	case OP_TOUCH: {
+		// Touch cannot turn a bin back into a normal bin, use never instead.
+		int64_t ttl = bench_pick_ttl(t);
+
+		if (ttl == AS_EXPBIN_TTL_NONE) {
+			ttl = AS_EXPBIN_TTL_NEVER;
+		}
+
+		as_expbin_args_add(t->args, bin, NULL, ttl);
+
+		if (cfg->native) {
+			// The stand-in is a transport, so this takes the module too.
+			rc = as_expbin_touch_native(t->eb, err, NULL, &key,
+					as_expbin_args_list(t->args), AS_EXPBIN_WRITE_DEFAULT);
+		}
+		else {
+			rc = as_expbin_touch(t->eb, err, NULL, &key,
+					as_expbin_args_list(t->args));
+		}
+
+		as_expbin_args_reset(t->args);
+		break;
+	}
+	case OP_MANY: {
+		as_batch batch;
+		as_batch_inita(&batch, cfg->batch);
+
+		for (uint32_t i = 0; i < cfg->batch; i++) {
+			bench_key(t, bench_rand(&t->seed) % cfg->keys,
+					as_batch_keyat(&batch, i));
+		}
+
+		as_map* results[cfg->batch];
+		rc = as_expbin_get_many(t->eb, err, NULL, &batch, g_bins, results);
+
+		if (rc == AEROSPIKE_OK) {
+			for (uint32_t i = 0; i < cfg->batch; i++) {
+				if (results[i]) {
+					as_map_destroy(results[i]);
+				}
+			}
+		}
+
+		as_batch_destroy(&batch);
+		break;
+	}
+	case OP_TTL: {
+		int64_t ttl;
+		rc = as_expbin_ttl(t->eb, err, NULL, &key, bin, &ttl);
+		break;
+	}
+	default:
+		rc = as_error_update(err, AEROSPIKE_ERR_PARAM, "bad op %d", op);
+		break;
+	}
+
+	as_key_destroy(&key);
+	return rc;
+}
+
+static void
+bench_key(bench_thread* t, uint32_t k, as_key* key)
+{
+	as_key_init_int64(key, t->eb->ns, t->eb->set, (int64_t)k);
+}
+
+static int64_t
+bench_pick_ttl(bench_thread* t)
+{
+	const bench_config* cfg = t->cfg;
+	uint32_t pick = bench_rand(&t->seed) % cfg->ttl_total;
+	uint32_t i = 0;
+
+	while (pick >= cfg->ttl_weights[i]) {
+		pick -= cfg->ttl_weights[i++];
+	}
+
+	return cfg->ttls[i];
+}
+
+static uint32_t
+bench_rand(uint64_t* seed)
+{
+	// xorshift64*
+	*seed ^= *seed >> 12;
+	*seed ^= *seed << 25;
+	*seed ^= *seed >> 27;
+	return (uint32_t)((*seed * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static uint64_t
+bench_nanos(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void
+hist_add(bench_hist* h, uint64_t v)
+{
+	uint32_t idx;
+
+	if (v < HIST_SUBS) {
+		idx = (uint32_t)v;
+	}
+	else {
+		uint32_t msb = 63 - (uint32_t)__builtin_clzll(v);
+		uint32_t shift = msb - HIST_SUB_BITS;
+
+		idx = ((shift + 1) << HIST_SUB_BITS) + (uint32_t)((v >> shift) & (HIST_SUBS - 1));
+	}
+
+	h->counts[idx]++;
+	h->n++;
+
+	if (v > h->max) {
+		h->max = v;
+	}
+}
+
+static void
+hist_merge(bench_hist* into, const bench_hist* from)
+{
+	for (uint32_t i = 0; i < HIST_BUCKETS; i++) {
+		into->counts[i] += from->counts[i];
+	}
+
+	into->n += from->n;
+
+	if (from->max > into->max) {
+		into->max = from->max;
+	}
+}
+
+// Returns microseconds, the upper edge of the bucket holding the percentile.
+static double
+hist_percentile(const bench_hist* h, double p)
+{
+	if (h->n == 0) {
+		return 0.0;
+	}
+
+	uint64_t rank = (uint64_t)(p * h->n + 0.5);
+	uint64_t seen = 0;
+
+	if (rank == 0) {
+		rank = 1;
+	}
+
+	for (uint32_t i = 0; i < HIST_BUCKETS; i++) {
+		seen += h->counts[i];
+
+		if (seen >= rank) {
+			if (i < HIST_SUBS) {
+				return (i + 1) / 1e3;
+			}
+
+			uint32_t shift = (i >> HIST_SUB_BITS) - 1;
+			uint64_t upper = (uint64_t)(HIST_SUBS + (i & (HIST_SUBS - 1)) + 1) << shift;
+
+			return (upper < h->max ? upper : h->max) / 1e3;
+		}
+	}
+
+	return h->max / 1e3;
+}
+
+static void
+bench_report(const bench_config* cfg, const bench_stats* total, double secs)
+{
+	uint64_t all = 0;
+
+	printf("%u threads, %u keys, %u bins, %u byte values, %s format, %s reads, %s, %.2f s\n",
+			cfg->threads, cfg->keys, cfg->bins, cfg->value_size,
+			cfg->compact ? "compact" : "map", cfg->native ? "native" : "udf",
+			cfg->standin ? "stand-in" : "server", secs);
+	printf("%-6s %10s %10s %8s %8s %10s %10s %10s %10s\n", "op", "ops",
+			"ops/s", "miss", "errors", "p50 us", "p99 us", "p999 us", "max us");
+
+	for (uint32_t op = 0; op < OP_MAX; op++) {
+		const bench_hist* h = &total->hist[op];
+
+		if (h->n == 0) {
+			continue;
+		}
+
+		all += h->n;
+
+		printf("%-6s %10" PRIu64 " %10.0f %8" PRIu64 " %8" PRIu64 " %10.1f %10.1f %10.1f %10.1f\n",
+				OP_NAMES[op], h->n, h->n / secs, total->miss[op],
+				total->errors[op], hist_percentile(h, 0.50),
+				hist_percentile(h, 0.99), hist_percentile(h, 0.999),
+				h->max / 1e3);
+	}
+
+	printf("%-6s %10" PRIu64 " %10.0f\n", "total", all, all / secs);
+
+	if (total->first_err.code != AEROSPIKE_OK) {
+		printf("first error: %d - %s\n", total->first_err.code,
+				total->first_err.message);
+	}
+}
+
+static bool
+bench_report_json(const bench_config* cfg, const bench_stats* total, double secs)
+{
+	bool to_stdout = strcmp(cfg->json_path, "-") == 0;
+	FILE* f = to_stdout ? stdout : fopen(cfg->json_path, "w");
+
+	if (! f) {
+		fprintf(stderr, "cannot open %s\n", cfg->json_path);
+		return false;
+	}
+
+	uint64_t all = 0;
+
+	fprintf(f, "{\"config\":{\"threads\":%u,\"keys\":%u,\"bins\":%u,"
+			"\"value_size\":%u,\"format\":\"%s\",\"read_mode\":\"%s\","
+			"\"target\":\"%s\"},",
+			cfg->threads, cfg->keys, cfg->bins, cfg->value_size,
+			cfg->compact ? "compact" : "map", cfg->native ? "native" : "udf",
+			cfg->standin ? "standin" : "server");
+	fprintf(f, "\"seconds\":%.3f,\"ops\":{", secs);
+
+	const char* sep = "";
+
+	for (uint32_t op = 0; op < OP_MAX; op++) {
+		const bench_hist* h = &total->hist[op];
+
+		if (h->n == 0) {
+			continue;
+		}
+
+		all += h->n;
+
+		fprintf(f, "%s\"%s\":{\"ops\":%" PRIu64 ",\"ops_per_sec\":%.1f,"
+				"\"ok\":%" PRIu64 ",\"miss\":%" PRIu64 ",\"errors\":%" PRIu64 ","
+				"\"p50_us\":%.1f,\"p99_us\":%.1f,\"p999_us\":%.1f,\"max_us\":%.1f}",
+				sep, OP_NAMES[op], h->n, h->n / secs, total->ok[op],
+				total->miss[op], total->errors[op], hist_percentile(h, 0.50),
+				hist_percentile(h, 0.99), hist_percentile(h, 0.999),
+				h->max / 1e3);
+		sep = ",";
+	}
+
+	fprintf(f, "},\"total\":{\"ops\":%" PRIu64 ",\"ops_per_sec\":%.1f}}\n",
+			all, all / secs);
+
+	if (! to_stdout) {
+		fclose(f);
+	}
+
+	return true;
+}
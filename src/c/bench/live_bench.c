@@ -0,0 +1,198 @@
+/*******************************************************************************
+ * Copyright 2008-2015 by Aerospike.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ ******************************************************************************/
+
+
+
+
+//==========================================================
+// Includes
+//
+
+#include "as_expbin_live.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+
+//==========================================================
+// Constants
+//
+
+static const char* const ISA_NAMES[] = { "scalar", "sse4.2", "avx2" };
+
+
+//==========================================================
+// Forward Declarations
+//
+
+static double bench_secs(void);
+static uint32_t bench_rand(uint64_t* seed);
+static uint32_t bench_branchy(const uint32_t* expiry, uint32_t n, uint32_t now, uint64_t* mask);
+
+
+//==========================================================
+// Main
+//
+
+int
+main(int argc, char* argv[])
+{
+	uint32_t n = 4 * 1024 * 1024 + 17;
+	uint32_t rounds = 50;
+	uint32_t live_pct = 50;
+	uint32_t never_pct = 10;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:r:l:z:")) != -1) {
+		switch (c) {
+		case 'n':
+			n = (uint32_t)strtoul(optarg, NULL, 10);
+			break;
+		case 'r':
+			rounds = (uint32_t)strtoul(optarg, NULL, 10);
+			break;
+		case 'l':
+			live_pct = (uint32_t)strtoul(optarg, NULL, 10);
+			break;
+		case 'z':
+			never_pct = (uint32_t)strtoul(optarg, NULL, 10);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n expiry times] [-r rounds] [-l live %%] [-z never expiring %%]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (n == 0 || rounds == 0) {
+		fprintf(stderr, "expiry times and rounds must be positive\n");
+		return 1;
+	}
+
+	uint32_t words = (n + 63) / 64;
+	uint32_t* expiry = malloc(n * sizeof(uint32_t));
+	uint64_t* want = malloc(words * sizeof(uint64_t));
+	uint64_t* got = malloc(words * sizeof(uint64_t));
+
+	if (! expiry || ! want || ! got) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	// Randomly mixed, so the branchy baseline mispredicts as it would on
+	// real data.
+	uint64_t seed = 0x9E3779B97F4A7C15ULL;
+	uint32_t now = 500000000;
+
+	for (uint32_t i = 0; i < n; i++) {
+		uint32_t r = bench_rand(&seed) % 100;
+		uint32_t delta = 1 + bench_rand(&seed) % 86400;
+
+		expiry[i] = r < never_pct ? 0 :
+				(r < never_pct + (100 - never_pct) * live_pct / 100 ?
+						now + delta - 1 : now - delta);
+	}
+
+	uint32_t want_live = bench_branchy(expiry, n, now, want);
+	as_expbin_isa best = as_expbin_live_isa();
+
+	printf("expiry times %u x %u rounds, %u live, dispatch picks %s\n", n,
+			rounds, want_live, ISA_NAMES[best]);
+
+	double base = 0.0;
+	int rc = 0;
+
+	for (int isa = -1; isa <= (int)best; isa++) {
+		uint32_t live = 0;
+		double t0 = bench_secs();
+
+		for (uint32_t r = 0; r < rounds; r++) {
+			live = isa < 0 ? bench_branchy(expiry, n, now, got) :
+					as_expbin_live_mask_isa((as_expbin_isa)isa, expiry, n, now,
+							got);
+		}
+
+		double ns = (bench_secs() - t0) * 1e9 / ((double)n * rounds);
+
+		if (isa < 0) {
+			base = ns;
+		}
+
+		printf("%-10s %6.3f ns/expiry %8.1f M/s  x%.1f\n",
+				isa < 0 ? "branchy" : ISA_NAMES[isa], ns, 1e3 / ns, base / ns);
+
+		if (live != want_live || memcmp(got, want, words * sizeof(uint64_t)) != 0) {
+			fprintf(stderr, "mismatch: %s\n", isa < 0 ? "branchy" : ISA_NAMES[isa]);
+			rc = 1;
+		}
+	}
+
+	free(got);
+	free(want);
+	free(expiry);
+	return rc;
+}
+
+
+//==========================================================
+// Local Helpers
+//
+
+static double
+bench_secs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint32_t
+bench_rand(uint64_t* seed)
+{
+	// xorshift64*
+	*seed ^= *seed >> 12;
+	*seed ^= *seed << 25;
+	*seed ^= *seed >> 27;
+	return (uint32_t)((*seed * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+// One expiry at a time, the way the library checked them before.
+static uint32_t
+bench_branchy(const uint32_t* expiry, uint32_t n, uint32_t now, uint64_t* mask)
+{
+	uint32_t live = 0;
+
+	memset(mask, 0, ((n + 63) / 64) * sizeof(uint64_t));
+
+	for (uint32_t i = 0; i < n; i++) {
+		if (expiry[i] != 0 && now > expiry[i]) {
+			continue;
+		}
+
+		mask[i / 64] |= 1ULL << (i % 64);
+		live++;
+	}
+
+	return live;
+}
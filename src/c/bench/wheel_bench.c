@@ -0,0 +1,195 @@
+/*******************************************************************************
+ * Copyright 2008-2015 by Aerospike.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ ******************************************************************************/
+
+
+
+//==========================================================
+// Includes
+//
+
+#include "as_expbin_wheel.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+
+//==========================================================
+// Typedefs
+//
+
+typedef struct bench_entry_s {
+	as_expbin_timer timer;
+	uint32_t expiry;
+} bench_entry;
+
+typedef struct bench_state_s {
+	uint32_t now;
+	uint32_t step;
+	uint32_t late;
+} bench_state;
+
+
+//==========================================================
+// Forward Declarations
+//
+
+static double bench_secs(void);
+static uint32_t bench_rand(uint64_t* seed);
+static void bench_fired(as_expbin_timer* timer, void* udata);
+
+
+//==========================================================
+// Main
+//
+
+int
+main(int argc, char* argv[])
+{
+	uint32_t n = 2000000;
+	uint32_t horizon = 30 * 86400;
+	uint32_t cancel_pct = 25;
+	uint32_t step = 1;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:h:c:s:")) != -1) {
+		switch (c) {
+		case 'n':
+			n = (uint32_t)strtoul(optarg, NULL, 10);
+			break;
+		case 'h':
+			horizon = (uint32_t)strtoul(optarg, NULL, 10);
+			break;
+		case 'c':
+			cancel_pct = (uint32_t)strtoul(optarg, NULL, 10);
+			break;
+		case 's':
+			step = (uint32_t)strtoul(optarg, NULL, 10);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n timers] [-h horizon secs] [-c cancel %%] [-s advance step secs]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (n == 0 || horizon == 0 || step == 0) {
+		fprintf(stderr, "timers, horizon and step must be positive\n");
+		return 1;
+	}
+
+	bench_entry* entries = calloc(n, sizeof(bench_entry));
+	as_expbin_wheel* wheel = malloc(sizeof(as_expbin_wheel));
+
+	if (! entries || ! wheel) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	uint64_t seed = 0x9E3779B97F4A7C15ULL;
+	uint32_t start = 500000000;
+
+	as_expbin_wheel_init(wheel, start);
+
+	double t0 = bench_secs();
+
+	for (uint32_t i = 0; i < n; i++) {
+		entries[i].expiry = start + 1 + bench_rand(&seed) % horizon;
+		as_expbin_wheel_insert(wheel, &entries[i].timer, entries[i].expiry);
+	}
+
+	double t1 = bench_secs();
+	uint32_t cancelled = 0;
+
+	for (uint32_t i = 0; i < n; i++) {
+		if (bench_rand(&seed) % 100 < cancel_pct) {
+			as_expbin_wheel_cancel(wheel, &entries[i].timer);
+			cancelled++;
+		}
+	}
+
+	double t2 = bench_secs();
+	bench_state state = { .now = start, .step = step, .late = 0 };
+	uint32_t fired = 0;
+	uint32_t advances = 0;
+
+	while (state.now < start + horizon) {
+		state.now += step;
+		fired += as_expbin_wheel_advance(wheel, state.now, bench_fired, &state);
+		advances++;
+	}
+
+	double t3 = bench_secs();
+
+	printf("timers     %u over %u s, %u cancelled, advance step %u s\n", n, horizon, cancelled, step);
+	printf("insert     %8.1f ns/op\n", (t1 - t0) * 1e9 / n);
+	printf("cancel     %8.1f ns/op\n", cancelled ? (t2 - t1) * 1e9 / cancelled : 0.0);
+	printf("advance    %8.1f ns/fired, %.1f us/advance\n",
+			fired ? (t3 - t2) * 1e9 / fired : 0.0, (t3 - t2) * 1e6 / advances);
+
+	int rc = 0;
+
+	if (fired + cancelled != n || wheel->count != 0 || state.late != 0) {
+		fprintf(stderr, "mismatch: fired %u cancelled %u pending %u late %u\n",
+				fired, cancelled, wheel->count, state.late);
+		rc = 1;
+	}
+
+	free(wheel);
+	free(entries);
+	return rc;
+}
+
+
+//==========================================================
+// Local Helpers
+//
+
+static double
+bench_secs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint32_t
+bench_rand(uint64_t* seed)
+{
+	// xorshift64*
+	*seed ^= *seed >> 12;
+	*seed ^= *seed << 25;
+	*seed ^= *seed >> 27;
+	return (uint32_t)((*seed * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static void
+bench_fired(as_expbin_timer* timer, void* udata)
+{
+	bench_entry* entry = AS_EXPBIN_TIMER_OWNER(timer, bench_entry, timer);
+	bench_state* state = (bench_state*)udata;
+
+	// A timer must fire on the advance that first reaches its expiry.
+	if (entry->expiry > state->now || state->now - entry->expiry >= state->step) {
+		state->late++;
+	}
+}
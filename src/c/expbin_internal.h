@@ -0,0 +1,138 @@
+/*******************************************************************************
+ * Copyright 2008-2015 by Aerospike.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ ******************************************************************************/
+
+#pragma once
+
+// Helpers shared by the library's translation units. Not installed, not part
+// of the public API.
+
+//==========================================================
+// Includes
+//
+
+#include <stdint.h>
+
+#include <aerospike/aerospike_index.h>
+#include <aerospike/as_arraylist.h>
+#include <aerospike/as_error.h>
+#include <aerospike/as_key.h>
+#include <aerospike/as_map.h>
+#include <aerospike/as_policy.h>
+#include <aerospike/as_record.h>
+#include <aerospike/as_status.h>
+#include <aerospike/as_val.h>
+
+#include "as_expbin.h"
+
+//==========================================================
+// Internal API
+//
+
+// Count a NULL terminated bin name array, failing past AS_EXPBIN_MAX_BINS.
+as_status expbin_count_bins(as_error* err, const char* bins[], uint32_t* n_bins);
+
+// Append bin names to list as strings in the thread's scratch. They are not
+// freed when the list is destroyed, so the list must not outlive the call
+// that built it, and a thread may only have one such list at a time.
+void expbin_append_names(as_arraylist* list, const char* bins[], uint32_t n_bins);
+
+// Apply a module function to a record.
+as_status expbin_apply(as_expbin* eb, as_error* err, const as_policy_apply* policy, const as_key* key, const char* fn, as_list* arglist, as_val** result);
+
+// Read bins of a record, see aerospike_key_select().
+as_status expbin_select(as_expbin* eb, as_error* err, const as_policy_read* policy, const as_key* key, const char* bins[], as_record** rec);
+
+// Apply a module function, taking bin names and optionally a trailing options
+// map as arguments, to every record in the handle's namespace and set with a
+// background scan, and wait for it. Takes ownership of opts, which may be
+// NULL.
+as_status expbin_scan_apply(as_expbin* eb, as_error* err, const as_policy_scan* policy, const char* fn, const char* bins[], as_map* opts);
+
+// Append put's arguments and the options for the handle, the write's policy
+// and flags to list, which needs room for 4. Takes ownership of bin, reserves
+// val.
+void expbin_append_put_args(as_expbin* eb, const as_policy_apply* policy, as_arraylist* list, as_val* bin, as_val* val, int64_t bin_ttl, uint32_t flags);
+
+// Append puts' or touch's entries and the options for the handle, the
+// write's policy and flags to list, which needs room for one more than the
+// entries. Reserves each entry.
+void expbin_append_puts_args(as_expbin* eb, const as_policy_apply* policy, as_arraylist* list, const as_list* entries, uint32_t flags);
+
+// The record TTL the server applies to a UDF write with policy, when the
+// client sets one: seconds, or AS_RECORD_NO_EXPIRE_TTL. 0 when the record
+// gets the namespace default-ttl or keeps its own.
+uint32_t expbin_write_ttl(const as_expbin* eb, const as_policy_apply* policy);
+
+// The module's trailing options map, marked with opts = 1, for the handle's
+// settings, as_expbin_write_flags and a write's expbin_write_ttl() (0 for
+// reads and scans), or NULL when all are at their defaults. A new reference
+// to a map the thread reuses while the settings are unchanged, so it must not
+// be modified. Learns the handle's default_ttl first if it is unknown.
+as_map* expbin_opts_new(as_expbin* eb, uint32_t flags, uint32_t write_ttl);
+
+// Create a secondary index on bin for the handle's namespace and set, named
+// <set>_<bin>, and wait for it. An existing index is not an error.
+as_status expbin_index_create(as_expbin* eb, as_error* err, const as_policy_info* policy, const char* bin, as_index_type type);
+
+// Cached read path, see as_expbin_s.cache.
+as_status expbin_get_cached(as_expbin* eb, as_error* err, const as_policy_apply* policy, const as_key* key, const char* bins[], uint32_t n_bins, as_map** result);
+
+// Look up a bin of a record read at now. true if cached, with val set to a
+// new reference, or to NULL for a bin cached as absent. gen is set to the
+// invalidation generation to pass to expbin_cache_put().
+bool expbin_cache_get(as_expbin_cache* cache, const as_key* key, const char* bin, int64_t now, as_val** val, uint64_t* gen);
+
+// Cache a bin read at now. Reserves val, NULL caches the bin as absent.
+// expiry is the stored expiry of a live expire bin, 0 otherwise. Dropped if
+// the bin's shard was invalidated since the miss that returned gen.
+void expbin_cache_put(as_expbin_cache* cache, const as_key* key, const char* bin, as_val* val, int64_t expiry, int64_t now, uint64_t gen);
+
+// Drop a bin written through a handle, and its record if cached as missing.
+void expbin_cache_forget(as_expbin_cache* cache, const as_key* key, const char* bin);
+
+// Drop the bins named by the "bin" fields of puts or touch entries.
+void expbin_cache_forget_entries(as_expbin_cache* cache, const as_key* key, const as_list* entries);
+
+// put, puts and touch answer 0 on success and 1 when a bin TTL is rejected.
+// put of a normal bin answers the status of the record update.
+as_status expbin_check_code(as_error* err, const char* fn, as_val* result);
+
+// get answers a map, or 1 when the record is missing.
+as_status expbin_check_map(as_error* err, as_val* result);
+
+// ttl answers the remaining seconds, -1 for no expiration, or nil.
+as_status expbin_check_ttl(as_error* err, const char* bin, as_val* result, int64_t* ttl);
+
+// Native read path, see AS_EXPBIN_READ_NATIVE.
+as_status expbin_get_native(as_expbin* eb, as_error* err, const as_policy_apply* policy, const as_key* key, const char* bins[], uint32_t n_bins, as_map** result);
+as_status expbin_ttl_native(as_expbin* eb, as_error* err, const as_policy_apply* policy, const as_key* key, const char* bin, int64_t* ttl);
+
+// The value get returns for a stored bin, as a new reference, or NULL if
+// there is none. Compact envelopes are decoded into a value of their type.
+as_val* expbin_live_val(const as_val* stored, int64_t now);
+
+// The value of a live map mode field entry {expiry, value}, borrowed from
+// entry, or NULL if the entry is expired or malformed.
+as_val* expbin_field_eval(const as_val* entry, int64_t now, int64_t* expiry);
+
+// Read policy carrying the transport settings of an apply policy.
+void expbin_read_policy(as_policy_read* read, const as_policy_apply* policy);
@@ -0,0 +1,534 @@
+/*******************************************************************************
+ * Copyright 2008-2015 by Aerospike.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ ******************************************************************************/
+
+
+
+//==========================================================
+// Includes
+//
+
+#include "as_expbin.h"
+#include "as_expbin_standin.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <aerospike/as_arraylist.h>
+#include <aerospike/as_bytes.h>
+#include <aerospike/as_integer.h>
+#include <aerospike/as_string.h>
+#include <aerospike/as_stringmap.h>
+
+
+//==========================================================
+// Constants
+//
+
+#define TEST_NS "test"
+#define TEST_SET "standin"
+
+// The stand-in's namespace default-ttl.
+#define TEST_DEFAULT_TTL 1000
+
+
+//==========================================================
+// Forward Declarations
+//
+
+static void test_writes(as_expbin* eb);
+static void test_expiry(as_expbin* eb);
+static void test_envelope(as_expbin* eb);
+static void test_cache(as_expbin* eb);
+static bool test_same(const as_val* a, const as_val* b);
+static as_record* test_select(as_expbin* eb, const as_key* key);
+static int64_t test_int(as_map* map, const char* name);
+static const char* test_str(as_map* map, const char* name);
+
+
+//==========================================================
+// Globals
+//
+
+static uint32_t g_checks;
+
+
+//==========================================================
+// Public API
+//
+
+#define CHECK(_cond) do { \
+	g_checks++; \
+	if (! (_cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, \
+				#_cond); \
+		exit(1); \
+	} \
+} while (0)
+
+// Expects an as_error err in scope.
+#define CHECK_OK(_call) do { \
+	g_checks++; \
+	if ((_call) != AEROSPIKE_OK) { \
+		fprintf(stderr, "%s:%d: %s failed: %d - %s\n", __FILE__, __LINE__, \
+				#_call, err.code, err.message); \
+		exit(1); \
+	} \
+} while (0)
+
+// Runs put, puts, get, touch, ttl, clean, mput and lappend through the
+// stand-in, round trips compact envelopes between C and the module, and
+// checks a cached get answers as an uncached one, with the module at the path
+// given, ../../expire_bin.lua by default.
+int
+main(int argc, char* argv[])
+{
+	const char* path = argc > 1 ? argv[1] : "../../expire_bin.lua";
+	as_expbin_standin* si = as_expbin_standin_new(TEST_DEFAULT_TTL);
+
+	CHECK(si != NULL);
+
+	as_expbin eb;
+	as_error err;
+
+	CHECK(as_expbin_init(&eb, NULL, TEST_NS, TEST_SET) != NULL);
+	as_expbin_standin_attach(si, &eb);
+	as_expbin_standin_log(si, getenv("STANDIN_LOG") ? stderr : NULL);
+
+	CHECK_OK(as_expbin_register(&eb, &err, path));
+	CHECK(eb.default_ttl == TEST_DEFAULT_TTL);
+
+	test_writes(&eb);
+	test_expiry(&eb);
+	test_envelope(&eb);
+	test_cache(&eb);
+
+	as_expbin_destroy(&eb);
+	as_expbin_standin_destroy(si);
+
+	printf("stand-in: %u checks passed\n", g_checks);
+	return 0;
+}
+
+
+//==========================================================
+// Local Helpers
+//
+
+static void
+test_writes(as_expbin* eb)
+{
+	as_error err;
+	as_key key;
+	as_key_init_str(&key, TEST_NS, TEST_SET, "writes");
+
+	as_string a;
+	as_string_init(&a, "x", false);
+
+	CHECK_OK(as_expbin_put(eb, &err, NULL, &key, "a", (as_val*)&a, 100));
+
+	as_arraylist entries;
+	as_arraylist_init(&entries, 2, 0);
+	as_arraylist_append(&entries, (as_val*)as_expbin_entry_new("b",
+			(as_val*)as_integer_new(5), 200));
+	as_arraylist_append(&entries, (as_val*)as_expbin_entry_new("c",
+			(as_val*)as_string_new_strdup("plain"), AS_EXPBIN_TTL_NONE));
+	CHECK_OK(as_expbin_puts(eb, &err, NULL, &key, (as_list*)&entries));
+	as_arraylist_destroy(&entries);
+
+	const char* bins[] = { "a", "b", "c", "missing", NULL };
+	as_map* result = NULL;
+
+	CHECK_OK(as_expbin_get(eb, &err, NULL, &key, bins, &result));
+	CHECK(as_map_size(result) == 3);
+	CHECK(strcmp(test_str(result, "a"), "x") == 0);
+	CHECK(test_int(result, "b") == 5);
+	CHECK(strcmp(test_str(result, "c"), "plain") == 0);
+	as_map_destroy(result);
+
+	int64_t ttl = 0;
+
+	CHECK_OK(as_expbin_ttl(eb, &err, NULL, &key, "a", &ttl));
+	CHECK(ttl > 90 && ttl <= 100);
+
+	as_arraylist_init(&entries, 1, 0);
+	as_arraylist_append(&entries, (as_val*)as_expbin_entry_new("a", NULL, 50));
+	CHECK_OK(as_expbin_touch(eb, &err, NULL, &key, (as_list*)&entries));
+	as_arraylist_destroy(&entries);
+
+	CHECK_OK(as_expbin_ttl(eb, &err, NULL, &key, "a", &ttl));
+	CHECK(ttl > 40 && ttl <= 50);
+
+	CHECK(as_expbin_ttl(eb, &err, NULL, &key, "c", &ttl) ==
+			AEROSPIKE_ERR_BIN_NOT_FOUND);
+
+	// A bin TTL past the record's is rejected, unless extending.
+	CHECK(as_expbin_put(eb, &err, NULL, &key, "d", (as_val*)&a, 5000) ==
+			AEROSPIKE_ERR_UDF);
+	CHECK_OK(as_expbin_put_flags(eb, &err, NULL, &key, "d", (as_val*)&a, 5000,
+			AS_EXPBIN_WRITE_EXTEND_TTL));
+
+	as_record* rec = test_select(eb, &key);
+
+	CHECK(rec->ttl >= 5000);
+	CHECK(as_record_get(rec, AS_EXPBIN_NEXT_BIN) != NULL);
+	as_record_destroy(rec);
+
+	// Map mode.
+	as_arraylist_init(&entries, 2, 0);
+	as_arraylist_append(&entries, (as_val*)as_expbin_field_new("f1",
+			(as_val*)as_integer_new(1), 100));
+	as_arraylist_append(&entries, (as_val*)as_expbin_field_new("f2",
+			(as_val*)as_integer_new(2), AS_EXPBIN_TTL_NEVER));
+	CHECK_OK(as_expbin_mput(eb, &err, NULL, &key, "m", (as_list*)&entries));
+	as_arraylist_destroy(&entries);
+
+	const char* fields[] = { NULL };
+
+	CHECK_OK(as_expbin_mget(eb, &err, NULL, &key, "m", fields, &result));
+	CHECK(as_map_size(result) == 2);
+	CHECK(test_int(result, "f1") == 1);
+	CHECK(test_int(result, "f2") == 2);
+	as_map_destroy(result);
+
+	CHECK_OK(as_expbin_mttl(eb, &err, NULL, &key, "m", "f2", &ttl));
+	CHECK(ttl == AS_EXPBIN_TTL_NEVER);
+
+	// List mode.
+	as_arraylist_init(&entries, 2, 0);
+	as_arraylist_append(&entries, (as_val*)as_expbin_elem_new(
+			(as_val*)as_integer_new(10), 100));
+	as_arraylist_append(&entries, (as_val*)as_expbin_elem_new(
+			(as_val*)as_integer_new(11), 200));
+	CHECK_OK(as_expbin_lappend(eb, &err, NULL, &key, "l", (as_list*)&entries));
+	as_arraylist_destroy(&entries);
+
+	as_list* elems = NULL;
+
+	CHECK_OK(as_expbin_lget(eb, &err, NULL, &key, "l", &elems));
+	CHECK(as_list_size(elems) == 2);
+	CHECK(as_list_get_int64(elems, 0) == 10);
+	CHECK(as_list_get_int64(elems, 1) == 11);
+	as_list_destroy(elems);
+}
+
+static void
+test_expiry(as_expbin* eb)
+{
+	as_error err;
+	as_key mixed;
+	as_key only;
+	as_key_init_str(&mixed, TEST_NS, TEST_SET, "mixed");
+	as_key_init_str(&only, TEST_NS, TEST_SET, "only");
+
+	as_integer v;
+	as_integer_init(&v, 7);
+
+	// One record with a plain bin, one with only expire bins.
+	CHECK_OK(as_expbin_put(eb, &err, NULL, &mixed, "short", (as_val*)&v, 1));
+	CHECK_OK(as_expbin_put(eb, &err, NULL, &mixed, "plain", (as_val*)&v,
+			AS_EXPBIN_TTL_NONE));
+	CHECK_OK(as_expbin_put(eb, &err, NULL, &only, "short", (as_val*)&v, 1));
+	CHECK_OK(as_expbin_put(eb, &err, NULL, &only, "long", (as_val*)&v, 300));
+
+	as_arraylist entries;
+	as_arraylist_init(&entries, 2, 0);
+	as_arraylist_append(&entries, (as_val*)as_expbin_field_new("f1",
+			(as_val*)as_integer_new(1), 1));
+	as_arraylist_append(&entries, (as_val*)as_expbin_field_new("f2",
+			(as_val*)as_integer_new(2), 300));
+	CHECK_OK(as_expbin_mput(eb, &err, NULL, &mixed, "m", (as_list*)&entries));
+	as_arraylist_destroy(&entries);
+
+	as_arraylist_init(&entries, 2, 0);
+	as_arraylist_append(&entries, (as_val*)as_expbin_elem_new(
+			(as_val*)as_integer_new(20), 1));
+	as_arraylist_append(&entries, (as_val*)as_expbin_elem_new(
+			(as_val*)as_integer_new(21), 300));
+	CHECK_OK(as_expbin_lappend(eb, &err, NULL, &mixed, "l",
+			(as_list*)&entries));
+	as_arraylist_destroy(&entries);
+
+	// A bin is live through its expiry second.
+	sleep(3);
+
+	const char* bins[] = { "short", "plain", NULL };
+	as_map* result = NULL;
+
+	CHECK_OK(as_expbin_get(eb, &err, NULL, &mixed, bins, &result));
+	CHECK(as_map_size(result) == 1);
+	CHECK(test_int(result, "plain") == 7);
+	as_map_destroy(result);
+
+	const char* fields[] = { NULL };
+
+	CHECK_OK(as_expbin_mget(eb, &err, NULL, &mixed, "m", fields, &result));
+	CHECK(as_map_size(result) == 1);
+	CHECK(test_int(result, "f2") == 2);
+	as_map_destroy(result);
+
+	as_list* elems = NULL;
+
+	CHECK_OK(as_expbin_lget(eb, &err, NULL, &mixed, "l", &elems));
+	CHECK(as_list_size(elems) == 1);
+	CHECK(as_list_get_int64(elems, 0) == 21);
+	as_list_destroy(elems);
+
+	// Clean erases the expired bins and, shrinking, lowers the TTL of the
+	// record that holds only expire bins.
+	eb->clean_shrink = true;
+
+	const char* clean_bins[] = { "short", "long", NULL };
+
+	CHECK_OK(as_expbin_clean(eb, &err, NULL, clean_bins));
+
+	as_record* rec = test_select(eb, &mixed);
+
+	CHECK(as_record_get(rec, "short") == NULL);
+	CHECK(as_record_get(rec, "plain") != NULL);
+	CHECK(rec->ttl > 300);
+	as_record_destroy(rec);
+
+	rec = test_select(eb, &only);
+
+	CHECK(as_record_get(rec, "short") == NULL);
+	CHECK(as_record_get(rec, "long") != NULL);
+	CHECK(rec->ttl <= 300);
+	as_record_destroy(rec);
+
+	const char* mclean_bins[] = { "m", "l", NULL };
+
+	CHECK_OK(as_expbin_mclean(eb, &err, NULL, mclean_bins));
+
+	rec = test_select(eb, &mixed);
+
+	CHECK(as_map_size((as_map*)as_record_get_map(rec, "m")) == 1);
+	CHECK(as_list_size((as_list*)as_record_get_list(rec, "l")) == 1);
+	as_record_destroy(rec);
+
+	eb->clean_shrink = false;
+}
+
+// An envelope from as_expbin_env_encode() must read in the module as its own,
+// and one the module wrote must decode with as_expbin_env_decode(), for each
+// payload type.
+static void
+test_envelope(as_expbin* eb)
+{
+	as_error err;
+	as_key key;
+	as_key_init_str(&key, TEST_NS, TEST_SET, "envelope");
+
+	// 1234567, big-endian.
+	uint8_t int_payload[] = { 0, 0, 0, 0, 0, 0x12, 0xd6, 0x87 };
+	uint8_t str_payload[] = { 'h', 'e', 'l', 'l', 'o' };
+	uint8_t blob_payload[] = { 0x00, 0x01, AS_EXPBIN_ENV_MAGIC0,
+			AS_EXPBIN_ENV_MAGIC1, 0xff };
+
+	as_integer int_val;
+	as_string str_val;
+	as_bytes blob_val;
+	as_integer_init(&int_val, 1234567);
+	as_string_init(&str_val, "hello", false);
+	as_bytes_init_wrap(&blob_val, blob_payload, sizeof(blob_payload), false);
+
+	struct {
+		// Written by C, and by the module.
+		const char* c_bin;
+		const char* lua_bin;
+		as_bytes_type type;
+		const uint8_t* payload;
+		uint32_t size;
+		as_val* val;
+	} cases[] = {
+		{ "c_int", "lua_int", AS_BYTES_INTEGER, int_payload,
+				sizeof(int_payload), (as_val*)&int_val },
+		{ "c_str", "lua_str", AS_BYTES_STRING, str_payload,
+				sizeof(str_payload), (as_val*)&str_val },
+		{ "c_blob", "lua_blob", AS_BYTES_BLOB, blob_payload,
+				sizeof(blob_payload), (as_val*)&blob_val }
+	};
+	uint32_t n_cases = sizeof(cases) / sizeof(cases[0]);
+	int64_t now = as_expbin_now();
+
+	for (uint32_t i = 0; i < n_cases; i++) {
+		uint8_t buf[AS_EXPBIN_ENV_HEADER_SIZE + 8];
+		as_bytes env;
+
+		CHECK(as_expbin_env_encode(&env, buf, sizeof(buf),
+				(uint32_t)(now + 100), cases[i].type, cases[i].payload,
+				cases[i].size) == &env);
+
+		// Written as a normal bin, the module must take it for an expire bin.
+		CHECK_OK(as_expbin_put(eb, &err, NULL, &key, cases[i].c_bin,
+				(as_val*)&env, AS_EXPBIN_TTL_NONE));
+
+		const char* bins[] = { cases[i].c_bin, NULL };
+		as_map* result = NULL;
+
+		CHECK_OK(as_expbin_get(eb, &err, NULL, &key, bins, &result));
+		CHECK(test_same(as_stringmap_get(result, cases[i].c_bin),
+				cases[i].val));
+		as_map_destroy(result);
+
+		int64_t ttl = 0;
+
+		CHECK_OK(as_expbin_ttl(eb, &err, NULL, &key, cases[i].c_bin, &ttl));
+		CHECK(ttl > 90 && ttl <= 100);
+	}
+
+	eb->format = AS_EXPBIN_FORMAT_COMPACT;
+
+	for (uint32_t i = 0; i < n_cases; i++) {
+		CHECK_OK(as_expbin_put(eb, &err, NULL, &key, cases[i].lua_bin,
+				cases[i].val, 100));
+	}
+
+	eb->format = AS_EXPBIN_FORMAT_MAP;
+
+	as_record* rec = test_select(eb, &key);
+
+	for (uint32_t i = 0; i < n_cases; i++) {
+		const char* names[] = { cases[i].c_bin, cases[i].lua_bin };
+
+		for (uint32_t j = 0; j < 2; j++) {
+			as_bytes* stored = as_record_get_bytes(rec, names[j]);
+			uint32_t expiry;
+			as_bytes_type type;
+			as_bytes payload;
+
+			CHECK(stored != NULL);
+			CHECK(as_expbin_env_decode(stored, &expiry, &type, &payload));
+			CHECK(type == cases[i].type);
+			CHECK(expiry >= now + 90 && expiry <= now + 101);
+			CHECK(as_bytes_size(&payload) == cases[i].size);
+			CHECK(memcmp(as_bytes_get(&payload), cases[i].payload,
+					cases[i].size) == 0);
+		}
+	}
+
+	as_record_destroy(rec);
+}
+
+// A cached get must fail for a missing record as an uncached one does, from
+// the cache the second time, and see the record once a put creates it.
+static void
+test_cache(as_expbin* eb)
+{
+	as_error err;
+	as_key key;
+	as_key_init_str(&key, TEST_NS, TEST_SET, "cached");
+
+	const char* bins[] = { "a", NULL };
+	as_map* result = NULL;
+
+	CHECK(as_expbin_get(eb, &err, NULL, &key, bins, &result) ==
+			AEROSPIKE_ERR_RECORD_NOT_FOUND);
+
+	as_expbin_cache* cache = as_expbin_cache_new(NULL);
+
+	CHECK(cache != NULL);
+	eb->cache = cache;
+
+	CHECK(as_expbin_get(eb, &err, NULL, &key, bins, &result) ==
+			AEROSPIKE_ERR_RECORD_NOT_FOUND);
+	CHECK(as_expbin_get(eb, &err, NULL, &key, bins, &result) ==
+			AEROSPIKE_ERR_RECORD_NOT_FOUND);
+
+	as_expbin_cache_stats stats;
+	as_expbin_cache_stats_get(cache, &stats);
+	CHECK(stats.hits == 1);
+
+	as_integer v;
+	as_integer_init(&v, 5);
+
+	CHECK_OK(as_expbin_put(eb, &err, NULL, &key, "b", (as_val*)&v, 300));
+
+	// The record now exists without the bin asked for.
+	CHECK_OK(as_expbin_get(eb, &err, NULL, &key, bins, &result));
+	CHECK(as_map_size(result) == 0);
+	as_map_destroy(result);
+
+	const char* both[] = { "a", "b", NULL };
+
+	CHECK_OK(as_expbin_get(eb, &err, NULL, &key, both, &result));
+	CHECK(as_map_size(result) == 1);
+	CHECK(test_int(result, "b") == 5);
+	as_map_destroy(result);
+
+	eb->cache = NULL;
+	as_expbin_cache_destroy(cache);
+}
+
+// Values as the module returns them: integers, strings and bytes.
+static bool
+test_same(const as_val* a, const as_val* b)
+{
+	if (! a || ! b || as_val_type(a) != as_val_type(b)) {
+		return false;
+	}
+
+	switch (as_val_type(a)) {
+	case AS_INTEGER:
+		return as_integer_get((as_integer*)a) == as_integer_get((as_integer*)b);
+	case AS_STRING:
+		return strcmp(as_string_get((as_string*)a),
+				as_string_get((as_string*)b)) == 0;
+	case AS_BYTES:
+		return as_bytes_size((as_bytes*)a) == as_bytes_size((as_bytes*)b) &&
+				memcmp(as_bytes_get((as_bytes*)a), as_bytes_get((as_bytes*)b),
+						as_bytes_size((as_bytes*)a)) == 0;
+	default:
+		return false;
+	}
+}
+
+// Reads a record as stored, through the handle's transport.
+static as_record*
+test_select(as_expbin* eb, const as_key* key)
+{
+	as_error err;
+	as_record* rec = NULL;
+
+	CHECK(eb->transport->select(eb->transport->udata, &err, NULL, key, NULL,
+			&rec) == AEROSPIKE_OK);
+	return rec;
+}
+
+static int64_t
+test_int(as_map* map, const char* name)
+{
+	as_integer* val = as_integer_fromval(as_stringmap_get(map, name));
+
+	CHECK(val != NULL);
+	return as_integer_get(val);
+}
+
+static const char*
+test_str(as_map* map, const char* name)
+{
+	as_string* val = as_string_fromval(as_stringmap_get(map, name));
+
+	CHECK(val != NULL);
+	return as_string_get(val);
+}
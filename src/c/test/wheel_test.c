@@ -0,0 +1,470 @@
+/*******************************************************************************
+ * Copyright 2008-2015 by Aerospike.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ ******************************************************************************/
+
+
+
+//==========================================================
+// Includes
+//
+
+#include "as_expbin_wheel.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+//==========================================================
+// Constants
+//
+
+#define N_RANDOM 20000
+
+
+//==========================================================
+// Typedefs
+//
+
+typedef struct test_entry_s {
+	as_expbin_timer timer;
+
+	// Times fired, and the wheel's clock at the last firing.
+	uint32_t fired;
+	uint32_t fired_at;
+
+	// Fired by an advance that started at or after the expiry, so it may
+	// fire later than its expiry.
+	bool late_ok;
+
+	// Re-inserted this many seconds later by the callback, if not 0, while
+	// repeats lasts.
+	uint32_t period;
+	uint32_t repeats;
+
+	// Inserted already due by the callback, if set.
+	struct test_entry_s* chain;
+} test_entry;
+
+
+//==========================================================
+// Forward Declarations
+//
+
+static void test_due_on_insert(void);
+static void test_cancel(void);
+static void test_reschedule(void);
+static void test_insert_from_callback(void);
+static void test_cascade_boundaries(void);
+static void test_large_jumps(void);
+static void test_near_max(void);
+static void test_fired(as_expbin_timer* timer, void* udata);
+static void test_boundary(uint32_t boundary);
+static uint32_t test_rand(uint64_t* seed);
+
+
+//==========================================================
+// Globals
+//
+
+static uint32_t g_checks;
+
+
+//==========================================================
+// Public API
+//
+
+#define CHECK(_cond) do { \
+	g_checks++; \
+	if (! (_cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, \
+				#_cond); \
+		exit(1); \
+	} \
+} while (0)
+
+int
+main(void)
+{
+	test_due_on_insert();
+	test_cancel();
+	test_reschedule();
+	test_insert_from_callback();
+	test_cascade_boundaries();
+	test_large_jumps();
+	test_near_max();
+
+	printf("wheel: %u checks passed\n", g_checks);
+	return 0;
+}
+
+
+//==========================================================
+// Local Helpers
+//
+
+static void
+test_due_on_insert(void)
+{
+	static as_expbin_wheel wheel;
+	as_expbin_wheel_init(&wheel, 1000);
+
+	test_entry e[3];
+	memset(e, 0, sizeof(e));
+
+	as_expbin_wheel_insert(&wheel, &e[0].timer, 0);
+	as_expbin_wheel_insert(&wheel, &e[1].timer, 999);
+	as_expbin_wheel_insert(&wheel, &e[2].timer, 1000);
+
+	for (uint32_t i = 0; i < 3; i++) {
+		e[i].late_ok = true;
+		CHECK(as_expbin_timer_pending(&e[i].timer));
+	}
+
+	CHECK(wheel.count == 3);
+
+	// Due timers fire on the next advance even if the clock doesn't move.
+	CHECK(as_expbin_wheel_advance(&wheel, 1000, test_fired, &wheel) == 3);
+	CHECK(wheel.count == 0);
+
+	for (uint32_t i = 0; i < 3; i++) {
+		CHECK(e[i].fired == 1);
+		CHECK(! as_expbin_timer_pending(&e[i].timer));
+	}
+
+	// Moving backwards only fires due timers.
+	as_expbin_wheel_insert(&wheel, &e[0].timer, 1001);
+	CHECK(as_expbin_wheel_advance(&wheel, 10, test_fired, &wheel) == 0);
+	CHECK(wheel.now == 1000);
+	CHECK(as_expbin_wheel_advance(&wheel, 1001, test_fired, &wheel) == 1);
+	CHECK(e[0].fired == 2 && e[0].fired_at == 1001);
+}
+
+static void
+test_cancel(void)
+{
+	static as_expbin_wheel wheel;
+	as_expbin_wheel_init(&wheel, 5000);
+
+	test_entry e[5];
+	memset(e, 0, sizeof(e));
+
+	// Cancelling a timer that was never inserted does nothing.
+	as_expbin_wheel_cancel(&wheel, &e[0].timer);
+	CHECK(wheel.count == 0);
+
+	// A due one, two sharing a level 0 slot, and one on each higher level.
+	as_expbin_wheel_insert(&wheel, &e[0].timer, 4000);
+	as_expbin_wheel_insert(&wheel, &e[1].timer, 5010);
+	as_expbin_wheel_insert(&wheel, &e[2].timer, 5010);
+	as_expbin_wheel_insert(&wheel, &e[3].timer, 5000 + 70000);
+	as_expbin_wheel_insert(&wheel, &e[4].timer, 5000 + 20000000);
+	CHECK(wheel.count == 5);
+
+	as_expbin_wheel_cancel(&wheel, &e[0].timer);
+	as_expbin_wheel_cancel(&wheel, &e[1].timer);
+	as_expbin_wheel_cancel(&wheel, &e[3].timer);
+	as_expbin_wheel_cancel(&wheel, &e[4].timer);
+	CHECK(wheel.count == 1);
+
+	// Cancelling twice is harmless.
+	as_expbin_wheel_cancel(&wheel, &e[1].timer);
+	CHECK(wheel.count == 1);
+
+	for (uint32_t i = 0; i < 5; i++) {
+		CHECK(as_expbin_timer_pending(&e[i].timer) == (i == 2));
+	}
+
+	// The slot's other timer still fires, on time.
+	CHECK(as_expbin_wheel_advance(&wheel, 5000 + 30000000, test_fired,
+			&wheel) == 1);
+	CHECK(e[2].fired == 1 && e[2].fired_at == 5010);
+
+	for (uint32_t i = 0; i < 5; i++) {
+		CHECK(e[i].fired == (i == 2 ? 1 : 0));
+	}
+
+	// Cancelling the last timer of a slot clears it, the clock then jumps.
+	as_expbin_wheel_insert(&wheel, &e[1].timer, wheel.now + 3);
+	as_expbin_wheel_cancel(&wheel, &e[1].timer);
+	CHECK(as_expbin_wheel_advance(&wheel, wheel.now + 1000, test_fired,
+			&wheel) == 0);
+}
+
+static void
+test_reschedule(void)
+{
+	static as_expbin_wheel wheel;
+	as_expbin_wheel_init(&wheel, 100);
+
+	test_entry e;
+	memset(&e, 0, sizeof(e));
+
+	// Earlier, across levels.
+	as_expbin_wheel_insert(&wheel, &e.timer, 100 + 100000);
+	as_expbin_wheel_insert(&wheel, &e.timer, 150);
+	CHECK(wheel.count == 1);
+	CHECK(as_expbin_wheel_advance(&wheel, 200000, test_fired, &wheel) == 1);
+	CHECK(e.fired == 1 && e.fired_at == 150);
+
+	// Later, and the old expiry passes without firing.
+	as_expbin_wheel_insert(&wheel, &e.timer, 200010);
+	as_expbin_wheel_insert(&wheel, &e.timer, 260000);
+	CHECK(wheel.count == 1);
+	CHECK(as_expbin_wheel_advance(&wheel, 259999, test_fired, &wheel) == 0);
+	CHECK(as_expbin_wheel_advance(&wheel, 260000, test_fired, &wheel) == 1);
+	CHECK(e.fired == 2 && e.fired_at == 260000);
+
+	// From due back to pending.
+	as_expbin_wheel_insert(&wheel, &e.timer, 1);
+	as_expbin_wheel_insert(&wheel, &e.timer, 260005);
+	CHECK(as_expbin_wheel_advance(&wheel, 260004, test_fired, &wheel) == 0);
+	CHECK(as_expbin_wheel_advance(&wheel, 260005, test_fired, &wheel) == 1);
+	CHECK(e.fired == 3 && e.fired_at == 260005);
+	CHECK(wheel.count == 0);
+}
+
+static void
+test_insert_from_callback(void)
+{
+	static as_expbin_wheel wheel;
+	as_expbin_wheel_init(&wheel, 0xFF00);
+
+	test_entry periodic;
+	test_entry chained;
+	memset(&periodic, 0, sizeof(periodic));
+	memset(&chained, 0, sizeof(chained));
+
+	// Re-inserts itself every 7 seconds, across a level 1 and a level 2
+	// boundary, and inserts chained already due each time.
+	periodic.period = 7;
+	periodic.repeats = 99;
+	periodic.chain = &chained;
+	chained.late_ok = true;
+
+	as_expbin_wheel_insert(&wheel, &periodic.timer, 0xFF00 + 7);
+
+	uint32_t fired = 0;
+
+	for (uint32_t now = 0xFF00; now <= 0xFF00 + 7 * 100; now += 3) {
+		fired += as_expbin_wheel_advance(&wheel, now, test_fired, &wheel);
+	}
+
+	// The last firing inserts chained, which fires on the advance after.
+	fired += as_expbin_wheel_advance(&wheel, 0xFF00 + 7 * 100, test_fired,
+			&wheel);
+	CHECK(chained.fired == 99);
+	fired += as_expbin_wheel_advance(&wheel, 0xFF00 + 7 * 100, test_fired,
+			&wheel);
+
+	CHECK(periodic.fired == 100);
+	CHECK(periodic.fired_at == 0xFF00 + 7 * 100);
+	CHECK(chained.fired == 100);
+	CHECK(fired == 200);
+	CHECK(wheel.count == 0);
+
+	// A callback inserting into the slot being fired, already due, in one
+	// big jump.
+	memset(&periodic, 0, sizeof(periodic));
+	memset(&chained, 0, sizeof(chained));
+	periodic.period = 1000;
+	periodic.repeats = 49;
+	periodic.chain = &chained;
+	chained.late_ok = true;
+
+	uint32_t start = wheel.now;
+
+	as_expbin_wheel_insert(&wheel, &periodic.timer, start + 1000);
+	as_expbin_wheel_advance(&wheel, start + 50 * 1000, test_fired, &wheel);
+	as_expbin_wheel_advance(&wheel, start + 50 * 1000, test_fired, &wheel);
+	CHECK(periodic.fired == 50);
+	CHECK(chained.fired == 50);
+	CHECK(wheel.count == 0);
+}
+
+static void
+test_cascade_boundaries(void)
+{
+	// Level 0 to 1, 1 to 2 and 2 to 3 turn over at these times, and all of
+	// them at once at the last.
+	test_boundary(1u << 8);
+	test_boundary(1u << 16);
+	test_boundary(1u << 24);
+	test_boundary(3u << 24);
+	test_boundary(0x12340000);
+}
+
+static void
+test_boundary(uint32_t boundary)
+{
+	static as_expbin_wheel wheel;
+	static const int32_t offsets[] = {
+		-2, -1, 0, 1, 2, 255, 256, 257, 65535, 65536, 65537
+	};
+	uint32_t n = sizeof(offsets) / sizeof(offsets[0]);
+	test_entry e[sizeof(offsets) / sizeof(offsets[0])][2];
+
+	memset(e, 0, sizeof(e));
+
+	// Once stepping a second at a time, once in a single jump.
+	for (uint32_t pass = 0; pass < 2; pass++) {
+		uint32_t start = boundary - 3;
+
+		as_expbin_wheel_init(&wheel, start);
+
+		for (uint32_t i = 0; i < n; i++) {
+			as_expbin_wheel_insert(&wheel, &e[i][pass].timer,
+					boundary + (uint32_t)offsets[i]);
+		}
+
+		uint32_t end = boundary + 65537;
+
+		if (pass == 0) {
+			for (uint32_t now = start + 1; now <= end; now++) {
+				as_expbin_wheel_advance(&wheel, now, test_fired, &wheel);
+			}
+		}
+		else {
+			as_expbin_wheel_advance(&wheel, end, test_fired, &wheel);
+		}
+
+		CHECK(wheel.count == 0);
+
+		for (uint32_t i = 0; i < n; i++) {
+			CHECK(e[i][pass].fired == 1);
+			CHECK(e[i][pass].fired_at == boundary + (uint32_t)offsets[i]);
+		}
+	}
+}
+
+static void
+test_large_jumps(void)
+{
+	static as_expbin_wheel wheel;
+	static test_entry e[N_RANDOM];
+	static uint32_t expiry[N_RANDOM];
+	uint64_t seed = 42;
+	uint32_t start = 1000000;
+
+	memset(e, 0, sizeof(e));
+	as_expbin_wheel_init(&wheel, start);
+
+	// Spread over every level, many sharing seconds.
+	for (uint32_t i = 0; i < N_RANDOM; i++) {
+		uint32_t bits = 1 + test_rand(&seed) % 31;
+		uint32_t delta = 1 + test_rand(&seed) % ((1u << bits) - 1);
+
+		expiry[i] = start + delta;
+		as_expbin_wheel_insert(&wheel, &e[i].timer, expiry[i]);
+	}
+
+	uint32_t now = start;
+
+	while (wheel.count != 0) {
+		uint32_t bits = test_rand(&seed) % 31;
+		uint32_t jump = test_rand(&seed) % (1u << bits);
+		uint32_t room = UINT32_MAX - now;
+
+		now += jump < room ? jump : room;
+		as_expbin_wheel_advance(&wheel, now, test_fired, &wheel);
+
+		// Every timer up to now has fired once, on time, and no other.
+		for (uint32_t i = 0; i < N_RANDOM; i += 97) {
+			CHECK(e[i].fired == (expiry[i] <= now ? 1 : 0));
+		}
+	}
+
+	for (uint32_t i = 0; i < N_RANDOM; i++) {
+		CHECK(e[i].fired == 1);
+		CHECK(e[i].fired_at == expiry[i]);
+	}
+}
+
+static void
+test_near_max(void)
+{
+	static as_expbin_wheel wheel;
+	static const uint32_t expiries[] = {
+		UINT32_MAX - 65536, UINT32_MAX - 256, UINT32_MAX - 255,
+		UINT32_MAX - 1, UINT32_MAX
+	};
+	uint32_t n = sizeof(expiries) / sizeof(expiries[0]);
+	test_entry e[sizeof(expiries) / sizeof(expiries[0])];
+
+	memset(e, 0, sizeof(e));
+	as_expbin_wheel_init(&wheel, UINT32_MAX - 70000);
+
+	for (uint32_t i = 0; i < n; i++) {
+		as_expbin_wheel_insert(&wheel, &e[i].timer, expiries[i]);
+	}
+
+	CHECK(as_expbin_wheel_advance(&wheel, UINT32_MAX - 2, test_fired,
+			&wheel) == 3);
+	CHECK(as_expbin_wheel_advance(&wheel, UINT32_MAX, test_fired,
+			&wheel) == 2);
+	CHECK(wheel.now == UINT32_MAX);
+	CHECK(wheel.count == 0);
+
+	for (uint32_t i = 0; i < n; i++) {
+		CHECK(e[i].fired == 1 && e[i].fired_at == expiries[i]);
+	}
+
+	// The clock can't pass the end of time, advancing there again returns.
+	as_expbin_wheel_insert(&wheel, &e[0].timer, UINT32_MAX);
+	CHECK(as_expbin_wheel_advance(&wheel, UINT32_MAX, test_fired,
+			&wheel) == 1);
+	CHECK(as_expbin_wheel_advance(&wheel, UINT32_MAX, test_fired,
+			&wheel) == 0);
+}
+
+// Checks every timer fires no earlier than its expiry, and exactly at it
+// unless it was inserted already due.
+static void
+test_fired(as_expbin_timer* timer, void* udata)
+{
+	as_expbin_wheel* wheel = (as_expbin_wheel*)udata;
+	test_entry* e = AS_EXPBIN_TIMER_OWNER(timer, test_entry, timer);
+
+	CHECK(! as_expbin_timer_pending(timer));
+	CHECK(timer->expiry <= wheel->now);
+	CHECK(e->late_ok || timer->expiry == wheel->now);
+
+	e->fired++;
+	e->fired_at = wheel->now;
+
+	if (e->period != 0 && e->repeats != 0) {
+		e->repeats--;
+		as_expbin_wheel_insert(wheel, timer, wheel->now + e->period);
+	}
+
+	if (e->chain) {
+		as_expbin_wheel_insert(wheel, &e->chain->timer, wheel->now);
+	}
+}
+
+static uint32_t
+test_rand(uint64_t* seed)
+{
+	*seed ^= *seed << 13;
+	*seed ^= *seed >> 7;
+	*seed ^= *seed << 17;
+	return (uint32_t)(*seed >> 16);
+}